@@ -0,0 +1,172 @@
+/*
+ *     filename: asm.h
+ *     partner 1 name: Jack Burton       Login: jburto05
+ *     partner 2 name: James Hartley        Login: jhartl01
+ *     date: April 13th, 2024
+ *     assignment: hw6
+ *
+ *     summary: Defines umasm's assembler: the sections of instructions,
+ *     labels and data that .ums modules assemble into, and the linker
+ *     that lays them out as one .um image
+ *
+*/
+
+#ifndef ASM_INCLUDED
+#define ASM_INCLUDED
+
+#include "memexec.h"
+
+/* Symbol of an item that refers to none */
+#define NO_SYMBOL UINT32_MAX
+
+/* What an item of a section is */
+typedef enum Item_kind {
+        ITEM_INSN = 0,  /* one instruction word */
+        ITEM_LABEL,     /* defines symbol at the next word */
+        ITEM_SPACE,     /* value zero words */
+        ITEM_WORD       /* one data word, value plus symbol's address */
+} Item_kind;
+
+/* Macro an item was expanded from, where the optimizer needs to know */
+typedef enum Macro_kind {
+        MACRO_NONE = 0,
+        MACRO_PUSH,
+        MACRO_POP
+} Macro_kind;
+
+/* Zero register of an item written with no .zero in force */
+#define NO_ZERO 0xFF
+
+/* Item
+ * Usage: One entry of a section, as the parser expands it from source
+ *
+ * Members:
+ * 	uint8_t kind: Item_kind
+ * 	uint8_t op: Um_opcode of an instruction
+ * 	uint8_t a, b, c: Its registers (only a, for LOADV)
+ * 	uint8_t temps: Bit per register that was a .temps temporary where
+ * 		the item was written, so free to clobber
+ * 	uint8_t zero: Register .zero named there, or NO_ZERO
+ * 	uint8_t macro: Macro_kind of the statement it came from
+ * 	uint32_t symbol: Label defined by ITEM_LABEL, or whose address is
+ * 		added to value (LOADV, ITEM_WORD); NO_SYMBOL for none
+ * 	uint32_t value: LOADV value, data word or .space size
+ * 	const char *file: Source file, for messages
+ * 	int line: Source line
+ *
+*/
+typedef struct Item {
+        uint8_t kind;
+        uint8_t op;
+        uint8_t a;
+        uint8_t b;
+        uint8_t c;
+        uint8_t temps;
+        uint8_t zero;
+        uint8_t macro;
+        uint32_t symbol;
+        uint32_t value;
+        const char *file;
+        int line;
+} Item;
+
+/* Section
+ * Usage: Everything the modules put in one named section, in order
+ *
+ * Members:
+ * 	char *name: Section name, as given to .section
+ * 	Item *items: Its items
+ * 	uint32_t numItems, capacity: Items used and allocated
+ *
+*/
+typedef struct Section {
+        char *name;
+        Item *items;
+        uint32_t numItems;
+        uint32_t capacity;
+} Section;
+
+/* Symbol
+ * Usage: One label
+ *
+ * Members:
+ * 	char *name: Its name; internal labels made by macros start with
+ * 		'.', which no source label can
+ * 	bool defined: Whether a module has defined it yet
+ * 	uint32_t address: Offset in segment 0, once linked
+ * 	const char *file: Where it was defined, or first used
+ * 	int line: Line of that
+ *
+*/
+typedef struct Symbol {
+        char *name;
+        bool defined;
+        uint32_t address;
+        const char *file;
+        int line;
+} Symbol;
+
+/* Asm_T
+ * Usage: A program being assembled from one or more modules
+ *
+ * Members:
+ * 	Section *sections: Sections in order of first use, which is the
+ * 		order they are laid out in
+ * 	uint32_t numSections, sectionCapacity: Sections used and allocated
+ * 	Symbol *symbols: Every label, source and internal
+ * 	uint32_t numSymbols, symbolCapacity: Symbols used and allocated
+ * 	uint32_t *buckets: Hash table from name to symbol index, NO_SYMBOL
+ * 		where empty; twice symbolCapacity in size
+ * 	uint32_t numInternal: Internal labels made so far, to name the next
+ * 	int errors: Errors reported so far
+ *
+ * An Asm_T object is typedefed to be a pointer to a Asm_T struct instance.
+*/
+typedef struct Asm_T {
+        Section *sections;
+        uint32_t numSections;
+        uint32_t sectionCapacity;
+        Symbol *symbols;
+        uint32_t numSymbols;
+        uint32_t symbolCapacity;
+        uint32_t *buckets;
+        uint32_t numInternal;
+        int errors;
+} *Asm_T;
+
+/* Asm_image
+ * Usage: A linked program
+ *
+ * Members:
+ * 	uint32_t *words: Words of the .um file, in host order
+ * 	uint32_t length: Number of words in the file
+ * 	uint32_t total: Words of segment 0 once running; past length they
+ * 		are zero, and mapped by a boot stub rather than stored
+ * 	uint32_t stub: Words of boot stub before the first module's code,
+ * 		0 if the image needed none
+ *
+*/
+typedef struct Asm_image {
+        uint32_t *words;
+        uint32_t length;
+        uint32_t total;
+        uint32_t stub;
+} Asm_image;
+
+/* asmparse.c */
+Asm_T initAsm(void);
+void freeAsm(Asm_T as);
+bool assembleFile(Asm_T as, const char *path);
+uint32_t findSymbol(Asm_T as, const char *name, const char *file, int line);
+uint32_t newLabel(Asm_T as);
+void asmError(Asm_T as, const char *file, int line, const char *fmt, ...);
+
+/* asmopt.c */
+uint32_t optimizeProgram(Asm_T as);
+
+/* asmlink.c */
+bool linkProgram(Asm_T as, bool zeroFill, Asm_image *image);
+bool writeImage(const Asm_image *image, const char *path);
+bool writeSymbolMap(Asm_T as, const char *path);
+
+#endif
@@ -0,0 +1,333 @@
+/*
+ *     filename: asmlink.c
+ *     partner 1 name: Jack Burton       Login: jburto05
+ *     partner 2 name: James Hartley        Login: jhartl01
+ *     date: April 13th, 2024
+ *     assignment: hw6
+ *
+ *     summary: Implements the umasm linker, which lays out the sections
+ *     every module assembled into as one segment 0, resolves labels, and
+ *     writes the .um image and its symbol map
+ *
+*/
+
+#include <string.h>
+#include "asm.h"
+
+/* Largest value LOADV can load */
+#define LOADV_MAX ((1u << 25) - 1)
+
+/* Fewest trailing zero words worth a boot stub to map rather than store */
+#define ZERO_FILL_MIN 1024
+
+/* Words of the boot stub, and offsets of its labels */
+#define STUB_LOOP 13
+#define STUB_BODY 17
+#define STUB_DONE 22
+#define STUB_ENTRY 24
+#define STUB_WORDS 32
+
+static uint32_t encodeOp(Um_opcode op, int a, int b, int c)
+{
+        return (uint32_t)op << 28 | (uint32_t)a << 6 | (uint32_t)b << 3 |
+               (uint32_t)c;
+}
+
+static uint32_t encodeLoadv(int a, uint32_t value)
+{
+        return (uint32_t)LOADV << 28 | (uint32_t)a << 25 | value;
+}
+
+/* Loads any 32-bit value into a in 5 words, clobbering helper */
+static uint32_t *stubConst(uint32_t *w, int a, uint32_t value, int helper)
+{
+        *w++ = encodeLoadv(a, value >> 16);
+        *w++ = encodeLoadv(helper, 1u << 16);
+        *w++ = encodeOp(MUL, a, a, helper);
+        *w++ = encodeLoadv(helper, value & 0xFFFF);
+        *w++ = encodeOp(ADD, a, a, helper);
+        return w;
+}
+
+/********** writeStub ********
+ *
+ * Writes the boot stub that grows segment 0 from the words stored in
+ * the image to the total the program needs
+ *
+ * Parameters:
+ *     uint32_t *w: Where to write its STUB_WORDS words
+ *     uint32_t length: Words stored in the image, stub included
+ *     uint32_t total: Words of segment 0 the program needs
+ *
+ * Return: None
+ *
+ * Notes
+ *      It maps a segment of total words, which the UM zero-fills, copies
+ *      the stored words into it, loads it as segment 0, unmaps the copy
+ *      and zeroes the registers, so the program starts just as if all
+ *      total words had been stored. Only r0 == 0, as every UM starts,
+ *      is assumed.
+ ************************/
+static void writeStub(uint32_t *w, uint32_t length, uint32_t total)
+{
+        uint32_t *start = w;
+        w = stubConst(w, 1, total, 7);
+        *w++ = encodeOp(MAP, 0, 2, 1);
+        w = stubConst(w, 3, length, 7);
+        *w++ = encodeLoadv(4, 0);
+        *w++ = encodeOp(NAND, 4, 4, 4);
+        assert(w - start == STUB_LOOP);
+
+        /* Copy down from the last word while r3 != 0 */
+        *w++ = encodeLoadv(6, STUB_DONE);
+        *w++ = encodeLoadv(5, STUB_BODY);
+        *w++ = encodeOp(CMOV, 6, 5, 3);
+        *w++ = encodeOp(LOADP, 0, 0, 6);
+        assert(w - start == STUB_BODY);
+        *w++ = encodeOp(ADD, 3, 3, 4);
+        *w++ = encodeOp(SLOAD, 1, 0, 3);
+        *w++ = encodeOp(SSTORE, 2, 3, 1);
+        *w++ = encodeLoadv(6, STUB_LOOP);
+        *w++ = encodeOp(LOADP, 0, 0, 6);
+        assert(w - start == STUB_DONE);
+        *w++ = encodeLoadv(6, STUB_ENTRY);
+        *w++ = encodeOp(LOADP, 0, 2, 6);
+        assert(w - start == STUB_ENTRY);
+        *w++ = encodeOp(UNMAP, 0, 0, 2);
+        for (int r = 1; r < 8; r++) {
+                *w++ = encodeLoadv(r, 0);
+        }
+        assert(w - start == STUB_WORDS);
+}
+
+/* Whether a section holds nothing but labels and .space */
+static bool onlySpace(const Section *section)
+{
+        for (uint32_t i = 0; i < section->numItems; i++) {
+                uint8_t kind = section->items[i].kind;
+                if (kind != ITEM_LABEL && kind != ITEM_SPACE) {
+                        return false;
+                }
+        }
+        return true;
+}
+
+static uint32_t itemWords(const Item *item)
+{
+        switch (item->kind) {
+        case ITEM_INSN:
+        case ITEM_WORD:
+                return 1;
+        case ITEM_SPACE:
+                return item->value;
+        default:
+                return 0;
+        }
+}
+
+/* Counts the zero words at the end of the laid-out sections */
+static uint64_t trailingZeros(Asm_T as, const uint32_t *order)
+{
+        uint64_t zeros = 0;
+        for (uint32_t s = as->numSections; s-- > 0;) {
+                const Section *section = &as->sections[order[s]];
+                for (uint32_t i = section->numItems; i-- > 0;) {
+                        const Item *item = &section->items[i];
+                        if (item->kind == ITEM_SPACE) {
+                                zeros += item->value;
+                        } else if (item->kind == ITEM_WORD &&
+                                   item->value == 0 &&
+                                   item->symbol == NO_SYMBOL) {
+                                zeros++;
+                        } else if (item->kind != ITEM_LABEL) {
+                                return zeros;
+                        }
+                }
+        }
+        return zeros;
+}
+
+/* Gets the value of a LOADV or data word, once labels have addresses */
+static uint32_t itemValue(Asm_T as, const Item *item)
+{
+        if (item->symbol == NO_SYMBOL) {
+                return item->value;
+        }
+        return item->value + as->symbols[item->symbol].address;
+}
+
+/********** linkProgram ********
+ *
+ * Lays out a program's sections, gives every label its address and
+ * builds the .um image
+ *
+ * Parameters:
+ *     Asm_T as: Program, with every module assembled
+ *     bool zeroFill: Whether to leave trailing zero words out of the
+ *                    image, for a boot stub to map at run time
+ *     Asm_image *image: Set to the image; free image->words when done
+ *
+ * Return: true, or false after reporting undefined labels or values
+ *         that do not fit
+ *
+ * Notes
+ *      Sections go in the order modules first named them, except that
+ *      sections of nothing but .space go last, so that they are the
+ *      trailing zeros a boot stub can leave out.
+ ************************/
+bool linkProgram(Asm_T as, bool zeroFill, Asm_image *image)
+{
+        uint32_t *order = malloc(((size_t)as->numSections + 1) *
+                                 sizeof(*order));
+        assert(order != NULL);
+        uint32_t n = 0;
+        for (int pass = 0; pass < 2; pass++) {
+                for (uint32_t s = 0; s < as->numSections; s++) {
+                        if (onlySpace(&as->sections[s]) == (pass == 1)) {
+                                order[n++] = s;
+                        }
+                }
+        }
+
+        uint64_t zeros = trailingZeros(as, order);
+        uint32_t stub = zeroFill && zeros >= ZERO_FILL_MIN ? STUB_WORDS : 0;
+        uint64_t address = stub;
+        for (uint32_t s = 0; s < n; s++) {
+                const Section *section = &as->sections[order[s]];
+                for (uint32_t i = 0; i < section->numItems; i++) {
+                        const Item *item = &section->items[i];
+                        if (item->kind == ITEM_LABEL &&
+                            address <= UINT32_MAX) {
+                                as->symbols[item->symbol].address = address;
+                        }
+                        address += itemWords(item);
+                }
+        }
+        if (address > UINT32_MAX) {
+                fprintf(stderr, "umasm: program of %llu words is too "
+                                "large\n", (unsigned long long)address);
+                free(order);
+                return false;
+        }
+        for (uint32_t i = 0; i < as->numSymbols; i++) {
+                const Symbol *sym = &as->symbols[i];
+                if (!sym->defined && sym->name[0] != '.') {
+                        asmError(as, sym->file, sym->line,
+                                 "undefined label %s", sym->name);
+                }
+        }
+
+        image->total = address;
+        image->stub = stub;
+        image->length = stub ? image->total - zeros : image->total;
+        image->words = calloc((size_t)image->length + 1, sizeof(uint32_t));
+        assert(image->words != NULL);
+        if (stub) {
+                writeStub(image->words, image->length, image->total);
+        }
+        uint32_t at = stub;
+        for (uint32_t s = 0; s < n; s++) {
+                const Section *section = &as->sections[order[s]];
+                for (uint32_t i = 0; i < section->numItems; i++) {
+                        const Item *item = &section->items[i];
+                        uint32_t value = itemValue(as, item);
+                        if (item->kind == ITEM_INSN && item->op == LOADV) {
+                                if (value > LOADV_MAX) {
+                                        asmError(as, item->file, item->line,
+                                                 "value %u does not fit in "
+                                                 "25 bits", (unsigned)value);
+                                }
+                                value = encodeLoadv(item->a, value);
+                        } else if (item->kind == ITEM_INSN) {
+                                value = encodeOp(item->op, item->a, item->b,
+                                                 item->c);
+                        }
+                        if (item->kind != ITEM_SPACE &&
+                            item->kind != ITEM_LABEL && at < image->length) {
+                                image->words[at] = value;
+                        }
+                        at += itemWords(item);
+                }
+        }
+        free(order);
+        return as->errors == 0;
+}
+
+/********** writeImage ********
+ *
+ * Writes a linked program as a .um file of big-endian words
+ *
+ * Parameters:
+ *     const Asm_image *image: The program
+ *     const char *path: File to write
+ *
+ * Return: true, or false if it cannot be written
+ *
+ ************************/
+bool writeImage(const Asm_image *image, const char *path)
+{
+        FILE *fp = fopen(path, "wb");
+        if (fp == NULL) {
+                return false;
+        }
+        for (uint32_t i = 0; i < image->length; i++) {
+                uint32_t word = image->words[i];
+                putc(word >> 24, fp);
+                putc(word >> 16 & 0xFF, fp);
+                putc(word >> 8 & 0xFF, fp);
+                putc(word & 0xFF, fp);
+        }
+        bool ok = !ferror(fp);
+        return fclose(fp) == 0 && ok;
+}
+
+static int compareSymbols(const void *x, const void *y)
+{
+        const Symbol *a = *(const Symbol *const *)x;
+        const Symbol *b = *(const Symbol *const *)y;
+        if (a->address != b->address) {
+                return a->address < b->address ? -1 : 1;
+        }
+        return strcmp(a->name, b->name);
+}
+
+/********** writeSymbolMap ********
+ *
+ * Writes the addresses of a linked program's source labels, one
+ * "OFFSET NAME" line each in offset order, after a "#" comment line.
+ * um --symbols reads it to name the offsets it profiles.
+ *
+ * Parameters:
+ *     Asm_T as: The linked program
+ *     const char *path: File to write
+ *
+ * Return: true, or false if it cannot be written
+ *
+ ************************/
+bool writeSymbolMap(Asm_T as, const char *path)
+{
+        const Symbol **sorted = malloc(((size_t)as->numSymbols + 1) *
+                                       sizeof(*sorted));
+        assert(sorted != NULL);
+        uint32_t n = 0;
+        for (uint32_t i = 0; i < as->numSymbols; i++) {
+                if (as->symbols[i].defined && as->symbols[i].name[0] != '.') {
+                        sorted[n++] = &as->symbols[i];
+                }
+        }
+        qsort(sorted, n, sizeof(*sorted), compareSymbols);
+
+        FILE *fp = fopen(path, "w");
+        if (fp == NULL) {
+                free(sorted);
+                return false;
+        }
+        fprintf(fp, "# umasm symbol map: offset label\n");
+        for (uint32_t i = 0; i < n; i++) {
+                fprintf(fp, "%u %s\n", (unsigned)sorted[i]->address,
+                        sorted[i]->name);
+        }
+        free(sorted);
+        bool ok = !ferror(fp);
+        return fclose(fp) == 0 && ok;
+}
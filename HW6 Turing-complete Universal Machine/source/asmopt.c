@@ -0,0 +1,651 @@
+/*
+ *     filename: asmopt.c
+ *     partner 1 name: Jack Burton       Login: jburto05
+ *     partner 2 name: James Hartley        Login: jhartl01
+ *     date: April 14th, 2024
+ *     assignment: hw6
+ *
+ *     summary: Implements umasm's peephole optimizer, which runs over the
+ *     macro-expanded instructions of each section before they are laid
+ *     out: it cancels pushes against pops, propagates the constants
+ *     LOADV and arithmetic leave in registers, and removes stores to
+ *     registers that are overwritten before they are read.
+ *
+*/
+
+#include <string.h>
+#include "asm.h"
+
+/* Largest value LOADV can load */
+#define LOADV_MAX ((1u << 25) - 1)
+
+/* Most values a register is tracked as possibly holding */
+#define MAX_VALUES 2
+
+/* Value
+ * Usage: What the optimizer knows a register holds at one point
+ *
+ * Members:
+ * 	uint8_t n: Number of values it may hold, or 0 if not known
+ * 	uint32_t symbol[]: Label whose address each value adds, or
+ * 		NO_SYMBOL
+ * 	uint32_t value[]: Constant part of each value
+ *
+*/
+typedef struct Value {
+        uint8_t n;
+        uint32_t symbol[MAX_VALUES];
+        uint32_t value[MAX_VALUES];
+} Value;
+
+static const Value UNKNOWN = { 0, { NO_SYMBOL, NO_SYMBOL }, { 0, 0 } };
+
+static Value known(uint32_t symbol, uint32_t value)
+{
+        Value val = UNKNOWN;
+        val.n = 1;
+        val.symbol[0] = symbol;
+        val.value[0] = value;
+        return val;
+}
+
+/* Whether x and y are each one value, the same one */
+static bool sameValue(Value x, Value y)
+{
+        return x.n == 1 && y.n == 1 && x.symbol[0] == y.symbol[0] &&
+               x.value[0] == y.value[0];
+}
+
+/* Whether x is one value with no label, and sets *c to it */
+static bool constant(Value x, uint32_t *c)
+{
+        *c = x.value[0];
+        return x.n == 1 && x.symbol[0] == NO_SYMBOL;
+}
+
+/* Gets the values either of x or y may hold */
+static Value join(Value x, Value y)
+{
+        if (x.n == 0 || y.n == 0) {
+                return UNKNOWN;
+        }
+        for (int i = 0; i < y.n; i++) {
+                bool found = false;
+                for (int j = 0; j < x.n; j++) {
+                        found = found || (x.symbol[j] == y.symbol[i] &&
+                                          x.value[j] == y.value[i]);
+                }
+                if (found) {
+                        continue;
+                }
+                if (x.n == MAX_VALUES) {
+                        return UNKNOWN;
+                }
+                x.symbol[x.n] = y.symbol[i];
+                x.value[x.n++] = y.value[i];
+        }
+        return x;
+}
+
+/* Whether x may hold the address of a label */
+static bool mayHold(Value x, uint32_t symbol)
+{
+        for (int i = 0; i < x.n; i++) {
+                if (x.symbol[i] == symbol && x.value[i] == 0) {
+                        return true;
+                }
+        }
+        return false;
+}
+
+/* Whether one LOADV can load x; a label's address is only taken to fit
+ * when nothing is added to it, as the source's own LOADVs of it do */
+static bool fitsLoadv(Value x)
+{
+        return x.n == 1 && (x.symbol[0] == NO_SYMBOL ? x.value[0] <= LOADV_MAX
+                                                     : x.value[0] == 0);
+}
+
+/* Gets what an ADD, MUL, DIV or NAND leaves in its register */
+static Value arith(uint8_t op, Value b, Value c)
+{
+        uint32_t x, y;
+        bool cb = constant(b, &x), cc = constant(c, &y);
+        if (op == ADD && b.n == 1 && cc) {
+                return known(b.symbol[0], b.value[0] + y);
+        } else if (op == ADD && cb && c.n == 1) {
+                return known(c.symbol[0], c.value[0] + x);
+        } else if (!cb || !cc) {
+                return UNKNOWN;
+        } else if (op == MUL) {
+                return known(NO_SYMBOL, x * y);
+        } else if (op == DIV) {
+                return y == 0 ? UNKNOWN : known(NO_SYMBOL, x / y);
+        } else {
+                return known(NO_SYMBOL, ~(x & y));
+        }
+}
+
+static bool isOp(const Item *item, Um_opcode op)
+{
+        return item->kind == ITEM_INSN && item->op == op;
+}
+
+/* Registers an instruction reads; CMOV counts as reading A, which it
+ * may leave as it was */
+static uint8_t readsOf(const Item *item)
+{
+        switch (item->op) {
+        case CMOV:
+        case SSTORE:
+                return 1u << item->a | 1u << item->b | 1u << item->c;
+        case SLOAD:
+        case ADD:
+        case MUL:
+        case DIV:
+        case NAND:
+        case LOADP:
+                return 1u << item->b | 1u << item->c;
+        case MAP:
+        case UNMAP:
+        case OUT:
+                return 1u << item->c;
+        default:
+                return 0;
+        }
+}
+
+static uint8_t writesOf(const Item *item)
+{
+        switch (item->op) {
+        case CMOV:
+        case SLOAD:
+        case ADD:
+        case MUL:
+        case DIV:
+        case NAND:
+        case LOADV:
+                return 1u << item->a;
+        case MAP:
+                return 1u << item->b;
+        case IN:
+                return 1u << item->c;
+        default:
+                return 0;
+        }
+}
+
+/* Whether an instruction does nothing but set one register, so that it
+ * can go if the value is not needed. DIV and SLOAD are left, as they may
+ * fail. */
+static bool isPure(const Item *item)
+{
+        return item->kind == ITEM_INSN &&
+               (item->op == CMOV || item->op == ADD || item->op == MUL ||
+                item->op == NAND || item->op == LOADV);
+}
+
+/* Turns an item into a LOADV of a value fitsLoadv allows */
+static void makeLoadv(Item *item, int a, Value x)
+{
+        item->op = LOADV;
+        item->a = a;
+        item->b = item->c = 0;
+        item->symbol = x.symbol[0];
+        item->value = x.value[0];
+}
+
+/* Removes the items marked dead; returns how many of them were
+ * instructions */
+static uint32_t compact(Section *section, const bool *dead)
+{
+        uint32_t n = 0, removed = 0;
+        for (uint32_t i = 0; i < section->numItems; i++) {
+                if (dead[i]) {
+                        removed += section->items[i].kind == ITEM_INSN;
+                } else {
+                        section->items[n++] = section->items[i];
+                }
+        }
+        section->numItems = n;
+        return removed;
+}
+
+/* Index of the first item at or after i not marked dead */
+static uint32_t nextLive(const Section *section, const bool *dead,
+                         uint32_t i)
+{
+        while (i < section->numItems && dead[i]) {
+                i++;
+        }
+        return i;
+}
+
+/* Whether items i.. are the last four of a push onto sp:
+ * t := -1; sp := sp + t; m[zero][sp] := x */
+static bool isPushTail(const Section *section, uint32_t i, int *sp)
+{
+        if (i + 4 > section->numItems) {
+                return false;
+        }
+        const Item *it = &section->items[i];
+        for (int k = 0; k < 4; k++) {
+                if (it[k].macro != MACRO_PUSH || it[k].kind != ITEM_INSN) {
+                        return false;
+                }
+        }
+        int t = it[0].a;
+        *sp = it[2].a;
+        return it[0].op == LOADV && it[0].symbol == NO_SYMBOL &&
+               it[0].value == 0 && it[1].op == NAND && it[1].a == t &&
+               it[1].b == t && it[1].c == t && it[2].op == ADD &&
+               it[2].b == *sp && it[2].c == t && it[3].op == SSTORE &&
+               it[3].b == *sp && it[3].c != *sp;
+}
+
+/* Whether items i.. are a pop off sp: y := m[zero][sp]; t := 1;
+ * sp := sp + t */
+static bool isPop(const Section *section, uint32_t i, int *sp)
+{
+        if (i + 3 > section->numItems) {
+                return false;
+        }
+        const Item *it = &section->items[i];
+        for (int k = 0; k < 3; k++) {
+                if (it[k].macro != MACRO_POP || it[k].kind != ITEM_INSN) {
+                        return false;
+                }
+        }
+        int t = it[1].a;
+        *sp = it[2].a;
+        return it[0].op == SLOAD && it[0].c == *sp &&
+               it[1].op == LOADV && it[1].symbol == NO_SYMBOL &&
+               it[1].value == 1 && it[2].op == ADD && it[2].b == *sp &&
+               it[2].c == t;
+}
+
+/********** cancelStack ********
+ *
+ * Cancels pushes against pops on the same stack, in one section
+ *
+ * Parameters:
+ *     Section *section: Section to rewrite
+ *     bool *dead: Per item, set for those removed
+ *
+ * Return: Number of pairs cancelled
+ *
+ * Notes
+ *      A push right before a pop leaves the stack as it was, so it is
+ *      just a copy of the pushed register into the popped one (and no
+ *      store: the word below the stack pointer is free). A pop, then
+ *      code that does not use the stack pointer, then a push also
+ *      leaves it as it was, so the two pointer updates go and the push
+ *      stores where the pop loaded. Temporaries the macros set are not
+ *      kept, as .temps registers hold nothing between statements.
+ ************************/
+static uint32_t cancelStack(Section *section, bool *dead)
+{
+        uint32_t pairs = 0;
+        Item *items = section->items;
+        int sp, sp2;
+        for (uint32_t i = 0; i < section->numItems; i++) {
+                if (dead[i]) {
+                        continue;
+                }
+                if (isPushTail(section, i, &sp) && isPop(section, i + 4,
+                                                         &sp2) &&
+                    sp == sp2 && !dead[i + 4]) {
+                        int x = items[i + 3].c, y = items[i + 4].a;
+                        int zero = items[i + 3].a;
+                        for (uint32_t k = i; k < i + 7; k++) {
+                                dead[k] = true;
+                        }
+                        if (x != y) {
+                                dead[i + 6] = false;
+                                items[i + 6].op = ADD;
+                                items[i + 6].a = y;
+                                items[i + 6].b = x;
+                                items[i + 6].c = zero;
+                                items[i + 6].macro = MACRO_NONE;
+                        }
+                        pairs++;
+                        continue;
+                }
+                if (!isPop(section, i, &sp)) {
+                        continue;
+                }
+
+                /* Look for a push with nothing between using sp, or
+                 * reading the pop's temporary before setting it */
+                uint8_t t = 1u << items[i + 1].a, set = 0;
+                uint32_t k = i + 3;
+                for (; k < section->numItems; k++) {
+                        const Item *it = &items[k];
+                        if (dead[k]) {
+                                continue;
+                        }
+                        if (it->kind != ITEM_INSN || it->op == LOADP ||
+                            it->op == HALT || isPushTail(section, k, &sp2) ||
+                            ((readsOf(it) | writesOf(it)) >> sp & 1) ||
+                            (readsOf(it) & t & ~set)) {
+                                break;
+                        }
+                        set |= writesOf(it);
+                }
+                if (k == section->numItems || !isPushTail(section, k, &sp2) ||
+                    sp2 != sp) {
+                        continue;
+                }
+                dead[i + 1] = dead[i + 2] = true;
+                dead[k] = dead[k + 1] = dead[k + 2] = true;
+                items[i].macro = items[k + 3].macro = MACRO_NONE;
+                if (k == i + 3 && items[k + 3].c == items[i].a &&
+                    items[k + 3].a == items[i].b) {
+                        /* Stores back the word just loaded */
+                        dead[k + 3] = true;
+                }
+                pairs++;
+        }
+        return pairs;
+}
+
+/* Forgets every register but the zero register .zero names */
+static void forget(Value r[8], const Item *item)
+{
+        for (int i = 0; i < 8; i++) {
+                r[i] = UNKNOWN;
+        }
+        if (item->zero != NO_ZERO) {
+                r[item->zero] = known(NO_SYMBOL, 0);
+        }
+}
+
+/* Where the single LOADV of each internal label is, if it has one */
+typedef struct Label_use {
+        uint32_t uses;
+        uint32_t section;
+        uint32_t item;
+} Label_use;
+
+/********** countUses ********
+ *
+ * Counts the LOADVs and data words that take each label's address
+ *
+ * Parameters:
+ *     Asm_T as: Program to count in
+ *
+ * Return: Per symbol, its uses and where the last one is
+ *
+ ************************/
+static Label_use *countUses(Asm_T as)
+{
+        Label_use *uses = calloc((size_t)as->numSymbols + 1,
+                                 sizeof(*uses));
+        assert(uses != NULL);
+        for (uint32_t s = 0; s < as->numSections; s++) {
+                const Section *section = &as->sections[s];
+                for (uint32_t i = 0; i < section->numItems; i++) {
+                        const Item *item = &section->items[i];
+                        if (item->kind != ITEM_LABEL &&
+                            item->kind != ITEM_SPACE &&
+                            item->symbol != NO_SYMBOL) {
+                                uses[item->symbol].uses++;
+                                uses[item->symbol].section = s;
+                                uses[item->symbol].item = i;
+                        }
+                }
+        }
+        return uses;
+}
+
+/********** propagate ********
+ *
+ * Tracks the constants in registers through a section, removing
+ * instructions that leave a register as it already is, and turning
+ * those whose result is a known constant into a LOADV of it
+ *
+ * Parameters:
+ *     Asm_T as: Program the section is in
+ *     uint32_t s: Index of the section
+ *     const Label_use *uses: From countUses
+ *     bool *dead: Per item, set for those removed
+ *
+ * Return: Number of instructions removed or rewritten
+ *
+ * Notes
+ *      Registers are forgotten at a label, except one that a LOADP just
+ *      before it is the only way to: the fall-through label of an
+ *      if-goto, taken only when the jump register holds it. A LOADP to
+ *      the label right after it (a goto of the next line) goes.
+ ************************/
+static uint32_t propagate(Asm_T as, uint32_t s, const Label_use *uses,
+                          bool *dead)
+{
+        Section *section = &as->sections[s];
+        Item *items = section->items;
+        uint32_t changes = 0, blockStart = 0, contLabel = NO_SYMBOL;
+        int contReg = 0;
+        Value r[8];
+        if (section->numItems > 0) {
+                forget(r, &items[0]);
+        }
+
+        for (uint32_t i = 0; i < section->numItems; i++) {
+                Item *it = &items[i];
+                if (dead[i]) {
+                        continue;
+                }
+                if (it->kind == ITEM_LABEL && it->symbol == contLabel) {
+                        r[contReg] = known(contLabel, 0);
+                        contLabel = NO_SYMBOL;
+                        continue;
+                }
+                if (it->kind != ITEM_INSN) {
+                        forget(r, it);
+                        blockStart = i;
+                        contLabel = NO_SYMBOL;
+                        continue;
+                }
+
+                Value result;
+                uint32_t c, j = nextLive(section, dead, i + 1);
+                switch (it->op) {
+                case LOADV:
+                        result = known(it->symbol, it->value);
+                        if (it->symbol == NO_SYMBOL && j < section->numItems &&
+                            isOp(&items[j], NAND) && items[j].a == it->a &&
+                            items[j].b == it->a && items[j].c == it->a) {
+                                /* The two-word load of ~value */
+                                result = known(NO_SYMBOL, ~it->value);
+                                if (sameValue(r[it->a], result)) {
+                                        dead[i] = dead[j] = true;
+                                        changes += 2;
+                                }
+                                r[it->a] = result;
+                                i = j;
+                                continue;
+                        }
+                        break;
+                case ADD:
+                case MUL:
+                case NAND:
+                case DIV:
+                        result = arith(it->op, r[it->b], r[it->c]);
+                        break;
+                case CMOV:
+                        if (constant(r[it->c], &c) && c == 0) {
+                                dead[i] = true;
+                                changes++;
+                                continue;
+                        }
+                        if (constant(r[it->c], &c)) {
+                                result = r[it->b];
+                        } else if (sameValue(r[it->a], r[it->b])) {
+                                result = r[it->a];
+                        } else {
+                                r[it->a] = join(r[it->a], r[it->b]);
+                                continue;
+                        }
+                        break;
+                case LOADP:
+                        if (constant(r[it->b], &c) && c == 0 &&
+                            r[it->c].n == 1) {
+                                /* A jump to a label just after it? */
+                                for (uint32_t k = j; k < section->numItems &&
+                                     items[k].kind == ITEM_LABEL; k++) {
+                                        if (!dead[k] && items[k].symbol ==
+                                                        r[it->c].symbol[0] &&
+                                            r[it->c].value[0] == 0) {
+                                                dead[i] = true;
+                                                changes++;
+                                        }
+                                }
+                                if (dead[i]) {
+                                        continue;
+                                }
+                        }
+                        if (j < section->numItems &&
+                            items[j].kind == ITEM_LABEL) {
+                                uint32_t label = items[j].symbol;
+                                const Label_use *use = &uses[label];
+                                if (as->symbols[label].name[0] == '.' &&
+                                    use->uses == 1 && use->section == s &&
+                                    use->item >= blockStart &&
+                                    use->item < i && mayHold(r[it->c],
+                                                             label)) {
+                                        contLabel = label;
+                                        contReg = it->c;
+                                }
+                        }
+                        blockStart = i + 1;
+                        continue;
+                case HALT:
+                        blockStart = i + 1;
+                        continue;
+                case SSTORE:
+                case OUT:
+                case UNMAP:
+                        continue;
+                default:
+                        /* SLOAD, MAP, IN */
+                        for (int k = 0; k < 8; k++) {
+                                if (writesOf(it) >> k & 1) {
+                                        r[k] = UNKNOWN;
+                                }
+                        }
+                        continue;
+                }
+
+                int a = it->a;
+                if (isPure(it) && sameValue(r[a], result)) {
+                        dead[i] = true;
+                        changes++;
+                        continue;
+                }
+                if (it->op != LOADV && it->op != DIV && fitsLoadv(result)) {
+                        makeLoadv(it, a, result);
+                        changes++;
+                }
+                r[a] = result;
+        }
+        return changes;
+}
+
+/********** removeDeadStores ********
+ *
+ * Removes instructions that only set a register that is set again, or
+ * no longer needed, before anything reads it
+ *
+ * Parameters:
+ *     Section *section: Section to rewrite
+ *     bool *dead: Per item, set for those removed
+ *
+ * Return: Number of instructions removed
+ *
+ * Notes
+ *      Every register is taken as needed at a label, and after HALT
+ *      none is. A jump needs all but the .temps temporaries: a macro
+ *      sets those itself before using them, so no value in them is
+ *      meant to survive a goto. The LOADP of an if-goto, followed by
+ *      its fall-through label, needs them all.
+ ************************/
+static uint32_t removeDeadStores(Section *section, bool *dead)
+{
+        uint32_t removed = 0;
+        uint8_t live = 0xFF;
+        for (uint32_t i = section->numItems; i-- > 0;) {
+                const Item *it = &section->items[i];
+                if (dead[i]) {
+                        continue;
+                }
+                if (it->kind != ITEM_INSN) {
+                        live = 0xFF;
+                        continue;
+                }
+                if (it->op == HALT) {
+                        live = 0;
+                        continue;
+                }
+                if (it->op == LOADP) {
+                        uint32_t j = nextLive(section, dead, i + 1);
+                        bool falls = j < section->numItems &&
+                                     section->items[j].kind == ITEM_LABEL;
+                        live = (falls ? 0xFF : (uint8_t)~it->temps) |
+                               readsOf(it);
+                        continue;
+                }
+                if (isPure(it) && !(live >> it->a & 1)) {
+                        dead[i] = true;
+                        removed++;
+                        continue;
+                }
+                live = (live & ~writesOf(it)) | readsOf(it);
+        }
+        return removed;
+}
+
+/********** optimizeProgram ********
+ *
+ * Runs the peephole passes over every section until none changes
+ * anything
+ *
+ * Parameters:
+ *     Asm_T as: Program, with every module assembled and not yet linked
+ *
+ * Return: Number of instructions removed
+ *
+ ************************/
+uint32_t optimizeProgram(Asm_T as)
+{
+        uint32_t removed = 0;
+        for (uint32_t s = 0; s < as->numSections; s++) {
+                Section *section = &as->sections[s];
+                bool *dead = calloc((size_t)section->numItems + 1,
+                                    sizeof(*dead));
+                assert(dead != NULL);
+                while (cancelStack(section, dead) > 0) {
+                        removed += compact(section, dead);
+                        memset(dead, 0, section->numItems * sizeof(*dead));
+                }
+                free(dead);
+        }
+
+        bool changed = true;
+        while (changed) {
+                changed = false;
+                Label_use *uses = countUses(as);
+                for (uint32_t s = 0; s < as->numSections; s++) {
+                        Section *section = &as->sections[s];
+                        bool *dead = calloc((size_t)section->numItems + 1,
+                                            sizeof(*dead));
+                        assert(dead != NULL);
+                        uint32_t changes = propagate(as, s, uses, dead);
+                        changes += removeDeadStores(section, dead);
+                        removed += compact(section, dead);
+                        changed = changed || changes > 0;
+                        free(dead);
+                }
+                free(uses);
+        }
+        return removed;
+}
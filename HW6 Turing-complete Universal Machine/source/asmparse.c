@@ -0,0 +1,1665 @@
+/*
+ *     filename: asmparse.c
+ *     partner 1 name: Jack Burton       Login: jburto05
+ *     partner 2 name: James Hartley        Login: jhartl01
+ *     date: April 13th, 2024
+ *     assignment: hw6
+ *
+ *     summary: Implements the umasm parser. Each line of a .ums module
+ *     is tokenized, parsed, and expanded into UM instructions in the
+ *     current section: the macros (goto, if-goto, push, pop, output of
+ *     strings, arithmetic the UM lacks) use the registers named by
+ *     .temps, the using register and the .zero register.
+ *
+*/
+
+#include <stdarg.h>
+#include <string.h>
+#include <ctype.h>
+#include "asm.h"
+
+/* Longest source line, and most tokens on one */
+#define MAX_LINE 4096
+#define MAX_TOKENS 128
+
+/* Largest value LOADV can load */
+#define LOADV_MAX ((1u << 25) - 1)
+
+/* Added to both sides of a signed comparison to make it unsigned */
+#define SIGN_BIAS 0x80000000u
+
+typedef enum Token_kind {
+        TOK_END = 0, TOK_IDENT, TOK_REG, TOK_NUM, TOK_STRING, TOK_PUNCT
+} Token_kind;
+
+/* Token
+ * Usage: One token of a source line
+ *
+ * Members:
+ * 	Token_kind kind: What it is
+ * 	char *text: Identifier or punctuation, or a string's contents with
+ * 		escapes decoded; in the parser's pool
+ * 	uint32_t value: Value of a number or character, number of a
+ * 		register, or length of a string
+ *
+*/
+typedef struct Token {
+        Token_kind kind;
+        char *text;
+        uint32_t value;
+} Token;
+
+/* Parser
+ * Usage: State while assembling one module
+ *
+ * Members:
+ * 	Asm_T as: Program the module is part of
+ * 	const char *file: Module's file name
+ * 	int line: Line being parsed
+ * 	Token toks[MAX_TOKENS]: Its tokens, then a TOK_END
+ * 	int pos: Next token to parse
+ * 	char pool[]: Text of the tokens
+ * 	size_t poolUsed: Bytes of pool in use
+ * 	uint32_t section: Index of the section being assembled into, or
+ * 		NO_SYMBOL until the module puts anything in one
+ * 	int zero: Register .zero says holds 0, or -1
+ * 	uint8_t temps: Bit per register .temps lets macros clobber
+ *
+*/
+typedef struct Parser {
+        Asm_T as;
+        const char *file;
+        int line;
+        Token toks[MAX_TOKENS + 1];
+        int pos;
+        char pool[2 * MAX_LINE];
+        size_t poolUsed;
+        uint32_t section;
+        int zero;
+        uint8_t temps;
+} Parser;
+
+/* Operand
+ * Usage: A register, or a value known by link time: a constant, plus
+ * the address of at most one label
+ *
+*/
+typedef struct Operand {
+        bool isReg;
+        int reg;
+        uint32_t symbol;
+        uint32_t value;
+} Operand;
+
+/********** initAsm ********
+ *
+ * Creates an empty program
+ *
+ * Parameters: None
+ *
+ * Return: pointer to initialized Asm_T struct
+ *
+ ************************/
+Asm_T initAsm(void)
+{
+        Asm_T as = calloc(1, sizeof(*as));
+        assert(as != NULL);
+        as->symbolCapacity = 64;
+        as->symbols = malloc(as->symbolCapacity * sizeof(Symbol));
+        as->buckets = malloc(2 * as->symbolCapacity * sizeof(uint32_t));
+        assert(as->symbols != NULL && as->buckets != NULL);
+        memset(as->buckets, 0xFF, 2 * as->symbolCapacity * sizeof(uint32_t));
+        return as;
+}
+
+/********** freeAsm ********
+ *
+ * Frees a program, its sections and its symbols
+ *
+ * Parameters:
+ *     Asm_T as: Program to free, or NULL
+ *
+ * Return: None
+ *
+ ************************/
+void freeAsm(Asm_T as)
+{
+        if (as == NULL) {
+                return;
+        }
+        for (uint32_t i = 0; i < as->numSections; i++) {
+                free(as->sections[i].name);
+                free(as->sections[i].items);
+        }
+        for (uint32_t i = 0; i < as->numSymbols; i++) {
+                free(as->symbols[i].name);
+        }
+        free(as->sections);
+        free(as->symbols);
+        free(as->buckets);
+        free(as);
+}
+
+/********** asmError ********
+ *
+ * Reports an error in a module as "file:line: message", and counts it
+ *
+ * Parameters:
+ *     Asm_T as: Program being assembled
+ *     const char *file, int line: Where the error is
+ *     const char *fmt, ...: printf-style message
+ *
+ * Return: None
+ *
+ ************************/
+void asmError(Asm_T as, const char *file, int line, const char *fmt, ...)
+{
+        va_list args;
+        va_start(args, fmt);
+        fprintf(stderr, "%s:%d: ", file, line);
+        vfprintf(stderr, fmt, args);
+        fputc('\n', stderr);
+        va_end(args);
+        as->errors++;
+}
+
+/* Reports an error on the line being parsed; returns false */
+static bool syntax(Parser *p, const char *fmt, ...)
+{
+        va_list args;
+        va_start(args, fmt);
+        fprintf(stderr, "%s:%d: ", p->file, p->line);
+        vfprintf(stderr, fmt, args);
+        fputc('\n', stderr);
+        va_end(args);
+        p->as->errors++;
+        return false;
+}
+
+static uint32_t hashName(const char *name)
+{
+        uint32_t hash = 2166136261u;
+        for (; *name != '\0'; name++) {
+                hash = (hash ^ (uint8_t)*name) * 16777619u;
+        }
+        return hash;
+}
+
+/* Puts symbol i in the hash table */
+static void hashSymbol(Asm_T as, uint32_t i)
+{
+        uint32_t mask = 2 * as->symbolCapacity - 1;
+        uint32_t bucket = hashName(as->symbols[i].name) & mask;
+        while (as->buckets[bucket] != NO_SYMBOL) {
+                bucket = (bucket + 1) & mask;
+        }
+        as->buckets[bucket] = i;
+}
+
+/* Adds a symbol that is not yet defined, growing the table if full */
+static uint32_t addSymbol(Asm_T as, const char *name, const char *file,
+                          int line)
+{
+        if (as->numSymbols == as->symbolCapacity) {
+                as->symbolCapacity *= 2;
+                as->symbols = realloc(as->symbols, as->symbolCapacity *
+                                                   sizeof(Symbol));
+                as->buckets = realloc(as->buckets, 2 * as->symbolCapacity *
+                                                   sizeof(uint32_t));
+                assert(as->symbols != NULL && as->buckets != NULL);
+                memset(as->buckets, 0xFF,
+                       2 * as->symbolCapacity * sizeof(uint32_t));
+                for (uint32_t i = 0; i < as->numSymbols; i++) {
+                        hashSymbol(as, i);
+                }
+        }
+        uint32_t i = as->numSymbols++;
+        Symbol *sym = &as->symbols[i];
+        sym->name = malloc(strlen(name) + 1);
+        assert(sym->name != NULL);
+        strcpy(sym->name, name);
+        sym->defined = false;
+        sym->address = 0;
+        sym->file = file;
+        sym->line = line;
+        hashSymbol(as, i);
+        return i;
+}
+
+/********** findSymbol ********
+ *
+ * Looks up a label by name, adding it undefined if it is new
+ *
+ * Parameters:
+ *     Asm_T as: Program to look in
+ *     const char *name: Label
+ *     const char *file, int line: Where it is used, if it is new
+ *
+ * Return: Index of the label in as->symbols
+ *
+ ************************/
+uint32_t findSymbol(Asm_T as, const char *name, const char *file, int line)
+{
+        uint32_t mask = 2 * as->symbolCapacity - 1;
+        uint32_t bucket = hashName(name) & mask;
+        while (as->buckets[bucket] != NO_SYMBOL) {
+                uint32_t i = as->buckets[bucket];
+                if (strcmp(as->symbols[i].name, name) == 0) {
+                        return i;
+                }
+                bucket = (bucket + 1) & mask;
+        }
+        return addSymbol(as, name, file, line);
+}
+
+/********** newLabel ********
+ *
+ * Makes an internal label for a macro to jump to, named so that no
+ * source label can clash with it
+ *
+ * Parameters:
+ *     Asm_T as: Program to add it to
+ *
+ * Return: Index of the label in as->symbols
+ *
+ ************************/
+uint32_t newLabel(Asm_T as)
+{
+        char name[32];
+        snprintf(name, sizeof(name), ".L%u", (unsigned)as->numInternal++);
+        return addSymbol(as, name, "<macro>", 0);
+}
+
+/* Gets the index of a section, adding it if it is new */
+static uint32_t findSection(Asm_T as, const char *name)
+{
+        for (uint32_t i = 0; i < as->numSections; i++) {
+                if (strcmp(as->sections[i].name, name) == 0) {
+                        return i;
+                }
+        }
+        if (as->numSections == as->sectionCapacity) {
+                as->sectionCapacity = 2 * as->sectionCapacity + 4;
+                as->sections = realloc(as->sections, as->sectionCapacity *
+                                                     sizeof(Section));
+                assert(as->sections != NULL);
+        }
+        Section *section = &as->sections[as->numSections];
+        section->name = malloc(strlen(name) + 1);
+        assert(section->name != NULL);
+        strcpy(section->name, name);
+        section->items = NULL;
+        section->numItems = 0;
+        section->capacity = 0;
+        return as->numSections++;
+}
+
+/* Copies text into the pool; returns the copy */
+static char *poolString(Parser *p, const char *text, size_t len)
+{
+        assert(p->poolUsed + len + 1 <= sizeof(p->pool));
+        char *copy = p->pool + p->poolUsed;
+        memcpy(copy, text, len);
+        copy[len] = '\0';
+        p->poolUsed += len + 1;
+        return copy;
+}
+
+/* Decodes the character at *s, an escape if it starts with '\', and
+ * advances past it; false for an unknown escape */
+static bool decodeChar(const char **s, uint32_t *c)
+{
+        if (**s != '\\') {
+                *c = (uint8_t)*(*s)++;
+                return true;
+        }
+        (*s)++;
+        switch (*(*s)++) {
+        case 'n':  *c = '\n'; return true;
+        case 't':  *c = '\t'; return true;
+        case 'r':  *c = '\r'; return true;
+        case '0':  *c = '\0'; return true;
+        case '\\': *c = '\\'; return true;
+        case '\'': *c = '\''; return true;
+        case '"':  *c = '"';  return true;
+        default:   return false;
+        }
+}
+
+static bool isIdentChar(char c)
+{
+        return isalnum((unsigned char)c) || c == '_';
+}
+
+/* Punctuation, longest first so that each is matched whole */
+static const char *puncts[] = {
+        "<=s", ">=s", ":=", "==", "!=", "<s", ">s", "<=", ">=", "<", ">",
+        "(", ")", "[", "]", "+", "-", "*", "/", "&", "|", "~", ",", ":",
+        "."
+};
+
+/********** tokenize ********
+ *
+ * Splits a source line into tokens, ending them with a TOK_END; a "//"
+ * outside a string starts a comment
+ *
+ * Parameters:
+ *     Parser *p: Parser to fill in the tokens of
+ *     const char *s: The line
+ *
+ * Return: true, or false after reporting a bad token
+ *
+ ************************/
+static bool tokenize(Parser *p, const char *s)
+{
+        int n = 0;
+        p->poolUsed = 0;
+        p->pos = 0;
+        for (;;) {
+                while (isspace((unsigned char)*s)) {
+                        s++;
+                }
+                if (*s == '\0' || (s[0] == '/' && s[1] == '/')) {
+                        break;
+                }
+                if (n == MAX_TOKENS) {
+                        return syntax(p, "line has too many tokens");
+                }
+                Token *tok = &p->toks[n++];
+                tok->value = 0;
+
+                if (isalpha((unsigned char)*s) || *s == '_') {
+                        const char *start = s;
+                        while (isIdentChar(*s)) {
+                                s++;
+                        }
+                        tok->text = poolString(p, start, s - start);
+                        bool reg = s - start == 2 && start[0] == 'r' &&
+                                   start[1] >= '0' && start[1] <= '7';
+                        tok->kind = reg ? TOK_REG : TOK_IDENT;
+                        tok->value = reg ? (uint32_t)(start[1] - '0') : 0;
+                } else if (isdigit((unsigned char)*s)) {
+                        char *end;
+                        unsigned long long value = strtoull(s, &end, 0);
+                        if (isIdentChar(*end) || value > UINT32_MAX) {
+                                return syntax(p, "bad number");
+                        }
+                        tok->kind = TOK_NUM;
+                        tok->value = value;
+                        tok->text = poolString(p, s, end - s);
+                        s = end;
+                } else if (*s == '\'') {
+                        s++;
+                        if (*s == '\0' || !decodeChar(&s, &tok->value) ||
+                            *s != '\'') {
+                                return syntax(p, "bad character literal");
+                        }
+                        s++;
+                        tok->kind = TOK_NUM;
+                        tok->text = "character";
+                } else if (*s == '"') {
+                        char buf[MAX_LINE];
+                        size_t len = 0;
+                        for (s++; *s != '"'; len++) {
+                                uint32_t c;
+                                if (*s == '\0' || !decodeChar(&s, &c)) {
+                                        return syntax(p, "bad string");
+                                }
+                                buf[len] = c;
+                        }
+                        s++;
+                        tok->kind = TOK_STRING;
+                        tok->text = poolString(p, buf, len);
+                        tok->value = len;
+                } else {
+                        size_t i, count = sizeof(puncts) / sizeof(*puncts);
+                        size_t len = 0;
+                        for (i = 0; i < count; i++) {
+                                len = strlen(puncts[i]);
+                                if (strncmp(s, puncts[i], len) == 0 &&
+                                    !(puncts[i][len - 1] == 's' &&
+                                      isIdentChar(s[len]))) {
+                                        break;
+                                }
+                        }
+                        if (i == count) {
+                                return syntax(p, "unexpected '%c'", *s);
+                        }
+                        tok->kind = TOK_PUNCT;
+                        tok->text = poolString(p, s, len);
+                        s += len;
+                }
+        }
+        p->toks[n].kind = TOK_END;
+        p->toks[n].text = "end of line";
+        return true;
+}
+
+static Token *peek(Parser *p, int ahead)
+{
+        int i = p->pos;
+        while (ahead-- > 0 && p->toks[i].kind != TOK_END) {
+                i++;
+        }
+        return &p->toks[i];
+}
+
+static bool isPunct(Token *tok, const char *text)
+{
+        return tok->kind == TOK_PUNCT && strcmp(tok->text, text) == 0;
+}
+
+static bool isWord(Token *tok, const char *word)
+{
+        return tok->kind == TOK_IDENT && strcmp(tok->text, word) == 0;
+}
+
+/* Consumes the next token if it is the punctuation given */
+static bool accept(Parser *p, const char *text)
+{
+        if (isPunct(peek(p, 0), text)) {
+                p->pos++;
+                return true;
+        }
+        return false;
+}
+
+/* Consumes the next token if it is the word given */
+static bool acceptWord(Parser *p, const char *word)
+{
+        if (isWord(peek(p, 0), word)) {
+                p->pos++;
+                return true;
+        }
+        return false;
+}
+
+static bool expect(Parser *p, const char *text)
+{
+        if (accept(p, text)) {
+                return true;
+        }
+        return syntax(p, "expected '%s' before %s", text, peek(p, 0)->text);
+}
+
+static bool expectWord(Parser *p, const char *word)
+{
+        if (acceptWord(p, word)) {
+                return true;
+        }
+        return syntax(p, "expected '%s' before %s", word, peek(p, 0)->text);
+}
+
+static bool parseReg(Parser *p, int *reg)
+{
+        Token *tok = peek(p, 0);
+        *reg = 0;
+        if (tok->kind != TOK_REG) {
+                return syntax(p, "expected a register, not %s", tok->text);
+        }
+        *reg = tok->value;
+        p->pos++;
+        return true;
+}
+
+static bool atEnd(Parser *p)
+{
+        if (peek(p, 0)->kind == TOK_END) {
+                return true;
+        }
+        return syntax(p, "unexpected %s", peek(p, 0)->text);
+}
+
+/* Parses a number, character or label, optionally negated */
+static bool parseTerm(Parser *p, Operand *x)
+{
+        bool negate = accept(p, "-");
+        Token *tok = peek(p, 0);
+        x->isReg = false;
+        x->symbol = NO_SYMBOL;
+        x->value = 0;
+        if (tok->kind == TOK_NUM) {
+                x->value = tok->value;
+        } else if (tok->kind == TOK_IDENT) {
+                if (negate) {
+                        return syntax(p, "cannot negate label %s",
+                                      tok->text);
+                }
+                x->symbol = findSymbol(p->as, tok->text, p->file, p->line);
+        } else {
+                return syntax(p, "expected a value, not %s", tok->text);
+        }
+        p->pos++;
+        if (negate) {
+                x->value = -x->value;
+        }
+        return true;
+}
+
+/********** parseExpr ********
+ *
+ * Parses a link-time value: terms joined by + and -, with at most one
+ * label, added. A + or - followed by a register ends the value, so that
+ * "label + r3" is an addition for the caller.
+ *
+ * Parameters:
+ *     Parser *p: Parser at the value
+ *     Operand *x: Set to the value
+ *
+ * Return: true, or false after reporting an error
+ *
+ ************************/
+static bool parseExpr(Parser *p, Operand *x)
+{
+        if (!parseTerm(p, x)) {
+                return false;
+        }
+        while ((isPunct(peek(p, 0), "+") || isPunct(peek(p, 0), "-")) &&
+               peek(p, 1)->kind != TOK_REG) {
+                bool minus = isPunct(peek(p, 0), "-");
+                Operand y;
+                p->pos++;
+                if (!parseTerm(p, &y)) {
+                        return false;
+                }
+                if (y.symbol != NO_SYMBOL) {
+                        if (minus || x->symbol != NO_SYMBOL) {
+                                return syntax(p, "a value can only add "
+                                                 "one label");
+                        }
+                        x->symbol = y.symbol;
+                }
+                x->value = minus ? x->value - y.value : x->value + y.value;
+        }
+        return true;
+}
+
+static bool parseOperand(Parser *p, Operand *x)
+{
+        if (peek(p, 0)->kind == TOK_REG) {
+                x->isReg = true;
+                x->reg = peek(p, 0)->value;
+                x->symbol = NO_SYMBOL;
+                x->value = 0;
+                p->pos++;
+                return true;
+        }
+        return parseExpr(p, x);
+}
+
+/* Whether x is a constant known now (the .zero register counts as 0) */
+static bool isConst(Parser *p, Operand x, uint32_t *value)
+{
+        if (x.isReg) {
+                *value = 0;
+                return x.reg == p->zero;
+        }
+        *value = x.value;
+        return x.symbol == NO_SYMBOL;
+}
+
+static uint8_t regBit(Operand x)
+{
+        return x.isReg ? 1u << x.reg : 0;
+}
+
+/* Appends an item for the line being parsed to the current section */
+static Item *newItem(Parser *p, Item_kind kind)
+{
+        if (p->section == NO_SYMBOL) {
+                p->section = findSection(p->as, "text");
+        }
+        Section *section = &p->as->sections[p->section];
+        if (section->numItems == section->capacity) {
+                section->capacity = 2 * section->capacity + 64;
+                section->items = realloc(section->items, section->capacity *
+                                                         sizeof(Item));
+                assert(section->items != NULL);
+        }
+        Item *item = &section->items[section->numItems++];
+        memset(item, 0, sizeof(*item));
+        item->kind = kind;
+        item->temps = p->temps;
+        item->zero = p->zero < 0 ? NO_ZERO : p->zero;
+        item->symbol = NO_SYMBOL;
+        item->file = p->file;
+        item->line = p->line;
+        return item;
+}
+
+static void emitOp(Parser *p, Um_opcode op, int a, int b, int c)
+{
+        Item *item = newItem(p, ITEM_INSN);
+        item->op = op;
+        item->a = a;
+        item->b = b;
+        item->c = c;
+}
+
+static void emitLoadv(Parser *p, int a, uint32_t symbol, uint32_t value)
+{
+        Item *item = newItem(p, ITEM_INSN);
+        item->op = LOADV;
+        item->a = a;
+        item->symbol = symbol;
+        item->value = value;
+}
+
+static void emitLabel(Parser *p, uint32_t symbol)
+{
+        newItem(p, ITEM_LABEL)->symbol = symbol;
+}
+
+/* Whether loading x takes a helper register besides its own */
+static bool needsHelper(Operand x)
+{
+        return x.symbol == NO_SYMBOL && x.value > LOADV_MAX &&
+               ~x.value > LOADV_MAX;
+}
+
+/********** loadConst ********
+ *
+ * Emits the shortest load of a link-time value into a register
+ *
+ * Parameters:
+ *     Parser *p: Parser emitting it
+ *     int reg: Register to load
+ *     Operand x: The value (not a register)
+ *     int helper: Register to clobber if x needs one (see needsHelper),
+ *                 else unused
+ *
+ * Return: None
+ *
+ * Notes
+ *      A value with a label must fit LOADV once linked; the linker
+ *      checks. Other values take 1 instruction, 2 (LOADV then NAND) if
+ *      their complement fits, or 5 with the helper.
+ ************************/
+static void loadConst(Parser *p, int reg, Operand x, int helper)
+{
+        uint32_t v = x.value;
+        if (x.symbol != NO_SYMBOL || v <= LOADV_MAX) {
+                emitLoadv(p, reg, x.symbol, v);
+        } else if (~v <= LOADV_MAX) {
+                emitLoadv(p, reg, NO_SYMBOL, ~v);
+                emitOp(p, NAND, reg, reg, reg);
+        } else {
+                assert(helper >= 0 && helper != reg);
+                emitLoadv(p, reg, NO_SYMBOL, v >> 16);
+                emitLoadv(p, helper, NO_SYMBOL, 1u << 16);
+                emitOp(p, MUL, reg, reg, helper);
+                if ((v & 0xFFFF) != 0) {
+                        emitLoadv(p, helper, NO_SYMBOL, v & 0xFFFF);
+                        emitOp(p, ADD, reg, reg, helper);
+                }
+        }
+}
+
+/* Takes a temporary not in *busy, marking it busy */
+static bool takeTemp(Parser *p, uint8_t *busy, int *reg)
+{
+        *reg = -1;
+        for (int r = 0; r < 8; r++) {
+                if ((p->temps >> r & 1) && !(*busy >> r & 1)) {
+                        *busy |= 1u << r;
+                        *reg = r;
+                        return true;
+                }
+        }
+        return syntax(p, "no free temporary register (see .temps)");
+}
+
+/* Loads a constant into a register, taking a helper temporary for it
+ * if it needs one */
+static bool loadConstTemp(Parser *p, int reg, Operand x, uint8_t busy)
+{
+        int helper = -1;
+        busy |= 1u << reg;
+        if (needsHelper(x) && !takeTemp(p, &busy, &helper)) {
+                return false;
+        }
+        loadConst(p, reg, x, helper);
+        return true;
+}
+
+/********** inReg ********
+ *
+ * Gets an operand into a register: itself if it is one, else a
+ * temporary it is loaded into
+ *
+ * Parameters:
+ *     Parser *p: Parser emitting the load
+ *     Operand x: The operand
+ *     uint8_t *busy: Registers not to use; updated with the temporary
+ *     int *reg: Set to the register
+ *
+ * Return: true, or false after reporting that no temporary is free
+ *
+ ************************/
+static bool inReg(Parser *p, Operand x, uint8_t *busy, int *reg)
+{
+        if (x.isReg) {
+                *reg = x.reg;
+                return true;
+        }
+        return takeTemp(p, busy, reg) && loadConstTemp(p, *reg, x, *busy);
+}
+
+/* Copies src to dst, through the .zero register if there is one */
+static void emitCopy(Parser *p, int dst, int src)
+{
+        if (dst == src) {
+                return;
+        }
+        if (p->zero >= 0) {
+                emitOp(p, ADD, dst, src, p->zero);
+        } else {
+                emitOp(p, NAND, dst, src, src);
+                emitOp(p, NAND, dst, dst, dst);
+        }
+}
+
+static bool needZero(Parser *p, const char *what)
+{
+        if (p->zero >= 0) {
+                return true;
+        }
+        return syntax(p, "%s needs a .zero register", what);
+}
+
+/* Whether an operator names one of the binary operations */
+static bool isBinop(Token *tok)
+{
+        static const char *ops[] = { "+", "-", "*", "/", "&", "|" };
+        for (size_t i = 0; i < sizeof(ops) / sizeof(*ops); i++) {
+                if (isPunct(tok, ops[i])) {
+                        return true;
+                }
+        }
+        return isWord(tok, "mod");
+}
+
+/* Applies a binary operation to two constants; false if it cannot */
+static bool foldBinop(const char *op, uint32_t x, uint32_t y, uint32_t *z)
+{
+        switch (op[0]) {
+        case '+': *z = x + y; return true;
+        case '-': *z = x - y; return true;
+        case '*': *z = x * y; return true;
+        case '&': *z = x & y; return true;
+        case '|': *z = x | y; return true;
+        case '/': *z = y ? x / y : 0; return y != 0;
+        default:  *z = y ? x % y : 0; return y != 0;
+        }
+}
+
+/********** emitBinop ********
+ *
+ * Emits d := x OP y for the operators of isBinop. UM has ADD, MUL, DIV
+ * and NAND; the rest are built from those.
+ *
+ * Parameters:
+ *     Parser *p: Parser emitting it
+ *     int d: Destination register
+ *     const char *op: Operator text ("mod" for the remainder)
+ *     Operand x, y: Its operands
+ *
+ * Return: true, or false after reporting an error
+ *
+ ************************/
+static bool emitBinop(Parser *p, int d, const char *op, Operand x,
+                      Operand y)
+{
+        uint32_t cx, cy, cz;
+        if (isConst(p, x, &cx) && isConst(p, y, &cy)) {
+                if (!foldBinop(op, cx, cy, &cz)) {
+                        return syntax(p, "division by zero");
+                }
+                Operand z = { false, 0, NO_SYMBOL, cz };
+                return loadConstTemp(p, d, z, 1u << d);
+        }
+        if (op[0] == '-' && isConst(p, y, &cy)) {
+                /* Adding the negation saves complementing y */
+                op = "+";
+                y.isReg = false;
+                y.value = -cy;
+        }
+
+        uint8_t busy = 1u << d | regBit(x) | regBit(y);
+        int rx, ry, t;
+        if (!inReg(p, x, &busy, &rx) || !inReg(p, y, &busy, &ry)) {
+                return false;
+        }
+        switch (op[0]) {
+        case '+':
+                emitOp(p, ADD, d, rx, ry);
+                return true;
+        case '*':
+                emitOp(p, MUL, d, rx, ry);
+                return true;
+        case '/':
+                emitOp(p, DIV, d, rx, ry);
+                return true;
+        case '&':
+                emitOp(p, NAND, d, rx, ry);
+                emitOp(p, NAND, d, d, d);
+                return true;
+        case '|':
+                if (!takeTemp(p, &busy, &t)) {
+                        return false;
+                }
+                emitOp(p, NAND, t, rx, rx);
+                emitOp(p, NAND, d, ry, ry);
+                emitOp(p, NAND, d, t, d);
+                return true;
+        case '-':
+                /* d := x + ~y + 1 */
+                if (!takeTemp(p, &busy, &t)) {
+                        return false;
+                }
+                emitOp(p, NAND, t, ry, ry);
+                emitOp(p, ADD, d, rx, t);
+                emitLoadv(p, t, NO_SYMBOL, 1);
+                emitOp(p, ADD, d, d, t);
+                return true;
+        default:
+                /* d := x - (x / y) * y */
+                if (!takeTemp(p, &busy, &t)) {
+                        return false;
+                }
+                emitOp(p, DIV, t, rx, ry);
+                emitOp(p, MUL, t, t, ry);
+                emitOp(p, NAND, t, t, t);
+                emitOp(p, ADD, d, rx, t);
+                emitLoadv(p, t, NO_SYMBOL, 1);
+                emitOp(p, ADD, d, d, t);
+                return true;
+        }
+}
+
+/********** parseAssign ********
+ *
+ * Parses and emits an assignment to a register: "rD := " then input(),
+ * map segment (X words), m[X][Y], -rS, ~X, X, or X OP Y
+ *
+ * Parameters:
+ *     Parser *p: Parser after the "rD :="
+ *     int d: The register
+ *
+ * Return: true, or false after reporting an error
+ *
+ ************************/
+static bool parseAssign(Parser *p, int d)
+{
+        Operand x, y;
+        uint8_t busy = 1u << d;
+        int rx, ry;
+        if (acceptWord(p, "input")) {
+                if (!expect(p, "(") || !expect(p, ")") || !atEnd(p)) {
+                        return false;
+                }
+                emitOp(p, IN, 0, 0, d);
+                return true;
+        }
+        if (acceptWord(p, "map")) {
+                if (!expectWord(p, "segment") || !expect(p, "(") ||
+                    !parseOperand(p, &x) || !expectWord(p, "words") ||
+                    !expect(p, ")") || !atEnd(p) ||
+                    !inReg(p, x, &busy, &rx)) {
+                        return false;
+                }
+                emitOp(p, MAP, 0, d, rx);
+                return true;
+        }
+        if (isWord(peek(p, 0), "m") && isPunct(peek(p, 1), "[")) {
+                p->pos++;
+                if (!expect(p, "[") || !parseOperand(p, &x) ||
+                    !expect(p, "]") || !expect(p, "[") ||
+                    !parseOperand(p, &y) || !expect(p, "]") || !atEnd(p)) {
+                        return false;
+                }
+                busy |= regBit(x) | regBit(y);
+                if (!inReg(p, x, &busy, &rx) || !inReg(p, y, &busy, &ry)) {
+                        return false;
+                }
+                emitOp(p, SLOAD, d, rx, ry);
+                return true;
+        }
+        if (isPunct(peek(p, 0), "-") && peek(p, 1)->kind == TOK_REG) {
+                p->pos++;
+                Operand zero = { false, 0, NO_SYMBOL, 0 };
+                return parseOperand(p, &x) && atEnd(p) &&
+                       emitBinop(p, d, "-", zero, x);
+        }
+        if (accept(p, "~")) {
+                if (!parseOperand(p, &x) || !atEnd(p)) {
+                        return false;
+                }
+                busy |= regBit(x);
+                if (!inReg(p, x, &busy, &rx)) {
+                        return false;
+                }
+                emitOp(p, NAND, d, rx, rx);
+                return true;
+        }
+
+        if (!parseOperand(p, &x)) {
+                return false;
+        }
+        if (peek(p, 0)->kind == TOK_END) {
+                if (x.isReg) {
+                        emitCopy(p, d, x.reg);
+                        return true;
+                }
+                return loadConstTemp(p, d, x, busy);
+        }
+        Token *op = peek(p, 0);
+        if (!isBinop(op)) {
+                return syntax(p, "unknown operator %s", op->text);
+        }
+        p->pos++;
+        return parseOperand(p, &y) && atEnd(p) &&
+               emitBinop(p, d, op->text, x, y);
+}
+
+/********** emitBranch ********
+ *
+ * Emits a jump to target taken if cond is nonzero (or zero), falling
+ * through otherwise
+ *
+ * Parameters:
+ *     Parser *p: Parser emitting it
+ *     int cond: Register tested
+ *     bool ifNonzero: Whether to jump when cond is nonzero, rather than
+ *                     when it is zero
+ *     Operand target: Label or register to jump to
+ *     int hold, use: Registers to clobber, besides cond
+ *
+ * Return: None
+ *
+ * Notes
+ *      Loads use with the fall-through label and hold with the target
+ *      (or the other way round), CMOVs one over the other on cond, and
+ *      jumps to use: 4 instructions, or 5 when jumping on zero to a
+ *      register.
+ ************************/
+static void emitBranch(Parser *p, int cond, bool ifNonzero, Operand target,
+                       int hold, int use)
+{
+        uint32_t fall = newLabel(p->as);
+        if (!target.isReg && ifNonzero) {
+                emitLoadv(p, use, fall, 0);
+                loadConst(p, hold, target, -1);
+                emitOp(p, CMOV, use, hold, cond);
+        } else if (!target.isReg) {
+                loadConst(p, use, target, -1);
+                emitLoadv(p, hold, fall, 0);
+                emitOp(p, CMOV, use, hold, cond);
+        } else if (ifNonzero) {
+                emitLoadv(p, use, fall, 0);
+                emitOp(p, CMOV, use, target.reg, cond);
+        } else {
+                emitLoadv(p, hold, fall, 0);
+                emitCopy(p, use, target.reg);
+                emitOp(p, CMOV, use, hold, cond);
+        }
+        emitOp(p, LOADP, 0, p->zero, use);
+        emitLabel(p, fall);
+}
+
+/* Emits an unconditional jump to target, through temp if it is a label */
+static void emitJump(Parser *p, Operand target, int temp)
+{
+        if (!target.isReg) {
+                loadConst(p, temp, target, -1);
+                target.reg = temp;
+        }
+        emitOp(p, LOADP, 0, p->zero, target.reg);
+}
+
+/********** emitCompare ********
+ *
+ * Emits "if (x < y) goto target", unsigned or signed, or its negation
+ *
+ * Parameters:
+ *     Parser *p: Parser emitting it
+ *     Operand x, y: Operands compared
+ *     bool isSigned: Whether to compare as two's complement
+ *     bool negate: Whether to jump when x < y is false instead
+ *     Operand target: Where to jump
+ *     int t1, t2, use: Registers to clobber
+ *
+ * Return: None
+ *
+ * Notes
+ *      The UM has no comparison, but x < y (unsigned) exactly when
+ *      y != 0 and x / y == 0; adding 2^31 to both sides turns a signed
+ *      comparison into an unsigned one. The y == 0 test is left out
+ *      when y is a nonzero constant.
+ ************************/
+static void emitCompare(Parser *p, Operand x, Operand y, bool isSigned,
+                        bool negate, Operand target, int t1, int t2,
+                        int use)
+{
+        uint32_t bias = isSigned ? SIGN_BIAS : 0;
+        Operand biasOp = { false, 0, NO_SYMBOL, bias };
+        uint32_t cx, cy;
+        int rx, ry;
+
+        if (isSigned && !negate && isConst(p, y, &cy) && cy == 0) {
+                /* x < 0 just when its sign bit is set */
+                loadConst(p, t2, biasOp, use);
+                emitOp(p, DIV, t1, x.reg, t2);
+                emitBranch(p, t1, true, target, t2, use);
+                return;
+        }
+
+        if (isConst(p, y, &cy)) {
+                Operand by = { false, 0, NO_SYMBOL, cy + bias };
+                loadConst(p, t2, by, t1);
+                ry = t2;
+        } else if (!y.isReg) {
+                loadConst(p, t2, y, -1);
+                ry = t2;
+        } else if (bias != 0) {
+                loadConst(p, t1, biasOp, use);
+                emitOp(p, ADD, t2, y.reg, t1);
+                ry = t2;
+        } else {
+                ry = y.reg;
+        }
+
+        /* Nothing is below 0: when y is, x < y is false */
+        uint32_t cont = NO_SYMBOL;
+        if (!isConst(p, y, &cy) || cy + bias == 0) {
+                Operand notBelow = target;
+                if (!negate) {
+                        cont = newLabel(p->as);
+                        notBelow.isReg = false;
+                        notBelow.symbol = cont;
+                        notBelow.value = 0;
+                }
+                emitBranch(p, ry, false, notBelow, t1, use);
+        }
+
+        if (isConst(p, x, &cx)) {
+                Operand bx = { false, 0, NO_SYMBOL, cx + bias };
+                loadConst(p, t1, bx, use);
+                rx = t1;
+        } else if (!x.isReg) {
+                loadConst(p, t1, x, -1);
+                rx = t1;
+        } else if (bias != 0) {
+                loadConst(p, t1, biasOp, use);
+                emitOp(p, ADD, t1, x.reg, t1);
+                rx = t1;
+        } else {
+                rx = x.reg;
+        }
+        emitOp(p, DIV, t1, rx, ry);
+        emitBranch(p, t1, negate, target, t2, use);
+        if (cont != NO_SYMBOL) {
+                emitLabel(p, cont);
+        }
+}
+
+/* Comparisons of if-goto; those ending in 's' are signed */
+static const char *relations[] = {
+        "==", "!=", "<s", ">s", "<=s", ">=s", "<", ">", "<=", ">="
+};
+
+/* Whether x REL y holds, for constants */
+static bool compareConst(const char *rel, uint32_t x, uint32_t y)
+{
+        bool isSigned = rel[strlen(rel) - 1] == 's';
+        int64_t sx = isSigned ? (int32_t)x : (int64_t)x;
+        int64_t sy = isSigned ? (int32_t)y : (int64_t)y;
+        if (strcmp(rel, "==") == 0) {
+                return sx == sy;
+        } else if (strcmp(rel, "!=") == 0) {
+                return sx != sy;
+        } else if (rel[0] == '<') {
+                return rel[1] == '=' ? sx <= sy : sx < sy;
+        } else {
+                return rel[1] == '=' ? sx >= sy : sx > sy;
+        }
+}
+
+/********** emitEquality ********
+ *
+ * Emits "if (x == y) goto target", or with != for ifDiffer
+ *
+ * Parameters:
+ *     Parser *p: Parser emitting it
+ *     Operand x, y: Operands compared, not both constants
+ *     bool ifDiffer: Whether to jump when they differ instead
+ *     Operand target: Where to jump
+ *     int use: Register to clobber
+ *     uint8_t busy: Registers not to use as temporaries
+ *
+ * Return: true, or false after reporting that no temporary is free
+ *
+ ************************/
+static bool emitEquality(Parser *p, Operand x, Operand y, bool ifDiffer,
+                         Operand target, int use, uint8_t busy)
+{
+        uint32_t cx, cy;
+        int hold, cond;
+        if (isConst(p, x, &cx)) {
+                Operand swap = x;
+                x = y;
+                y = swap;
+        }
+        if (!takeTemp(p, &busy, &hold)) {
+                return false;
+        }
+        if (x.isReg && isConst(p, y, &cy) && cy == 0) {
+                emitBranch(p, x.reg, ifDiffer, target, hold, use);
+                return true;
+        }
+        if (!takeTemp(p, &busy, &cond)) {
+                return false;
+        }
+        if (isConst(p, y, &cy)) {
+                /* cond := x - y, with the subtraction done now */
+                Operand negY = { false, 0, NO_SYMBOL, -cy };
+                if (x.isReg) {
+                        loadConst(p, cond, negY, hold);
+                        emitOp(p, ADD, cond, x.reg, cond);
+                } else {
+                        x.value -= cy;
+                        loadConst(p, cond, x, -1);
+                }
+        } else {
+                /* cond := x + ~y + 1 */
+                if (y.isReg) {
+                        emitOp(p, NAND, cond, y.reg, y.reg);
+                } else {
+                        loadConst(p, cond, y, -1);
+                        emitOp(p, NAND, cond, cond, cond);
+                }
+                int rx = x.isReg ? x.reg : hold;
+                if (!x.isReg) {
+                        loadConst(p, hold, x, -1);
+                }
+                emitOp(p, ADD, cond, rx, cond);
+                emitLoadv(p, hold, NO_SYMBOL, 1);
+                emitOp(p, ADD, cond, cond, hold);
+        }
+        emitBranch(p, cond, ifDiffer, target, hold, use);
+        return true;
+}
+
+/********** parseIf ********
+ *
+ * Parses and emits "if (rC != 0) rA := rB", or
+ * "if (X REL Y) goto TARGET [using rU]" for the relations above
+ *
+ * Parameters:
+ *     Parser *p: Parser after the "if"
+ *
+ * Return: true, or false after reporting an error
+ *
+ ************************/
+static bool parseIf(Parser *p)
+{
+        Operand x, y, target;
+        int a, b, c, use = -1;
+        uint32_t cx, cy;
+        if (!expect(p, "(")) {
+                return false;
+        }
+        if (peek(p, 0)->kind == TOK_REG && isPunct(peek(p, 1), "!=") &&
+            peek(p, 2)->kind == TOK_NUM && peek(p, 2)->value == 0 &&
+            isPunct(peek(p, 3), ")") && peek(p, 4)->kind == TOK_REG) {
+                c = peek(p, 0)->value;
+                p->pos += 4;
+                if (!parseReg(p, &a) || !expect(p, ":=") ||
+                    !parseReg(p, &b) || !atEnd(p)) {
+                        return false;
+                }
+                emitOp(p, CMOV, a, b, c);
+                return true;
+        }
+
+        if (!parseOperand(p, &x)) {
+                return false;
+        }
+        const char *rel = NULL;
+        for (size_t i = 0; i < sizeof(relations) / sizeof(*relations); i++) {
+                if (isPunct(peek(p, 0), relations[i])) {
+                        rel = relations[i];
+                }
+        }
+        if (rel == NULL) {
+                return syntax(p, "expected a comparison, not %s",
+                              peek(p, 0)->text);
+        }
+        p->pos++;
+        if (!parseOperand(p, &y) || !expect(p, ")") ||
+            !expectWord(p, "goto") || !parseOperand(p, &target) ||
+            (acceptWord(p, "using") && !parseReg(p, &use)) || !atEnd(p) ||
+            !needZero(p, "if-goto")) {
+                return false;
+        }
+
+        uint8_t busy = regBit(x) | regBit(y) | regBit(target);
+        if (use >= 0) {
+                busy |= 1u << use;
+        } else if (!takeTemp(p, &busy, &use)) {
+                return false;
+        }
+        if (isConst(p, x, &cx) && isConst(p, y, &cy)) {
+                if (compareConst(rel, cx, cy)) {
+                        emitJump(p, target, use);
+                }
+                return true;
+        }
+        if (rel[0] == '=' || rel[0] == '!') {
+                return emitEquality(p, x, y, rel[0] == '!', target, use,
+                                    busy);
+        }
+
+        bool isSigned = rel[strlen(rel) - 1] == 's';
+        if (isSigned && ((!x.isReg && x.symbol != NO_SYMBOL) ||
+                         (!y.isReg && y.symbol != NO_SYMBOL))) {
+                return syntax(p, "labels can only be compared unsigned");
+        }
+        /* x > y is y < x; x <= y is not y < x; x >= y is not x < y */
+        bool negate = rel[1] == '=';
+        if ((rel[0] == '>') != negate) {
+                Operand swap = x;
+                x = y;
+                y = swap;
+        }
+        int t1, t2;
+        if (!takeTemp(p, &busy, &t1) || !takeTemp(p, &busy, &t2)) {
+                return false;
+        }
+        emitCompare(p, x, y, isSigned, negate, target, t1, t2, use);
+        return true;
+}
+
+/********** parseGoto ********
+ *
+ * Parses and emits "goto TARGET [in program m[rS]] [linking rL]
+ * [using rU]"
+ *
+ * Parameters:
+ *     Parser *p: Parser after the "goto"
+ *
+ * Return: true, or false after reporting an error
+ *
+ * Notes
+ *      linking sets rL to the offset just after the jump, for a callee
+ *      to return to with "goto rL"
+ ************************/
+static bool parseGoto(Parser *p)
+{
+        Operand target;
+        int seg = p->zero, link = -1, use = -1;
+        if (!parseOperand(p, &target)) {
+                return false;
+        }
+        if (acceptWord(p, "in") &&
+            (!expectWord(p, "program") || !expectWord(p, "m") ||
+             !expect(p, "[") || !parseReg(p, &seg) || !expect(p, "]"))) {
+                return false;
+        }
+        if ((acceptWord(p, "linking") && !parseReg(p, &link)) ||
+            (acceptWord(p, "using") && !parseReg(p, &use)) || !atEnd(p)) {
+                return false;
+        }
+        if (seg < 0) {
+                return needZero(p, "goto");
+        }
+        if (target.isReg && target.reg == link) {
+                return syntax(p, "goto r%d linking r%d overwrites the "
+                                 "target", link, link);
+        }
+
+        uint8_t busy = regBit(target) | 1u << seg;
+        busy |= (link >= 0 ? 1u << link : 0) | (use >= 0 ? 1u << use : 0);
+        if (!target.isReg && use < 0 && !takeTemp(p, &busy, &use)) {
+                return false;
+        }
+        uint32_t ret = NO_SYMBOL;
+        if (link >= 0) {
+                ret = newLabel(p->as);
+                emitLoadv(p, link, ret, 0);
+        }
+        if (!target.isReg) {
+                loadConst(p, use, target, -1);
+                target.reg = use;
+        }
+        emitOp(p, LOADP, 0, seg, target.reg);
+        if (ret != NO_SYMBOL) {
+                emitLabel(p, ret);
+        }
+        return true;
+}
+
+/********** parseStack ********
+ *
+ * Parses and emits "push X on stack rS" or "pop rX off stack rS". A
+ * stack grows down from the label it starts at, rS pointing at its top.
+ *
+ * Parameters:
+ *     Parser *p: Parser after the "push" or "pop"
+ *     bool push: Which it is
+ *
+ * Return: true, or false after reporting an error
+ *
+ ************************/
+static bool parseStack(Parser *p, bool push)
+{
+        Operand x;
+        int sp, rx, t;
+        if (!(push ? parseOperand(p, &x) : parseReg(p, &rx)) ||
+            !expectWord(p, push ? "on" : "off") ||
+            !expectWord(p, "stack") || !parseReg(p, &sp) || !atEnd(p) ||
+            !needZero(p, push ? "push" : "pop")) {
+                return false;
+        }
+        if (!push && rx == sp) {
+                return syntax(p, "cannot pop r%d off its own stack", sp);
+        }
+        uint8_t busy = 1u << sp | (push ? regBit(x) : 1u << rx);
+        Section *section;
+        uint32_t first = 0;
+        if (p->section != NO_SYMBOL) {
+                first = p->as->sections[p->section].numItems;
+        }
+        if (push) {
+                if (!inReg(p, x, &busy, &rx) || !takeTemp(p, &busy, &t)) {
+                        return false;
+                }
+                emitLoadv(p, t, NO_SYMBOL, 0);
+                emitOp(p, NAND, t, t, t);
+                emitOp(p, ADD, sp, sp, t);
+                emitOp(p, SSTORE, p->zero, sp, rx);
+        } else {
+                if (!takeTemp(p, &busy, &t)) {
+                        return false;
+                }
+                emitOp(p, SLOAD, rx, p->zero, sp);
+                emitLoadv(p, t, NO_SYMBOL, 1);
+                emitOp(p, ADD, sp, sp, t);
+        }
+
+        /* Tagged so that the optimizer can cancel pushes against pops */
+        section = &p->as->sections[p->section];
+        for (uint32_t i = first; i < section->numItems; i++) {
+                section->items[i].macro = push ? MACRO_PUSH : MACRO_POP;
+        }
+        return true;
+}
+
+/* Parses and emits "output X" or output "string" */
+static bool parseOutput(Parser *p)
+{
+        Token *tok = peek(p, 0);
+        uint8_t busy = 0;
+        Operand x;
+        int rx;
+        if (tok->kind == TOK_STRING) {
+                p->pos++;
+                if (!atEnd(p) || !takeTemp(p, &busy, &rx)) {
+                        return false;
+                }
+                for (uint32_t i = 0; i < tok->value; i++) {
+                        emitLoadv(p, rx, NO_SYMBOL, (uint8_t)tok->text[i]);
+                        emitOp(p, OUT, 0, 0, rx);
+                }
+                return true;
+        }
+        if (!parseOperand(p, &x) || !atEnd(p)) {
+                return false;
+        }
+        busy = regBit(x);
+        if (!inReg(p, x, &busy, &rx)) {
+                return false;
+        }
+        emitOp(p, OUT, 0, 0, rx);
+        return true;
+}
+
+/* Parses and emits "m[X][Y] := Z" after the "m" */
+static bool parseStore(Parser *p)
+{
+        Operand x, y, z;
+        int rx, ry, rz;
+        if (!expect(p, "[") || !parseOperand(p, &x) || !expect(p, "]") ||
+            !expect(p, "[") || !parseOperand(p, &y) || !expect(p, "]") ||
+            !expect(p, ":=") || !parseOperand(p, &z) || !atEnd(p)) {
+                return false;
+        }
+        uint8_t busy = regBit(x) | regBit(y) | regBit(z);
+        if (!inReg(p, x, &busy, &rx) || !inReg(p, y, &busy, &ry) ||
+            !inReg(p, z, &busy, &rz)) {
+                return false;
+        }
+        emitOp(p, SSTORE, rx, ry, rz);
+        return true;
+}
+
+/* Parses a link-time value that must be a constant */
+static bool parseConst(Parser *p, uint32_t *value)
+{
+        Operand x;
+        *value = 0;
+        if (!parseExpr(p, &x)) {
+                return false;
+        }
+        if (x.symbol != NO_SYMBOL) {
+                return syntax(p, "expected a constant, not a label");
+        }
+        *value = x.value;
+        return true;
+}
+
+/********** parseDirective ********
+ *
+ * Parses a directive: .section NAME, .zero REG, .temps REG, ...,
+ * .space N (N zero words) or .data X (one word)
+ *
+ * Parameters:
+ *     Parser *p: Parser after the "."
+ *
+ * Return: true, or false after reporting an error
+ *
+ ************************/
+static bool parseDirective(Parser *p)
+{
+        Token *name = peek(p, 0);
+        Operand x;
+        int reg;
+        p->pos++;
+        if (isWord(name, "section")) {
+                if (peek(p, 0)->kind != TOK_IDENT) {
+                        return syntax(p, "expected a section name");
+                }
+                p->section = findSection(p->as, peek(p, 0)->text);
+                p->pos++;
+                return atEnd(p);
+        } else if (isWord(name, "zero")) {
+                if (!parseReg(p, &reg) || !atEnd(p)) {
+                        return false;
+                }
+                if (p->temps >> reg & 1) {
+                        return syntax(p, "r%d is a temporary", reg);
+                }
+                p->zero = reg;
+                return true;
+        } else if (isWord(name, "temps")) {
+                uint8_t temps = 0;
+                while (peek(p, 0)->kind != TOK_END) {
+                        if (temps != 0 && !expect(p, ",")) {
+                                return false;
+                        }
+                        if (!parseReg(p, &reg)) {
+                                return false;
+                        }
+                        if (reg == p->zero) {
+                                return syntax(p, "r%d is the zero "
+                                                 "register", reg);
+                        }
+                        temps |= 1u << reg;
+                }
+                p->temps = temps;
+                return true;
+        } else if (isWord(name, "space")) {
+                uint32_t words;
+                if (!parseConst(p, &words) || !atEnd(p)) {
+                        return false;
+                }
+                newItem(p, ITEM_SPACE)->value = words;
+                return true;
+        } else if (isWord(name, "data")) {
+                if (!parseExpr(p, &x) || !atEnd(p)) {
+                        return false;
+                }
+                Item *item = newItem(p, ITEM_WORD);
+                item->symbol = x.symbol;
+                item->value = x.value;
+                return true;
+        }
+        return syntax(p, "unknown directive .%s", name->text);
+}
+
+/* Defines a source label at the next item of the current section */
+static bool defineLabel(Parser *p, const char *name)
+{
+        uint32_t s = findSymbol(p->as, name, p->file, p->line);
+        Symbol *sym = &p->as->symbols[s];
+        if (sym->defined) {
+                return syntax(p, "label %s already defined at %s:%d", name,
+                              sym->file, sym->line);
+        }
+        sym->defined = true;
+        sym->file = p->file;
+        sym->line = p->line;
+        emitLabel(p, s);
+        return true;
+}
+
+/********** parseLine ********
+ *
+ * Parses and emits one tokenized line: labels, then a directive or a
+ * statement, either of which may be left out
+ *
+ * Parameters:
+ *     Parser *p: Parser holding the line's tokens
+ *
+ * Return: true, or false after reporting an error
+ *
+ ************************/
+static bool parseLine(Parser *p)
+{
+        while (peek(p, 0)->kind == TOK_IDENT && isPunct(peek(p, 1), ":")) {
+                if (!defineLabel(p, peek(p, 0)->text)) {
+                        return false;
+                }
+                p->pos += 2;
+        }
+        Token *tok = peek(p, 0);
+        int d;
+        if (tok->kind == TOK_END) {
+                return true;
+        } else if (accept(p, ".")) {
+                return parseDirective(p);
+        } else if (tok->kind == TOK_REG) {
+                return parseReg(p, &d) && expect(p, ":=") &&
+                       parseAssign(p, d);
+        }
+        p->pos++;
+        if (isWord(tok, "m") && isPunct(peek(p, 0), "[")) {
+                return parseStore(p);
+        } else if (isWord(tok, "goto")) {
+                return parseGoto(p);
+        } else if (isWord(tok, "if")) {
+                return parseIf(p);
+        } else if (isWord(tok, "push") || isWord(tok, "pop")) {
+                return parseStack(p, isWord(tok, "push"));
+        } else if (isWord(tok, "output")) {
+                return parseOutput(p);
+        } else if (isWord(tok, "halt")) {
+                if (!atEnd(p)) {
+                        return false;
+                }
+                emitOp(p, HALT, 0, 0, 0);
+                return true;
+        } else if (isWord(tok, "unmap")) {
+                Operand x;
+                uint8_t busy = 0;
+                int rx;
+                if (!expectWord(p, "m") || !expect(p, "[") ||
+                    !parseOperand(p, &x) || !expect(p, "]") || !atEnd(p)) {
+                        return false;
+                }
+                busy = regBit(x);
+                if (!inReg(p, x, &busy, &rx)) {
+                        return false;
+                }
+                emitOp(p, UNMAP, 0, 0, rx);
+                return true;
+        }
+        return syntax(p, "unknown statement %s", tok->text);
+}
+
+/********** assembleFile ********
+ *
+ * Assembles one .ums module into a program. Each module starts with no
+ * .zero register, no temporaries, and in section text.
+ *
+ * Parameters:
+ *     Asm_T as: Program to add it to
+ *     const char *path: Module's file; must outlive as
+ *
+ * Return: true, or false if it cannot be read or has errors, which are
+ *         reported to stderr
+ *
+ ************************/
+bool assembleFile(Asm_T as, const char *path)
+{
+        FILE *fp = fopen(path, "r");
+        if (fp == NULL) {
+                fprintf(stderr, "umasm: cannot open %s\n", path);
+                as->errors++;
+                return false;
+        }
+        Parser *p = malloc(sizeof(*p));
+        assert(p != NULL);
+        p->as = as;
+        p->file = path;
+        p->line = 0;
+        p->section = NO_SYMBOL;
+        p->zero = -1;
+        p->temps = 0;
+
+        int before = as->errors;
+        char line[MAX_LINE];
+        while (fgets(line, sizeof(line), fp) != NULL) {
+                p->line++;
+                size_t len = strlen(line);
+                if (len == sizeof(line) - 1 && line[len - 1] != '\n') {
+                        syntax(p, "line too long");
+                        int c;
+                        while ((c = getc(fp)) != EOF && c != '\n') {
+                                /* Skip the rest of it */
+                        }
+                        continue;
+                }
+                if (tokenize(p, line)) {
+                        parseLine(p);
+                }
+        }
+        bool ok = !ferror(fp);
+        if (!ok) {
+                fprintf(stderr, "umasm: error reading %s\n", path);
+                as->errors++;
+        }
+        fclose(fp);
+        free(p);
+        return ok && as->errors == before;
+}
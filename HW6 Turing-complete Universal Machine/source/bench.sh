@@ -0,0 +1,154 @@
+#!/bin/sh
+#
+# bench.sh: runs the UM benchmarks in ../tests and records how they did
+#
+# Jack Burton jburto05
+# James Hartley jhartl01
+#
+# Usage: ./bench.sh [-u UM] [-t TESTS] [-o PREFIX] [-b BUDGET]
+#
+# Runs hello.um, midmark.um, sandmark.umz and codex.umz (the last only up
+# to BUDGET instructions, 500000000 by default) under `UM --stats`, and
+# for each records instructions executed, wall time (load and run),
+# instructions per second, peak RSS and a cksum of the output. sandmark's
+# output is compared with sandmark.out, hello's and midmark's with known
+# checksums, and codex, which prints nothing within the budget, is checked
+# by the cksum of where it stopped (um's report of its program counter,
+# registers and instruction count). A row per program is appended to
+# PREFIX.csv (so runs at different commits can be compared) and this run
+# alone is written to PREFIX.json. PREFIX defaults to bench-results/bench,
+# and its directory is made if need be; bench-results is ignored by git,
+# so runs do not mark the tree changed. Exits with failure if any output
+# is wrong.
+#
+
+UM=./um
+TESTS=../tests
+PREFIX=bench-results/bench
+BUDGET=500000000
+DEFAULT_BUDGET=500000000
+
+while getopts u:t:o:b: opt; do
+        case $opt in
+                u) UM=$OPTARG ;;
+                t) TESTS=$OPTARG ;;
+                o) PREFIX=$OPTARG ;;
+                b) BUDGET=$OPTARG ;;
+                *) echo "usage: $0 [-u UM] [-t TESTS] [-o PREFIX]" \
+                        "[-b BUDGET]" >&2
+                   exit 1 ;;
+        esac
+done
+
+if [ ! -x "$UM" ]; then
+        echo "$0: $UM is not executable; run make first" >&2
+        exit 1
+fi
+
+mkdir -p "$(dirname "$PREFIX")" || exit 1
+
+COMMIT=$(git rev-parse --short HEAD 2>/dev/null || echo unknown)
+if [ -n "$(git status --porcelain -- . 2>/dev/null)" ]; then
+        COMMIT="$COMMIT+"
+fi
+DATE=$(date -u +%Y-%m-%dT%H:%M:%SZ)
+STDOUT=$(mktemp) || exit 1
+STDERR=$(mktemp) || exit 1
+JSON=$(mktemp) || exit 1
+trap 'rm -f "$STDOUT" "$STDERR" "$JSON"' EXIT
+
+if [ ! -f "$PREFIX.csv" ]; then
+        echo "commit,date,program,instructions,wall_ms,instr_per_sec," \
+             "peak_rss_kib,output_cksum,check" | tr -d ' ' > "$PREFIX.csv"
+fi
+
+failed=0
+
+# Prints one field of um --stats output, e.g. statOf "run time"
+statOf()
+{
+        sed -n "s/^$1: *\([0-9.]*\).*/\1/p" "$STDERR" | tail -n 1
+}
+
+# run NAME EXPECTED INPUT [UM OPTIONS...] PROGRAM
+# EXPECTED is the cksum of the right output, "sandmark.out" to compare
+# with that file, "stop:" and the cksum of the right stop report for a
+# budgeted run, or "-" for no check.
+run()
+{
+        name=$1
+        expected=$2
+        input=$3
+        shift 3
+        "$UM" --stats --count "$@" < "$input" > "$STDOUT" 2> "$STDERR"
+
+        instructions=$(statOf instructions)
+        wall=$(awk -v l="$(statOf "load time")" -v r="$(statOf "run time")" \
+                   'BEGIN { printf "%.3f", l + r }')
+        ips=$(awk -v n="$instructions" -v r="$(statOf "run time")" \
+                  'BEGIN { printf "%.0f", (r > 0 ? n / (r / 1000) : 0) }')
+        rss=$(statOf "peak rss")
+        sum=$(cksum < "$STDOUT" | awk '{ print $1 "-" $2 }')
+        stop=$(sed -n '/^um: stopped/,/^instructions/p' "$STDERR" | cksum |
+               awk '{ print "stop:" $1 "-" $2 }')
+
+        if [ "$expected" = "-" ]; then
+                check=unchecked
+        elif [ "${expected#stop:}" != "$expected" ]; then
+                if [ "$stop" = "$expected" ]; then
+                        check=ok
+                else
+                        check=FAIL
+                fi
+        elif [ "$expected" = sandmark.out ]; then
+                if cmp -s "$STDOUT" "$TESTS/sandmark.out"; then
+                        check=ok
+                else
+                        check=FAIL
+                fi
+        elif [ "$sum" = "$expected" ]; then
+                check=ok
+        else
+                check=FAIL
+        fi
+        if [ "$check" = FAIL ]; then
+                failed=1
+        fi
+
+        printf "%-10s %12s instr %10s ms %14s instr/s %8s KiB  %s\n" \
+               "$name" "$instructions" "$wall" "$ips" "$rss" "$check"
+        echo "$COMMIT,$DATE,$name,$instructions,$wall,$ips,$rss,$sum,$check" \
+                >> "$PREFIX.csv"
+        [ -s "$JSON" ] && echo "," >> "$JSON"
+        printf '    {"program": "%s", "instructions": %s, "wall_ms": %s, ' \
+               "$name" "$instructions" "$wall" >> "$JSON"
+        printf '"instr_per_sec": %s, "peak_rss_kib": %s, ' \
+               "$ips" "$rss" >> "$JSON"
+        printf '"output_cksum": "%s", "check": "%s"}' \
+               "$sum" "$check" >> "$JSON"
+}
+
+# codex prints nothing within the budget, so its check is of where it
+# stopped, which only holds at the budget that was taken at
+codexSum=-
+if [ "$BUDGET" = "$DEFAULT_BUDGET" ]; then
+        codexSum=stop:829781094-235
+fi
+
+run hello 1779316808-14 /dev/null "$TESTS/hello.um"
+run midmark 3190413062-181 /dev/null "$TESTS/midmark.um"
+run sandmark sandmark.out /dev/null "$TESTS/sandmark.umz"
+run codex "$codexSum" /dev/null --budget "$BUDGET" "$TESTS/codex.umz"
+
+{
+        echo "{"
+        echo "  \"commit\": \"$COMMIT\","
+        echo "  \"date\": \"$DATE\","
+        echo "  \"results\": ["
+        cat "$JSON"
+        echo
+        echo "  ]"
+        echo "}"
+} > "$PREFIX.json"
+
+exit $failed
@@ -0,0 +1,483 @@
+/*
+ *     filename: cfg.c
+ *     partner 1 name: Jack Burton       Login: jburto05
+ *     partner 2 name: James Hartley        Login: jhartl01
+ *     date: April 12th, 2024
+ *     assignment: hw6
+ *
+ *     summary: Builds the control-flow graph of a UM program. A jump is a
+ *     LOADP whose segment and offset registers were set by LOADVs (and
+ *     CMOVs, for a branch) earlier in its block, which is how the HW8
+ *     goto macros compile, so the registers are tracked through each
+ *     block as sets of known values, and joined into the blocks each
+ *     known jump or fall-through goes to.
+ *
+*/
+
+#include <string.h>
+#include "cfg.h"
+
+/* Most values a register is tracked as possibly holding */
+#define MAX_VALUES 2
+
+/* Value
+ * Usage: What is known about a register at one point in a block
+ *
+ * Members:
+ * 	uint8_t n: Number of values it may hold, or 0 if not known
+ * 	uint32_t v: The values
+ *
+*/
+typedef struct Value {
+        uint8_t n;
+        uint32_t v[MAX_VALUES];
+} Value;
+
+static const Value UNKNOWN = { 0, { 0, 0 } };
+
+/* Scan
+ * Usage: What the passes over a program have found so far
+ *
+ * Members:
+ * 	uint8_t *leader: Per offset, whether a block starts there
+ * 	uint32_t *slot: Per offset, 1 + index in regs of the registers
+ * 		known on entry to the block there, or 0 if no known jump
+ * 		or fall-through goes to it
+ * 	Value (*regs)[8]: The registers known on entry, joined over every
+ * 		known way in. Entries only ever grow, so passes settle.
+ * 	uint32_t count, capacity: Entries used and allocated in regs
+ *
+*/
+typedef struct Scan {
+        uint8_t *leader;
+        uint32_t *slot;
+        Value (*regs)[8];
+        uint32_t count;
+        uint32_t capacity;
+} Scan;
+
+static Value known(uint32_t x)
+{
+        Value val = { 1, { x, 0 } };
+        return val;
+}
+
+/* Gets the values either of x or y may hold */
+static Value join(Value x, Value y)
+{
+        if (x.n == 0 || y.n == 0) {
+                return UNKNOWN;
+        }
+        for (int i = 0; i < y.n; i++) {
+                bool found = false;
+                for (int j = 0; j < x.n; j++) {
+                        found = found || x.v[j] == y.v[i];
+                }
+                if (found) {
+                        continue;
+                }
+                if (x.n == MAX_VALUES) {
+                        return UNKNOWN;
+                }
+                x.v[x.n++] = y.v[i];
+        }
+        return x;
+}
+
+/* Whether x is known, and every value it may hold is nonzero (or with
+ * nonzero false, zero) */
+static bool everyValue(Value x, bool nonzero)
+{
+        for (int i = 0; i < x.n; i++) {
+                if ((x.v[i] != 0) != nonzero) {
+                        return false;
+                }
+        }
+        return x.n > 0;
+}
+
+/********** arith ********
+ *
+ * Gets the values an ADD, MUL, DIV or NAND may produce
+ *
+ * Parameters:
+ *     uint8_t op: The instruction's Decoded_op
+ *     Value b, c: Its operands
+ *
+ * Return: The results for each pair of operand values, or UNKNOWN if an
+ *         operand is not known, a division is by zero or there are more
+ *         than MAX_VALUES results
+ *
+ ************************/
+static Value arith(uint8_t op, Value b, Value c)
+{
+        Value result = UNKNOWN;
+        for (int i = 0; i < b.n; i++) {
+                for (int j = 0; j < c.n; j++) {
+                        uint32_t x = b.v[i], y = c.v[j], z;
+                        if (op == D_ADD) {
+                                z = x + y;
+                        } else if (op == D_MUL) {
+                                z = x * y;
+                        } else if (op == D_DIV && y != 0) {
+                                z = x / y;
+                        } else if (op == D_NAND) {
+                                z = ~(x & y);
+                        } else {
+                                return UNKNOWN;
+                        }
+                        result = result.n == 0 ? known(z)
+                                               : join(result, known(z));
+                        if (result.n == 0) {
+                                return UNKNOWN;
+                        }
+                }
+        }
+        return result;
+}
+
+/* Sets the registers as they are known on entry to the block at
+ * offset: unknown unless a known jump or fall-through goes to it */
+static void enterBlock(Value r[8], bool r0Zero, const Scan *scan,
+                       uint32_t offset)
+{
+        uint32_t slot = scan->slot[offset];
+        for (int i = 0; i < 8; i++) {
+                r[i] = slot > 0 ? scan->regs[slot - 1][i] : UNKNOWN;
+        }
+        if (r0Zero) {
+                r[0] = known(0);
+        }
+}
+
+/* Whether x and y may hold the same values, in the same order */
+static bool sameValue(Value x, Value y)
+{
+        for (int i = 0; i < x.n && i < y.n; i++) {
+                if (x.v[i] != y.v[i]) {
+                        return false;
+                }
+        }
+        return x.n == y.n;
+}
+
+/********** addEdge ********
+ *
+ * Joins the registers a known jump or fall-through leaves into those
+ * known on entry to the block it goes to
+ *
+ * Parameters:
+ *     Scan *scan: Entry registers so far; updated
+ *     uint32_t to: Offset gone to
+ *     const Value r[8]: Registers along the edge
+ *
+ * Return: Whether the entry registers at to changed
+ *
+ ************************/
+static bool addEdge(Scan *scan, uint32_t to, const Value r[8])
+{
+        if (scan->slot[to] == 0) {
+                if (scan->count == scan->capacity) {
+                        scan->capacity = 2 * scan->capacity + 64;
+                        scan->regs = realloc(scan->regs, scan->capacity *
+                                             sizeof(*scan->regs));
+                        assert(scan->regs != NULL);
+                }
+                scan->slot[to] = ++scan->count;
+                memcpy(scan->regs[scan->count - 1], r, sizeof(Value[8]));
+                return true;
+        }
+        Value *entry = scan->regs[scan->slot[to] - 1];
+        bool changed = false;
+        for (int i = 0; i < 8; i++) {
+                Value joined = join(entry[i], r[i]);
+                changed = changed || !sameValue(joined, entry[i]);
+                entry[i] = joined;
+        }
+        return changed;
+}
+
+/* Updates the registers for one instruction that is not LOADP */
+static void abstractStep(Value r[8], Decoded ins)
+{
+        switch (ins.op) {
+        case D_CMOV:
+                if (everyValue(r[ins.c], true)) {
+                        r[ins.a] = r[ins.b];
+                } else if (!everyValue(r[ins.c], false)) {
+                        r[ins.a] = join(r[ins.a], r[ins.b]);
+                }
+                break;
+        case D_SLOAD:
+                r[ins.a] = UNKNOWN;
+                break;
+        case D_ADD:
+        case D_MUL:
+        case D_DIV:
+        case D_NAND:
+                r[ins.a] = arith(ins.op, r[ins.b], r[ins.c]);
+                break;
+        case D_MAP:
+                r[ins.b] = UNKNOWN;
+                break;
+        case D_IN:
+                r[ins.c] = UNKNOWN;
+                break;
+        case D_LOADV:
+                r[ins.a] = known(ins.value);
+                break;
+        default:
+                break;
+        }
+}
+
+/********** classifyJump ********
+ *
+ * Works out where a LOADP goes from what is known about its registers
+ *
+ * Parameters:
+ *     Value r[8]: Registers just before the LOADP
+ *     Decoded ins: The LOADP
+ *     uint32_t next: Offset after it
+ *     uint32_t succ[2]: Set to the offsets it may go to, CFG_NONE for
+ *                       none
+ *
+ * Return: How the block it ends exits
+ *
+ * Notes
+ *      A jump that leaves a register holding exactly next is taken to
+ *      be a call, as the HW8 calling convention puts the return address
+ *      in r1 before the goto.
+ ************************/
+static Block_exit classifyJump(Value r[8], Decoded ins, uint32_t next,
+                               uint32_t succ[2])
+{
+        Value seg = r[ins.b], target = r[ins.c];
+        if (!everyValue(seg, false)) {
+                return everyValue(seg, true) ? BLOCK_LOAD : BLOCK_INDIRECT;
+        }
+        if (target.n == 0) {
+                return BLOCK_INDIRECT;
+        }
+        succ[0] = target.v[0];
+        if (target.n == 2) {
+                succ[1] = target.v[1];
+                return BLOCK_BRANCH;
+        }
+        for (int i = 0; i < 8; i++) {
+                if (i != ins.c && r[i].n == 1 && r[i].v[0] == next) {
+                        succ[1] = next;
+                        return BLOCK_CALL;
+                }
+        }
+        return BLOCK_JUMP;
+}
+
+/********** scanProgram ********
+ *
+ * Makes one pass over a program, marking block leaders: offset 0, every
+ * known jump target and every word after a block-ending instruction.
+ * Registers are tracked through each block from what is known on
+ * entry, and joined into the entry registers of the blocks it goes to.
+ *
+ * Parameters:
+ *     const uint32_t *words: The program
+ *     uint32_t length: Its number of words
+ *     bool r0Zero: Whether r0 is taken to be 0 on entry to every block
+ *     Scan *scan: Leaders and entry registers found so far; updated
+ *     Block *blocks: If not NULL, filled in with a block per leader
+ *
+ * Return: Number of leaders newly marked and entry registers changed.
+ *         Registers were tracked on what was known before, so until a
+ *         pass changes none, some jumps may not be classified right.
+ *
+ ************************/
+static uint32_t scanProgram(const uint32_t *words, uint32_t length,
+                            bool r0Zero, Scan *scan, Block *blocks)
+{
+        uint32_t added = 0, numBlocks = 0;
+        Block *block = NULL;
+        Value r[8];
+        static const Value returned[8];
+
+        for (uint32_t offset = 0; offset < length; offset++) {
+                if (scan->leader[offset]) {
+                        enterBlock(r, r0Zero, scan, offset);
+                        if (blocks != NULL) {
+                                block = &blocks[numBlocks++];
+                                block->start = offset;
+                        }
+                }
+                Decoded ins = decodeWord(words[offset]);
+                Block_exit exit = BLOCK_FALL;
+                uint32_t succ[2] = { CFG_NONE, CFG_NONE };
+                if (ins.op == D_LOADP) {
+                        exit = classifyJump(r, ins, offset + 1, succ);
+                } else if (ins.op == D_HALT) {
+                        exit = BLOCK_HALT;
+                } else if (ins.op == D_INVALID) {
+                        exit = BLOCK_INVALID;
+                } else {
+                        abstractStep(r, ins);
+                }
+
+                for (int i = 0; i < 2; i++) {
+                        if (succ[i] >= length) {
+                                continue;
+                        }
+                        if (!scan->leader[succ[i]]) {
+                                scan->leader[succ[i]] = true;
+                                added++;
+                        }
+                        /* The return site is entered from the callee */
+                        bool returns = exit == BLOCK_CALL && i == 1;
+                        added += addEdge(scan, succ[i],
+                                         returns ? returned : r);
+                }
+                uint32_t next = offset + 1;
+                bool nextLeader = next < length && scan->leader[next];
+                if (exit != BLOCK_FALL && next < length && !nextLeader) {
+                        scan->leader[next] = true;
+                        added++;
+                } else if (exit == BLOCK_FALL && nextLeader) {
+                        added += addEdge(scan, next, r);
+                }
+                if (blocks == NULL || (next < length && !scan->leader[next])) {
+                        continue;
+                }
+
+                if (exit == BLOCK_FALL) {
+                        exit = next < length ? BLOCK_FALL : BLOCK_END;
+                        succ[0] = next < length ? next : CFG_NONE;
+                }
+                block->end = next;
+                block->exit = exit;
+                block->succ[0] = succ[0] < length ? succ[0] : CFG_NONE;
+                block->succ[1] = succ[1] < length ? succ[1] : CFG_NONE;
+                block->reachable = false;
+        }
+        return added;
+}
+
+/* Marks every block reachable from offset 0 along known edges */
+static void markReachable(Cfg_T cfg)
+{
+        uint32_t *stack = malloc(((size_t)cfg->numBlocks + 1) *
+                                 sizeof(*stack));
+        assert(stack != NULL);
+        uint32_t depth = 0;
+        if (cfg->numBlocks > 0) {
+                cfg->blocks[0].reachable = true;
+                stack[depth++] = 0;
+        }
+        while (depth > 0) {
+                Block *block = &cfg->blocks[stack[--depth]];
+                for (int i = 0; i < 2; i++) {
+                        uint32_t next = findBlock(cfg, block->succ[i]);
+                        if (next != CFG_NONE &&
+                            !cfg->blocks[next].reachable) {
+                                cfg->blocks[next].reachable = true;
+                                stack[depth++] = next;
+                        }
+                }
+        }
+        free(stack);
+}
+
+/********** buildCfg ********
+ *
+ * Finds the basic blocks of a program and the jumps between them
+ *
+ * Parameters:
+ *     const uint32_t *words: The program, as segment 0 would hold it
+ *     uint32_t length: Its number of words
+ *     bool r0Zero: Whether to take r0 as always 0, as HW8 code keeps it,
+ *                  so that its gotos (LOADPs of m[r0]) are known jumps
+ *
+ * Return: pointer to initialized Cfg_T struct
+ *
+ * Notes
+ *      Linear in length, times the few passes it takes for the leaders
+ *      to settle. Only words as they are at load time are seen, so code
+ *      a program writes or modifies is not.
+ ************************/
+Cfg_T buildCfg(const uint32_t *words, uint32_t length, bool r0Zero)
+{
+        Scan scan = { calloc((size_t)length + 1, 1),
+                      calloc((size_t)length + 1, sizeof(uint32_t)),
+                      NULL, 0, 0 };
+        assert(scan.leader != NULL && scan.slot != NULL);
+        scan.leader[0] = true;
+        Value start[8];
+        for (int i = 0; i < 8; i++) {
+                start[i] = known(0);
+        }
+        addEdge(&scan, 0, start);
+        while (scanProgram(words, length, r0Zero, &scan, NULL) > 0) {
+                /* Again, until a pass finds nothing new */
+        }
+
+        Cfg_T cfg = calloc(1, sizeof(*cfg));
+        assert(cfg != NULL);
+        cfg->length = length;
+        for (uint32_t offset = 0; offset < length; offset++) {
+                cfg->numBlocks += scan.leader[offset];
+        }
+        cfg->blocks = calloc((size_t)cfg->numBlocks + 1, sizeof(Block));
+        assert(cfg->blocks != NULL);
+        scanProgram(words, length, r0Zero, &scan, cfg->blocks);
+        free(scan.leader);
+        free(scan.slot);
+        free(scan.regs);
+
+        markReachable(cfg);
+        return cfg;
+}
+
+/********** freeCfg ********
+ *
+ * Frees a control-flow graph
+ *
+ * Parameters:
+ *     Cfg_T cfg: Graph to free, or NULL
+ *
+ * Return: None
+ *
+ ************************/
+void freeCfg(Cfg_T cfg)
+{
+        if (cfg == NULL) {
+                return;
+        }
+        free(cfg->blocks);
+        free(cfg);
+}
+
+/********** findBlock ********
+ *
+ * Finds the block containing an offset
+ *
+ * Parameters:
+ *     Cfg_T cfg: Graph to search
+ *     uint32_t offset: Offset in the program
+ *
+ * Return: Index in cfg->blocks of the block containing offset, or
+ *         CFG_NONE if offset is past the end of the program
+ *
+ ************************/
+uint32_t findBlock(Cfg_T cfg, uint32_t offset)
+{
+        if (offset >= cfg->length) {
+                return CFG_NONE;
+        }
+        uint32_t lo = 0, hi = cfg->numBlocks;
+        while (hi - lo > 1) {
+                uint32_t mid = lo + (hi - lo) / 2;
+                if (cfg->blocks[mid].start <= offset) {
+                        lo = mid;
+                } else {
+                        hi = mid;
+                }
+        }
+        return lo;
+}
@@ -0,0 +1,79 @@
+/*
+ *     filename: cfg.h
+ *     partner 1 name: Jack Burton       Login: jburto05
+ *     partner 2 name: James Hartley        Login: jhartl01
+ *     date: April 12th, 2024
+ *     assignment: hw6
+ *
+ *     summary: Defines the control-flow graph of a UM program: its basic
+ *     blocks and the LOADP jumps between them, found without running it
+ *
+*/
+
+#ifndef CFG_INCLUDED
+#define CFG_INCLUDED
+
+#include "memexec.h"
+
+/* Successor that is not there, or not known */
+#define CFG_NONE UINT32_MAX
+
+/* How a basic block ends */
+typedef enum Block_exit {
+        BLOCK_FALL = 0,  /* runs into the next block, which is jumped to */
+        BLOCK_JUMP,      /* LOADP to one known offset of segment 0 */
+        BLOCK_BRANCH,    /* LOADP to one of two known offsets (a CMOV) */
+        BLOCK_CALL,      /* LOADP to a known offset, with the offset
+                          * after it in a register to return to */
+        BLOCK_INDIRECT,  /* LOADP to an offset not known statically */
+        BLOCK_LOAD,      /* LOADP of a segment other than 0 */
+        BLOCK_HALT,
+        BLOCK_INVALID,   /* a word that is not an instruction */
+        BLOCK_END        /* the last word of the program, not a jump */
+} Block_exit;
+
+/* Block
+ * Usage: One basic block: a run of words entered only at its first and
+ * left only at its last
+ *
+ * Members:
+ * 	uint32_t start, end: Offsets of its first word and one past its
+ * 		last
+ * 	Block_exit exit: How it ends
+ * 	uint32_t succ[2]: Offsets it can go to next, or CFG_NONE. A branch
+ * 		or call has two (for a call, the callee then the return
+ * 		site), a jump or fall-through one, the rest none.
+ * 	bool reachable: Whether it can be reached from offset 0 along known
+ * 		edges. Unreachable words are data, or reached only by an
+ * 		indirect jump.
+ *
+*/
+typedef struct Block {
+        uint32_t start;
+        uint32_t end;
+        Block_exit exit;
+        uint32_t succ[2];
+        bool reachable;
+} Block;
+
+/* Cfg_T
+ * Usage: Control-flow graph of a program
+ *
+ * Members:
+ * 	uint32_t length: Words in the program
+ * 	Block *blocks: Its blocks, in offset order, covering every word
+ * 	uint32_t numBlocks: Number of blocks
+ *
+ * A Cfg_T object is typedefed to be a pointer to a Cfg_T struct instance.
+*/
+typedef struct Cfg_T {
+        uint32_t length;
+        Block *blocks;
+        uint32_t numBlocks;
+} *Cfg_T;
+
+Cfg_T buildCfg(const uint32_t *words, uint32_t length, bool r0Zero);
+void freeCfg(Cfg_T cfg);
+uint32_t findBlock(Cfg_T cfg, uint32_t offset);
+
+#endif
@@ -0,0 +1,230 @@
+/*
+ *     filename: iodev.c
+ *     partner 1 name: Jack Burton       Login: jburto05
+ *     partner 2 name: James Hartley        Login: jhartl01
+ *     date: April 8th, 2024
+ *     assignment: hw6
+ *
+ *     summary: Implements a buffered I/O device for the universal machine
+ *     
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <unistd.h>
+#include "iodev.h"
+
+/********** initIODev ********
+ * 
+ * Creates an I/O device with empty buffers
+ *
+ * Parameters:
+ *     int inFd: File descriptor IN reads from
+ *     int outFd: File descriptor OUT writes to
+ *     int policy: FlushPolicy bits
+ *
+ * Return: pointer to initialized IODev_T struct
+ * 
+ * Notes
+ *      device is heap allocated--freed via freeIODev()
+ *
+ ************************/
+IODev_T initIODev(int inFd, int outFd, int policy)
+{
+        IODev_T io = malloc(sizeof(*io));
+        assert(io != NULL);
+        io->inFd = inFd;
+        io->outFd = outFd;
+        io->policy = policy;
+        io->inPos = 0;
+        io->inLength = 0;
+        io->inEOF = false;
+        io->outLength = 0;
+        return io;
+}
+
+/********** freeIODev ********
+ * 
+ * Flushes pending output and frees the device
+ *
+ * Parameters:
+ *     IODev_T io: Device to free
+ *
+ * Return: None
+ *
+ * Notes
+ *      Does not close the device's file descriptors
+ *
+ ************************/
+void freeIODev(IODev_T io)
+{
+        flushOutput(io);
+        free(io);
+}
+
+/********** defaultFlushPolicy ********
+ * 
+ * Picks a flush policy from what the descriptors are connected to:
+ * line by line when output goes to a terminal, before each read when a
+ * person is typing the input, and only when full otherwise
+ *
+ * Parameters:
+ *     int inFd: File descriptor IN reads from
+ *     int outFd: File descriptor OUT writes to
+ *
+ * Return: FlushPolicy bits
+ *
+ ************************/
+int defaultFlushPolicy(int inFd, int outFd)
+{
+        int policy = FLUSH_FULL;
+        if (isatty(outFd)) {
+                policy |= FLUSH_NEWLINE | FLUSH_INPUT;
+        }
+        if (isatty(inFd)) {
+                policy |= FLUSH_INPUT;
+        }
+        return policy;
+}
+
+/********** putByte ********
+ * 
+ * Buffers one byte of output, flushing as the policy requires
+ *
+ * Parameters:
+ *     IODev_T io: I/O device
+ *     uint32_t value: Byte to write
+ *
+ * Return: None
+ *
+ * Expects
+ *      0 <= value <= 255
+ *
+ ************************/
+void putByte(IODev_T io, uint32_t value)
+{
+        assert(value <= 255);
+        io->outBuf[io->outLength++] = (unsigned char)value;
+        if (io->outLength == IO_BUFSIZE || 
+            (value == '\n' && (io->policy & FLUSH_NEWLINE))) {
+                flushOutput(io);
+        }
+}
+
+/********** getByte ********
+ * 
+ * Reads one byte of input, refilling the input buffer with a single
+ * read when it is empty
+ *
+ * Parameters:
+ *     IODev_T io: I/O device
+ *
+ * Return: Byte read, or a word of all ones at end of input
+ *
+ * Notes
+ *      A read from a terminal returns as soon as a line is available,
+ *      so interactive programs never wait for a full buffer
+ *
+ ************************/
+uint32_t getByte(IODev_T io)
+{
+        if (io->inPos == io->inLength) {
+                if (io->policy & FLUSH_INPUT) {
+                        flushOutput(io);
+                }
+                if (io->inEOF) {
+                        return ~(uint32_t)0;
+                }
+
+                ssize_t numRead;
+                do {
+                        numRead = read(io->inFd, io->inBuf, IO_BUFSIZE);
+                } while (numRead < 0 && errno == EINTR);
+
+                if (numRead <= 0) {
+                        io->inEOF = true;
+                        return ~(uint32_t)0;
+                }
+                io->inPos = 0;
+                io->inLength = numRead;
+        }
+        return io->inBuf[io->inPos++];
+}
+
+/********** unreadInput ********
+ * 
+ * Finds the input already read from the input descriptor that IN has
+ * not yet consumed
+ *
+ * Parameters:
+ *     IODev_T io: I/O device
+ *     const unsigned char **bytes: Set to the first unread byte
+ *
+ * Return: Number of unread bytes, at most IO_BUFSIZE
+ *
+ ************************/
+size_t unreadInput(IODev_T io, const unsigned char **bytes)
+{
+        *bytes = io->inBuf + io->inPos;
+        return io->inLength - io->inPos;
+}
+
+/********** pushInput ********
+ * 
+ * Makes bytes the next input IN reads, before anything from the input
+ * descriptor
+ *
+ * Parameters:
+ *     IODev_T io: I/O device, with no input buffered
+ *     const unsigned char *bytes: Input to buffer
+ *     size_t length: Number of bytes
+ *
+ * Return: None
+ *
+ * Expects
+ *      length <= IO_BUFSIZE
+ *
+ ************************/
+void pushInput(IODev_T io, const unsigned char *bytes, size_t length)
+{
+        assert(length <= IO_BUFSIZE && io->inPos == io->inLength);
+        memcpy(io->inBuf, bytes, length);
+        io->inPos = 0;
+        io->inLength = length;
+}
+
+/********** flushOutput ********
+ * 
+ * Writes all buffered output to the output descriptor
+ *
+ * Parameters:
+ *     IODev_T io: I/O device
+ *
+ * Return: None
+ *
+ * Notes
+ *      Exits with EXIT_FAILURE if the output cannot be written
+ *
+ ************************/
+void flushOutput(IODev_T io)
+{
+        size_t written = 0;
+        while (written < io->outLength) {
+                ssize_t n = write(io->outFd, io->outBuf + written, 
+                                  io->outLength - written);
+                if (n < 0 && errno == EINTR) {
+                        continue;
+                }
+                if (n < 0) {
+                        perror("um: write");
+                        exit(EXIT_FAILURE);
+                }
+                written += n;
+        }
+        io->outLength = 0;
+}
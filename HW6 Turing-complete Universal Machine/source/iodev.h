@@ -0,0 +1,78 @@
+/*
+ *     filename: iodev.h
+ *     partner 1 name: Jack Burton       Login: jburto05
+ *     partner 2 name: James Hartley        Login: jhartl01
+ *     date: April 8th, 2024
+ *     assignment: hw6
+ *
+ *     summary: Defines a buffered I/O device for the universal machine
+ *     
+*/
+
+#ifndef IODEV_INCLUDED
+#define IODEV_INCLUDED
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define IO_BUFSIZE 65536
+
+/* FlushPolicy
+ * Usage: Bits saying when buffered output is written out, besides when
+ * the buffer is full and when the machine halts (which always flush)
+ *
+ * Members:
+ * 	FLUSH_FULL: No extra flushes
+ * 	FLUSH_NEWLINE: Flush after every newline written
+ * 	FLUSH_INPUT: Flush before IN waits for more input, so prompts
+ * 		appear before the machine blocks
+ *
+*/
+typedef enum FlushPolicy {
+        FLUSH_FULL = 0,
+        FLUSH_NEWLINE = 1 << 0,
+        FLUSH_INPUT = 1 << 1
+} FlushPolicy;
+
+/* IODev_T
+ * Usage: The universal machine's I/O device, reading and writing bytes
+ * through its own buffers with one system call per buffer
+ *
+ * Members:
+ * 	int inFd, outFd: File descriptors for input and output
+ * 	int policy: FlushPolicy bits
+ * 	unsigned char inBuf[]: Bytes read but not yet consumed by IN
+ * 	size_t inPos, inLength: Next byte and number of bytes in inBuf
+ * 	bool inEOF: Input is exhausted
+ * 	unsigned char outBuf[]: Bytes written by OUT but not yet flushed
+ * 	size_t outLength: Number of bytes in outBuf
+ *
+ * An IODev_T object is typedefed to be a pointer to an IODev_T struct.
+*/
+typedef struct IODev_T {
+        int inFd;
+        int outFd;
+        int policy;
+        unsigned char inBuf[IO_BUFSIZE];
+        size_t inPos;
+        size_t inLength;
+        bool inEOF;
+        unsigned char outBuf[IO_BUFSIZE];
+        size_t outLength;
+} *IODev_T;
+
+IODev_T initIODev(int inFd, int outFd, int policy);
+void freeIODev(IODev_T io);
+int defaultFlushPolicy(int inFd, int outFd);
+
+/* Device operations used by IN and OUT */
+void putByte(IODev_T io, uint32_t value);
+uint32_t getByte(IODev_T io);
+void flushOutput(IODev_T io);
+
+/* Input read from inFd but not yet consumed, for snapshots */
+size_t unreadInput(IODev_T io, const unsigned char **bytes);
+void pushInput(IODev_T io, const unsigned char *bytes, size_t length);
+
+#endif
@@ -0,0 +1,728 @@
+/*
+ *     filename: jit.c
+ *     partner 1 name: Jack Burton       Login: jburto05
+ *     partner 2 name: James Hartley        Login: jhartl01
+ *     date: April 8th, 2024
+ *     assignment: hw6
+ *
+ *     summary: Implements an x86-64 just-in-time compiler for hot basic
+ *     blocks of segment 0. Cold code, and every instruction a block
+ *     cannot run natively, goes through stepInstruction.
+ *     
+*/
+
+#define _DEFAULT_SOURCE
+
+#include <stddef.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "jit.h"
+
+#if defined(__x86_64__)
+#define JIT_SUPPORTED 1
+#endif
+
+/* Bytes of code memory; the cache is flushed when it fills. It is never
+ * writable and executable at once: compileBlock makes the pages it emits
+ * into writable, and executable again before any block runs. */
+#define JIT_CODE_SIZE (16 << 20)
+
+/* Executions of an offset before a block starting there is compiled */
+#define JIT_HOT 32
+
+/* hits value for offsets where compiling has already been tried */
+#define JIT_TRIED 255
+
+/* Most UM instructions in one block, and most bytes one can take (SSTORE,
+ * the longest, is 73 with REX prefixes); compileBlock checks both */
+#define JIT_MAX_BLOCK 256
+#define JIT_MAX_INSN_BYTES 80
+#define JIT_MAX_BLOCK_BYTES (JIT_MAX_BLOCK * JIT_MAX_INSN_BYTES + 128)
+
+/* A compiled block: runs natively from its start offset, chaining into
+ * other compiled blocks through entry, and returns the offset of the next
+ * instruction for the driver to execute */
+typedef uint32_t (*JitBlock)(uint32_t *reg, Segment *seg, 
+                             uint8_t *const *entry, const uint8_t *covered);
+
+/* Jit_T
+ * Usage: Compiled code for the program in segment 0
+ *
+ * Members:
+ * 	uint8_t *code: Buffer the blocks are emitted into, read and execute
+ * 		only except while compileBlock writes to it
+ * 	size_t used: Bytes of code in use
+ * 	Segment program: Segment the tables describe; when segment 0 is
+ * 		replaced (by LOADP or a copy on write) they are reset
+ * 	uint32_t length: Number of words in program
+ * 	uint8_t **entry: Per offset, the block starting there, or NULL
+ * 	uint8_t *hits: Per offset, executions counted towards JIT_HOT
+ * 	uint8_t *covered: Per offset, whether any block contains the
+ * 		instruction, so a store there must go through the driver
+ * 		and drop the blocks of its page
+ * 	uint64_t blocks, flushes, pages: Counters for --stats
+ *
+*/
+struct Jit_T {
+        uint8_t *code;
+        size_t used;
+        Segment program;
+        uint32_t length;
+        uint8_t **entry;
+        uint8_t *hits;
+        uint8_t *covered;
+        uint64_t blocks;
+        uint64_t flushes;
+        uint64_t pages;
+};
+
+/********** initJit ********
+ * 
+ * Creates an empty JIT with a code buffer that can be executed but not
+ * written
+ *
+ * Parameters: None
+ *
+ * Return: pointer to initialized Jit_T struct, or NULL if the host cannot
+ *         run generated code (not x86-64, or no executable mapping)
+ *
+ ************************/
+Jit_T initJit(void)
+{
+#ifdef JIT_SUPPORTED
+        void *code = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_EXEC,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (code == MAP_FAILED) {
+                return NULL;
+        }
+
+        Jit_T jit = calloc(1, sizeof(*jit));
+        assert(jit != NULL);
+        jit->code = code;
+        return jit;
+#else
+        return NULL;
+#endif
+}
+
+/********** freeJit ********
+ * 
+ * Frees the code buffer and tables of a JIT
+ *
+ * Parameters:
+ *     Jit_T jit: JIT to free, or NULL
+ *
+ * Return: None
+ *
+ ************************/
+void freeJit(Jit_T jit)
+{
+        if (jit == NULL) {
+                return;
+        }
+        munmap(jit->code, JIT_CODE_SIZE);
+        free(jit->entry);
+        free(jit->hits);
+        free(jit->covered);
+        free(jit);
+}
+
+/********** printJitStats ********
+ * 
+ * Prints how many blocks were compiled, how often the cache was thrown
+ * away and how many code pages were rebuilt after stores
+ *
+ * Parameters:
+ *     Jit_T jit: JIT to report on
+ *     FILE *fp: Stream to print to
+ *
+ * Return: None
+ *
+ ************************/
+void printJitStats(Jit_T jit, FILE *fp)
+{
+        fprintf(fp, "jit blocks compiled: %llu\n", 
+                (unsigned long long)jit->blocks);
+        fprintf(fp, "jit cache flushes:   %llu\n", 
+                (unsigned long long)jit->flushes);
+        fprintf(fp, "jit pages rebuilt:   %llu\n", 
+                (unsigned long long)jit->pages);
+}
+
+/********** flushJit ********
+ * 
+ * Throws away all compiled code, keeping the tables' size
+ *
+ * Parameters:
+ *     Jit_T jit: JIT to flush
+ *
+ * Return: None
+ *
+ ************************/
+static void flushJit(Jit_T jit)
+{
+        jit->used = 0;
+        memset(jit->entry, 0, jit->length * sizeof(*jit->entry));
+        memset(jit->hits, 0, jit->length);
+        memset(jit->covered, 0, jit->length);
+        jit->flushes++;
+}
+
+/********** dropPage ********
+ * 
+ * Unlinks every block containing an instruction of a code page that has
+ * been stored to, so each is compiled again once it is hot
+ *
+ * Parameters:
+ *     Jit_T jit: JIT for segment 0
+ *     uint32_t page: Dirty code page of segment 0
+ *
+ * Return: None
+ *
+ * Notes
+ *      A block is at most JIT_MAX_BLOCK instructions, so only those
+ *      starting up to that far before the page can reach it. Their code
+ *      stays in the buffer, unreachable, until the next flush. covered
+ *      is cleared for the page only; words before it may stay marked for
+ *      blocks already dropped, which costs at most a needless exit.
+ ************************/
+static void dropPage(Jit_T jit, uint32_t page)
+{
+        uint32_t start = page << CODE_PAGE_SHIFT;
+        uint32_t end = start + CODE_PAGE_WORDS;
+        if (start >= jit->length) {
+                return;
+        }
+        if (end > jit->length) {
+                end = jit->length;
+        }
+        uint32_t first = 0;
+        if (start > JIT_MAX_BLOCK - 1) {
+                first = start - (JIT_MAX_BLOCK - 1);
+        }
+        for (uint32_t offset = first; offset < end; offset++) {
+                if (jit->entry[offset] != NULL) {
+                        jit->entry[offset] = NULL;
+                        jit->hits[offset] = 0;
+                }
+        }
+        memset(jit->covered + start, 0, end - start);
+        jit->pages++;
+}
+
+/********** resetJit ********
+ * 
+ * Throws away all compiled code and sizes the tables for a new program
+ *
+ * Parameters:
+ *     Jit_T jit: JIT to reset
+ *     Segment program: Segment now mapped at address 0
+ *
+ * Return: None
+ *
+ ************************/
+static void resetJit(Jit_T jit, Segment program)
+{
+        free(jit->entry);
+        free(jit->hits);
+        free(jit->covered);
+        jit->program = program;
+        jit->length = program->length;
+        trackCodePages(program);
+        jit->entry = calloc((size_t)jit->length + 1, sizeof(*jit->entry));
+        jit->hits = calloc((size_t)jit->length + 1, 1);
+        jit->covered = calloc((size_t)jit->length + 1, 1);
+        assert(jit->entry != NULL && jit->hits != NULL && 
+               jit->covered != NULL);
+        jit->used = 0;
+}
+
+/* 
+ * x86-64 code generation. UM register i lives in host register r8d + i
+ * while compiled code runs. rdi holds the register file, rsi the segment
+ * table, rbx the entry table and rbp the covered table; eax, ecx and edx
+ * are scratch.
+ */
+enum { RAX = 0, RCX = 1, RDX = 2, RBX = 3, RBP = 5, RSI = 6, RDI = 7, 
+       R8 = 8 };
+
+/* Bytes emitPrologue emits; chained jumps land this far past an entry */
+#define JIT_PROLOGUE_BYTES 48
+#define HOST(umReg) (R8 + (umReg))
+
+/* Opcodes for emitRR; two-byte opcodes carry their 0x0F prefix */
+enum {
+        OP_MOV = 0x89,          /* mov r/m32, r32 */
+        OP_ADD = 0x03,          /* add r32, r/m32 */
+        OP_AND = 0x23,          /* and r32, r/m32 */
+        OP_XOR = 0x33,          /* xor r32, r/m32 */
+        OP_TEST = 0x85,         /* test r/m32, r32 */
+        OP_GROUP3 = 0xF7,       /* not (/2) or div (/6) r/m32 */
+        OP_IMUL = 0x0FAF,       /* imul r32, r/m32 */
+        OP_CMOVNE = 0x0F45      /* cmovne r32, r/m32 */
+};
+
+static void emit8(Jit_T jit, uint8_t byte)
+{
+        jit->code[jit->used++] = byte;
+}
+
+static void emit32(Jit_T jit, uint32_t word)
+{
+        for (int i = 0; i < 4; i++) {
+                emit8(jit, (word >> (8 * i)) & 0xFF);
+        }
+}
+
+/********** emitRR ********
+ * 
+ * Emits a register-to-register instruction, with a REX prefix when
+ * either register is r8-r15
+ *
+ * Parameters:
+ *     Jit_T jit: JIT to emit into
+ *     int opcode: One of the OP_ values above
+ *     int reg: Register (or opcode extension) in the ModRM reg field
+ *     int rm: Register in the ModRM r/m field
+ *
+ * Return: None
+ *
+ ************************/
+static void emitRR(Jit_T jit, int opcode, int reg, int rm)
+{
+        uint8_t rex = 0x40 | ((reg & 8) ? 0x4 : 0) | ((rm & 8) ? 0x1 : 0);
+        if (rex != 0x40) {
+                emit8(jit, rex);
+        }
+        if (opcode > 0xFF) {
+                emit8(jit, opcode >> 8);
+        }
+        emit8(jit, opcode & 0xFF);
+        emit8(jit, 0xC0 | (reg & 7) << 3 | (rm & 7));
+}
+
+/* mov reg, imm32 */
+static void emitMovImm(Jit_T jit, int reg, uint32_t imm)
+{
+        if (reg & 8) {
+                emit8(jit, 0x41);
+        }
+        emit8(jit, 0xB8 + (reg & 7));
+        emit32(jit, imm);
+}
+
+/* jmp rel32 to an address already emitted */
+static void emitJmp(Jit_T jit, uint8_t *target)
+{
+        emit8(jit, 0xE9);
+        emit32(jit, (uint32_t)(target - (jit->code + jit->used + 4)));
+}
+
+/* Jump over the exit sequence emitted by emitExit if the condition code
+ * holds; cc is the low nibble of the jcc opcode */
+enum { CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5 };
+#define EXIT_BYTES 10
+static void emitSkipExit(Jit_T jit, int cc)
+{
+        emit8(jit, 0x70 | cc);
+        emit8(jit, EXIT_BYTES);
+}
+
+/* Continue at offset through exit, which is either the block's epilogue
+ * (return to the driver) or its dispatch stub (chain to another block) */
+static void emitExit(Jit_T jit, uint8_t *exit, uint32_t offset)
+{
+        emitMovImm(jit, RAX, offset);
+        emitJmp(jit, exit);
+}
+
+/* rax = seg[umReg], the Segment a register addresses */
+static void emitLoadSegment(Jit_T jit, int umReg)
+{
+        emitRR(jit, OP_MOV, HOST(umReg), RAX);
+        /* mov rax, [rsi + rax*8] */
+        emit8(jit, 0x48); emit8(jit, 0x8B); emit8(jit, 0x04); emit8(jit, 0xC6);
+}
+
+/* Saves the UM registers back to the register file and returns */
+static void emitEpilogue(Jit_T jit)
+{
+        for (int i = 0; i < 8; i++) {
+                /* mov [rdi + 4i], r(8+i)d */
+                emit8(jit, 0x44); emit8(jit, 0x89);
+                emit8(jit, 0x40 | i << 3 | RDI); emit8(jit, 4 * i);
+        }
+        for (int i = 7; i >= 4; i--) {
+                emit8(jit, 0x41); emit8(jit, 0x58 + i);         /* pop */
+        }
+        emit8(jit, 0x58 + RBP); emit8(jit, 0x58 + RBX);
+        emit8(jit, 0xC3);                                       /* ret */
+}
+
+/********** emitDispatch ********
+ * 
+ * Emits the stub that continues at the offset in eax: in the body of the
+ * block compiled there if there is one, else back in the driver
+ *
+ * Parameters:
+ *     Jit_T jit: JIT to emit into
+ *     uint8_t *epilogue: The block's epilogue
+ *
+ * Return: None
+ *
+ * Notes
+ *      Every block's prologue is the same, so skipping JIT_PROLOGUE_BYTES
+ *      of another block's entry leaves the host registers exactly as
+ *      that block expects them, and its epilogue undoes this prologue.
+ ************************/
+static void emitDispatch(Jit_T jit, uint8_t *epilogue)
+{
+        emit8(jit, 0x3D); emit32(jit, jit->length);     /* cmp eax, len */
+        emit8(jit, 0x0F); emit8(jit, 0x80 | CC_AE);     /* jae epilogue */
+        emit32(jit, (uint32_t)(epilogue - (jit->code + jit->used + 4)));
+        /* mov rdx, [rbx + rax*8]; test rdx, rdx */
+        emit8(jit, 0x48); emit8(jit, 0x8B); emit8(jit, 0x14); emit8(jit, 0xC3);
+        emit8(jit, 0x48); emit8(jit, 0x85); emit8(jit, 0xD2);
+        emit8(jit, 0x0F); emit8(jit, 0x80 | CC_E);      /* je epilogue */
+        emit32(jit, (uint32_t)(epilogue - (jit->code + jit->used + 4)));
+        /* add rdx, JIT_PROLOGUE_BYTES; jmp rdx */
+        emit8(jit, 0x48); emit8(jit, 0x83); emit8(jit, 0xC2);
+        emit8(jit, JIT_PROLOGUE_BYTES);
+        emit8(jit, 0xFF); emit8(jit, 0xE2);
+}
+
+/* Saves the callee-saved registers used and loads the UM registers */
+static void emitPrologue(Jit_T jit)
+{
+        emit8(jit, 0x50 + RBX); emit8(jit, 0x50 + RBP);         /* push */
+        for (int i = 4; i <= 7; i++) {
+                emit8(jit, 0x41); emit8(jit, 0x50 + i);
+        }
+        /* mov rbx, rdx; mov rbp, rcx */
+        emit8(jit, 0x48); emit8(jit, 0x89); emit8(jit, 0xD3);
+        emit8(jit, 0x48); emit8(jit, 0x89); emit8(jit, 0xCD);
+        for (int i = 0; i < 8; i++) {
+                /* mov r(8+i)d, [rdi + 4i] */
+                emit8(jit, 0x44); emit8(jit, 0x8B);
+                emit8(jit, 0x40 | i << 3 | RDI); emit8(jit, 4 * i);
+        }
+}
+
+/********** emitInstruction ********
+ * 
+ * Emits native code for one instruction of a block
+ *
+ * Parameters:
+ *     Jit_T jit: JIT to emit into
+ *     Decoded ins: The instruction
+ *     uint32_t offset: Its offset in segment 0
+ *     uint8_t *epilogue: Where exits back to the driver jump to
+ *     uint8_t *dispatch: Where jumps that may chain to a block go
+ *     uint32_t start, uint8_t *body: Offset and native address of the
+ *                                    block's first instruction
+ *
+ * Return: true if the instruction ends the block (LOADP), false if
+ *         execution continues with the next one
+ *
+ * Expects
+ *      ins is one of the instructions canCompile accepts
+ * Notes
+ *      SSTORE exits to the driver before storing into a word of segment
+ *      0 that a block covers, into a segment shared by LOADP or into one
+ *      with decoded records; LOADP exits before loading a segment other
+ *      than 0. The driver then runs the instruction with stepInstruction.
+ ************************/
+static bool emitInstruction(Jit_T jit, Decoded ins, uint32_t offset, 
+                            uint8_t *epilogue, uint8_t *dispatch, 
+                            uint32_t start, uint8_t *body)
+{
+        int a = HOST(ins.a), b = HOST(ins.b), c = HOST(ins.c);
+        uint8_t *skip;
+
+        switch (ins.op) {
+                case D_CMOV:
+                        emitRR(jit, OP_TEST, c, c);
+                        emitRR(jit, OP_CMOVNE, a, b);
+                        break;
+                case D_ADD:
+                        emitRR(jit, OP_MOV, b, RAX);
+                        emitRR(jit, OP_ADD, RAX, c);
+                        emitRR(jit, OP_MOV, RAX, a);
+                        break;
+                case D_MUL:
+                        emitRR(jit, OP_MOV, b, RAX);
+                        emitRR(jit, OP_IMUL, RAX, c);
+                        emitRR(jit, OP_MOV, RAX, a);
+                        break;
+                case D_DIV:
+                        emitRR(jit, OP_MOV, b, RAX);
+                        emitRR(jit, OP_XOR, RDX, RDX);
+                        emitRR(jit, OP_GROUP3, 6, c);
+                        emitRR(jit, OP_MOV, RAX, a);
+                        break;
+                case D_NAND:
+                        emitRR(jit, OP_MOV, b, RAX);
+                        emitRR(jit, OP_AND, RAX, c);
+                        emitRR(jit, OP_GROUP3, 2, RAX);
+                        emitRR(jit, OP_MOV, RAX, a);
+                        break;
+                case D_LOADV:
+                        emitMovImm(jit, a, ins.value);
+                        break;
+                case D_SLOAD:
+                        emitLoadSegment(jit, ins.b);
+                        emitRR(jit, OP_MOV, c, RCX);
+                        /* mov eax, [rax + rcx*4 + words] */
+                        emit8(jit, 0x8B); emit8(jit, 0x44); emit8(jit, 0x88);
+                        emit8(jit, offsetof(struct Segment, words));
+                        emitRR(jit, OP_MOV, RAX, a);
+                        break;
+                case D_SSTORE:
+                        /* Into segment 0: exit if a block covers the word */
+                        emitRR(jit, OP_TEST, a, a);
+                        emit8(jit, 0x70 | CC_NE);
+                        emit8(jit, 0);
+                        skip = jit->code + jit->used;
+                        emitRR(jit, OP_MOV, b, RCX);
+                        /* cmp byte [rbp + rcx], 0 */
+                        emit8(jit, 0x80); emit8(jit, 0x7C); emit8(jit, 0x0D);
+                        emit8(jit, 0); emit8(jit, 0);
+                        emitSkipExit(jit, CC_E);
+                        emitExit(jit, epilogue, offset);
+                        skip[-1] = jit->code + jit->used - skip;
+                        emitLoadSegment(jit, ins.a);
+                        /* cmp dword [rax + refs], 1 */
+                        emit8(jit, 0x83); emit8(jit, 0x78);
+                        emit8(jit, offsetof(struct Segment, refs)); 
+                        emit8(jit, 1);
+                        emitSkipExit(jit, CC_E);
+                        emitExit(jit, epilogue, offset);
+                        /* cmp qword [rax + decoded], 0 */
+                        emit8(jit, 0x48); emit8(jit, 0x83); emit8(jit, 0x78);
+                        emit8(jit, offsetof(struct Segment, decoded));
+                        emit8(jit, 0);
+                        emitSkipExit(jit, CC_E);
+                        emitExit(jit, epilogue, offset);
+                        emitRR(jit, OP_MOV, b, RCX);
+                        /* mov [rax + rcx*4 + words], c */
+                        if (c & 8) {
+                                emit8(jit, 0x44);
+                        }
+                        emit8(jit, 0x89); emit8(jit, 0x44 | (c & 7) << 3);
+                        emit8(jit, 0x88);
+                        emit8(jit, offsetof(struct Segment, words));
+                        break;
+                case D_LOADP:
+                        emitRR(jit, OP_TEST, b, b);
+                        emitSkipExit(jit, CC_E);
+                        emitExit(jit, epilogue, offset);
+                        /* A jump back to the block's start stays native:
+                         * cmp c, start; je body */
+                        emit8(jit, 0x41); emit8(jit, 0x81);
+                        emit8(jit, 0xF8 | (c & 7)); emit32(jit, start);
+                        emit8(jit, 0x0F); emit8(jit, 0x80 | CC_E);
+                        emit32(jit, (uint32_t)(body - 
+                                               (jit->code + jit->used + 4)));
+                        emitRR(jit, OP_MOV, c, RAX);
+                        emitJmp(jit, dispatch);
+                        return true;
+                default:
+                        assert(false);
+        }
+        return false;
+}
+
+/********** canCompile ********
+ * 
+ * Says whether a block may contain an instruction
+ *
+ * Parameters:
+ *     Decoded ins: The instruction
+ *
+ * Return: true for instructions with native code, false for those that
+ *         call into the memory or I/O modules (and HALT and invalid
+ *         words), which end a block
+ *
+ ************************/
+static bool canCompile(Decoded ins)
+{
+        switch (ins.op) {
+                case D_CMOV: case D_SLOAD: case D_SSTORE: case D_ADD:
+                case D_MUL: case D_DIV: case D_NAND: case D_LOADP:
+                case D_LOADV:
+                        return true;
+                default:
+                        return false;
+        }
+}
+
+/********** protectCode ********
+ * 
+ * Sets the protection of the pages of the code buffer that a block
+ * emitted at an offset could cover
+ *
+ * Parameters:
+ *     Jit_T jit: JIT whose code buffer to protect
+ *     size_t from: Offset in the buffer the block starts at
+ *     int prot: PROT_READ | PROT_WRITE before emitting, or
+ *               PROT_READ | PROT_EXEC after
+ *
+ * Return: true, or false if mprotect failed
+ *
+ ************************/
+static bool protectCode(Jit_T jit, size_t from, int prot)
+{
+        size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        size_t start = from & ~(page - 1);
+        size_t end = from + JIT_MAX_BLOCK_BYTES;
+        end = end > JIT_CODE_SIZE ? JIT_CODE_SIZE 
+                                  : (end + page - 1) & ~(page - 1);
+        return mprotect(jit->code + start, end - start, prot) == 0;
+}
+
+/********** compileBlock ********
+ * 
+ * Compiles the basic block starting at an offset of segment 0
+ *
+ * Parameters:
+ *     Jit_T jit: JIT whose program is segment 0
+ *     uint32_t start: Offset of the block's first instruction
+ *
+ * Return: true if a block now starts at start, false if the instruction
+ *         there cannot be compiled or the code buffer cannot be
+ *         reprotected
+ *
+ * Notes
+ *      Blocks end after a LOADP, before an instruction canCompile rejects,
+ *      after JIT_MAX_BLOCK instructions, or early if the next might not
+ *      fit in the JIT_MAX_BLOCK_BYTES made writable. The code is laid out as
+ *      epilogue, dispatch stub, prologue (the entry point) and body, so
+ *      every exit jumps backwards to an address already known.
+ *      The pages written are made executable again before returning; if
+ *      that fails the cache is flushed, so no block is left to run from
+ *      writable pages.
+ ************************/
+static bool compileBlock(Jit_T jit, uint32_t start)
+{
+        uint32_t *words = jit->program->words;
+        if (!canCompile(decodeWord(words[start]))) {
+                return false;
+        }
+        if (JIT_CODE_SIZE - jit->used < JIT_MAX_BLOCK_BYTES) {
+                flushJit(jit);
+        }
+        size_t first = jit->used;
+        if (!protectCode(jit, first, PROT_READ | PROT_WRITE)) {
+                return false;
+        }
+
+        uint8_t *epilogue = jit->code + jit->used;
+        emitEpilogue(jit);
+        uint8_t *dispatch = jit->code + jit->used;
+        emitDispatch(jit, epilogue);
+        uint8_t *entry = jit->code + jit->used;
+        emitPrologue(jit);
+        uint8_t *body = jit->code + jit->used;
+        assert(body - entry == JIT_PROLOGUE_BYTES);
+
+        uint32_t offset = start;
+        bool ended = false;
+        while (!ended && offset < jit->length && 
+               offset - start < JIT_MAX_BLOCK) {
+                Decoded ins = decodeWord(words[offset]);
+                size_t before = jit->used;
+                if (!canCompile(ins) || 
+                    before - first + JIT_MAX_INSN_BYTES + EXIT_BYTES > 
+                    JIT_MAX_BLOCK_BYTES) {
+                        break;
+                }
+                ended = emitInstruction(jit, ins, offset, epilogue, 
+                                        dispatch, start, body);
+                assert(jit->used - before <= JIT_MAX_INSN_BYTES);
+                jit->covered[offset] = true;
+                offset++;
+        }
+        if (!ended) {
+                emitExit(jit, offset - start < JIT_MAX_BLOCK ? epilogue 
+                                                             : dispatch, 
+                         offset);
+        }
+
+        if (!protectCode(jit, first, PROT_READ | PROT_EXEC)) {
+                flushJit(jit);
+                return false;
+        }
+        jit->entry[start] = entry;
+        jit->blocks++;
+        return true;
+}
+
+/********** jitExecInstructions ********
+ * 
+ * Runs the machine like execInstructions, compiling each block of segment
+ * 0 to native code once it has run JIT_HOT times
+ *
+ * Parameters:
+ *     Jit_T jit: JIT from initJit, or NULL to just interpret
+ *     Mem_T mem: Pointer to memory struct
+ *     IODev_T io: I/O device used by IN and OUT
+ *
+ * Return: RUN_HALTED, or RUN_NOMEM if a MAP found no memory
+ *
+ * Notes
+ *      A store into a word of segment 0 that some block contains marks
+ *      its code page dirty, and the blocks over that page are dropped
+ *      before anything else runs; replacing segment 0 resets the JIT for
+ *      the new program. Both happen in stepInstruction, since blocks
+ *      exit rather than do either.
+ ************************/
+Run_status jitExecInstructions(Jit_T jit, Mem_T mem, IODev_T io)
+{
+        if (jit == NULL) {
+                return execInstructions(mem, io, NULL);
+        }
+
+        Run_status status = RUN_HALTED;
+        uint32_t offset = mem->counter->offset;
+        for (;;) {
+                Segment program = mem->seg[0];
+                if (program != jit->program) {
+                        resetJit(jit, program);
+                }
+
+                uint8_t *entry = jit->entry[offset];
+                if (entry != NULL) {
+                        JitBlock block;
+                        memcpy(&block, &entry, sizeof(block));
+                        uint32_t next = block(mem->reg, mem->seg, 
+                                              jit->entry, jit->covered);
+                        if (next != offset) {
+                                offset = next;
+                                continue;
+                        }
+                        /* The first instruction exited; step it here */
+                } else if (jit->hits[offset] < JIT_TRIED && 
+                           ++jit->hits[offset] == JIT_HOT) {
+                        jit->hits[offset] = JIT_TRIED;
+                        if (compileBlock(jit, offset)) {
+                                continue;
+                        }
+                }
+                /* Note a store that might hit compiled code */
+                uint32_t word = program->words[offset];
+                bool storesCode = (word >> 28) == SSTORE && 
+                                  mem->reg[(word >> 6) & 0x7] == 0;
+
+                if (!stepInstruction(mem, io, &offset)) {
+                        status = stopStatus(mem, offset);
+                        break;
+                }
+                uint32_t page;
+                while (storesCode && mem->seg[0] == jit->program && 
+                       nextDirtyPage(program, &page)) {
+                        dropPage(jit, page);
+                }
+        }
+        shiftProgCounter(mem->counter, 0, offset);
+        return status;
+}
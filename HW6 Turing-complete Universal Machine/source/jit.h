@@ -0,0 +1,25 @@
+/*
+ *     filename: jit.h
+ *     partner 1 name: Jack Burton       Login: jburto05
+ *     partner 2 name: James Hartley        Login: jhartl01
+ *     date: April 8th, 2024
+ *     assignment: hw6
+ *
+ *     summary: Defines an x86-64 just-in-time compiler for hot basic
+ *     blocks of segment 0
+ *     
+*/
+
+#ifndef JIT_INCLUDED
+#define JIT_INCLUDED
+
+#include "memexec.h"
+
+typedef struct Jit_T *Jit_T;
+
+Jit_T initJit(void);
+void freeJit(Jit_T jit);
+Run_status jitExecInstructions(Jit_T jit, Mem_T mem, IODev_T io);
+void printJitStats(Jit_T jit, FILE *fp);
+
+#endif
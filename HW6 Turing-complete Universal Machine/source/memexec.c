@@ -1,408 +1,727 @@
-/*
- *     filename: memexec.c
- *     partner 1 name: Jack Burton       Login: jburto05
- *     partner 2 name: James Hartley        Login: jhartl01
- *     date: April 8th, 2024
- *     assignment: hw6
- *
- *     summary: Implements functions for executing instructions from memory
- *     
-*/
-
-#include "memexec.h"
-
-const int BIT = 1;
-
-/********** execInstructions ********
- * 
- * Read through segment zero, executing each instruction
- * and iterating program counter
- *
- * Parameters:
- *     Mem_T Memory: Pointer to memory struct      		
- *
- * Return: None
- *
- * Expects
- * 	 Non-NULL pointer to initialized memory struct
- * 
- ************************/
-void execInstructions(Mem_T mem)
-{
-        assert(mem != NULL);
-
-        
-        uint32_t address = 0;
-        int offset = 0;
-        int isRunning = true;
-        while (isRunning  == true)
-        {
-                uint32_t encodedWord = getMem(mem, address, offset);
-                Um_opcode code = Bitpack_getu(encodedWord, 4*BIT, 28);
-
-                int currOffset = mem->counter->offset;
-                isRunning = handleCase(mem, encodedWord, code);
-                offset = mem->counter->offset;
-                if (offset == currOffset) {
-                        offset++;
-                }
-                address = mem->counter->address;
-
-                shiftProgCounter(mem->counter, address, offset);
-        }
-         
-        
-
-        return;
-}
-
-/********** handleCase ********
- * 
- * Executes appropriate instruction based on op code
- *
- * Parameters:
- *     Mem_T mem: Pointer to current um memory
- *     uint32_t encodedWord: Bitpacked instruction word
- *     Um_opcode code: opcode from instruction word  		
- *
- * Return: int indicating SUCCESS (0) or FAILURE (1)
- *
- * Expects
- * 	 Valid opcode 0-13, valid instruction word
- * Notes
- *	Undefined behavior if:
- *              Word does not code for a valid instruction
- *              Segmented load or store refers to unmapped segment
- *              Segment unmap called on $m[0] or an already unmapped segment 
- *              Dividing by zero
- *              Instruction loads program from unmapped segment
- *              Instruction outputs value > 255
- ************************/
-int handleCase(Mem_T mem, uint32_t encodedWord, Um_opcode code) {
-        if (code == LOADV) {
-                int A = Bitpack_getu(encodedWord, 3*BIT, 25);
-                int value = Bitpack_getu(encodedWord, 25*BIT, 0);
-                loadV(mem, A, value);
-        }
-        else {
-                /* Getting 3 registers */
-                int C = Bitpack_getu(encodedWord, 3*BIT, 0);
-                int B = Bitpack_getu(encodedWord, 3*BIT, 3);
-                int A = Bitpack_getu(encodedWord, 3*BIT, 6);
-
-                switch(code) {
-                        
-                        case OUT:
-                                output(mem, C);
-                                break;
-                        case IN:
-                                input(mem, C);
-                                break;
-                        case UNMAP:
-                                unmapSegment(mem, C);
-                                break;
-                        case MAP:
-                                mapSegment(mem, B, C);
-                                break;
-                        case LOADP:
-                                loadp(mem, B, C);
-                                break;
-                        case CMOV:
-                                condMove(mem, A, B, C);
-                                break;
-                        case SLOAD:
-                                segLoad(mem, A, B, C);
-                                break;
-                        case SSTORE:
-                                segStore(mem, A, B, C);
-                                break;
-                        case ADD:
-                                add(mem, A, B, C);
-                                break;
-                        case MUL:
-                                mult(mem, A, B, C);
-                                break;
-                        case DIV:
-                                divide(mem, A, B, C);
-                                break;
-                        case NAND:
-                                nand(mem, A, B, C);
-                                break;
-                        case HALT:
-                                return false;
-                        default:
-                                break;
-                }
-        }
-        return true;
-}
-
-/********** add ********
- * 
- * Adds registers at index B and C, putting their sum mod 32 into register
- * at index A
- *
- * Parameters:
- *      Mem_T Memory: Pointer to memory struct
- *      int A: Register A index
- *      int B: Register B index
- *      int C: Register C index  		
- *
- * Return: None
- *
- ************************/
-void add(Mem_T mem, int A, int B, int C)
-{
-        int sum = (getReg(mem, B) + getReg(mem, C));
-        setReg(mem, sum, A);
-}
-
-/********** mult ********
- * 
- * Multiplies registers at index B and C, putting their product
- * mod 32 into register at index A
- *
- * Parameters:
- *      Mem_T Memory: Pointer to memory struct
- *      int A: Register A index
- *      int B: Register B index
- *      int C: Register C index  		
- *
- * Return: None
- *
- ************************/
-void mult(Mem_T mem, int A, int B, int C)
-{
-        int prod = getReg(mem, B) * getReg(mem, C);
-        setReg(mem, prod, A);
-}
-
-/********** divide ********
- * 
- * Divides registers at index B and C, putting the 
- * result into register at index A
- *
- * Parameters:
- *      Mem_T Memory: Pointer to memory struct
- *      int A: Register A index
- *      int B: Register B index
- *      int C: Register C index  		
- *
- * Return: None
- *
- ************************/
-void divide(Mem_T mem, int A, int B, int C)
-{
-        int prod = getReg(mem, B) / getReg(mem, C);
-        setReg(mem, prod, A);
-}
-
-/********** nand ********
- * 
- * Performs bitwise NAND of values from registers at index B and C,
- * and puts result in register at index A.
- *
- * Parameters:
- *      Mem_T Memory: Pointer to memory struct
- *      int A: Register A index
- *      int B: Register B index
- *      int C: Register C index  		
- *
- * Return: None
- *
- ************************/
-void nand(Mem_T mem, int A, int B, int C)
-{
-        uint32_t result = ~(getReg(mem, B) & getReg(mem, C));
-        setReg(mem, result, A);
-}
-
-/********** condMove ********
- * 
- * If register at index C is nonzero, moves value from index B into
- * register at index A.
- *
- * Parameters:
- *      Mem_T Memory: Pointer to memory struct
- *      int A: Register A index
- *      int B: Register B index
- *      int C: Register C index  		
- *
- * Return: None
- *
- ************************/
-void condMove(Mem_T mem, int A, int B, int C)
-{
-        if (getReg(mem, C) != 0) {
-                setReg(mem, getReg(mem, B), A);
-        }
-}
-
-/********** loadV ********
- * 
- * Loads val into register at index A
- *
- * Parameters:
- *      Mem_T Memory: Pointer to memory struct
- *      int A: Register A index
- *      int val: Value to put in register A
- *            		
- *
- * Return: None
- *
- ************************/
-void loadV(Mem_T mem, int A, int val)
-{
-        setReg(mem, val, A);
-}
-
-
-/********** output ********
- * 
- * Prints value from register at index C to I/O device
- *
- * Parameters:
- *      Mem_T Memory: Pointer to memory struct
- *      int C Register C index		
- *
- * Return: None
- * 
- * Expects
- *       0 <= value <= 255
- *
- ************************/
-void output(Mem_T mem, int C)
-{
-        int value = getReg(mem, C);
-        assert(value >= 0 && value <= 255);
-        printf("%c", value);
-}
-
-/********** input ********
- * 
- * Loads input value into register at index C
- *
- * Parameters:
- *      Mem_T Memory: Pointer to memory struct
- *      int C: Register C index  		
- *
- * Return: None
- * 
- * Expects
- *      0 <= input value <= 255
- *
- ************************/
-void input(Mem_T mem, int C)
-{
-        char value = fgetc(stdin);
-        setReg(mem, value, C);
-}
-
-/********** mapSegment ********
- * 
- * Creates new segment with number of words equal to register at index C,
- * initializes each word to 0, and sets register at index B to new
- * register's address.
- *
- * Parameters:
- *      Mem_T Memory: Pointer to memory struct
- *      int B: Register B index
- *      int C: Register C index  		
- *
- * Return: None
- *
- ************************/
-void mapSegment(Mem_T mem, int B, int C)
-{
-        uint32_t segAddress = mapSeg(mem, getReg(mem, C));
-        setReg(mem, segAddress, B);
-}
-
-/********** unmapSegment ********
- * 
- * Unmaps segment at address from register at index C
- *
- * Parameters:
- *      Mem_T Memory: Pointer to memory struct
- *      int C: Register C index  		
- *
- * Return: None
- * 
- * Expects
- *      Segment 0 never unmapped
- *      C address specifies a currently mapped segment
- * 
- * Notes
- *      Undefined behavior to unmap segment 0,
- *      or to unmap a segment that is not mapped
- *
- ************************/
-void unmapSegment(Mem_T mem, int C)
-{
-        unmapSeg(mem, getReg(mem, C));
-}
-
-/********** segStore ********
- * 
- * Gets value from segment at address from register at index A, offset 
- * from register at index B, and puts this value into
- * register at index C.
- *
- * Parameters:
- *      Mem_T Memory: Pointer to memory struct
- *      int A: Register A index
- *      int B: Register B index
- *      int C: Register C index  		
- *
- * Return: None
- *
- ************************/
-void segStore(Mem_T mem, int A, int B, int C)
-{
-        setMem(mem, getReg(mem, C), getReg(mem, A),  getReg(mem, B));     
-}
-
-/********** segLoad ********
- * 
- * Sets register at index A to value in word at
- * segment with address from register at index B and
- * offset from register at index C.
- *
- * Parameters:
- *      Mem_T Memory: Pointer to memory struct
- *      int A: Register A index
- *      int B: Register B index
- *      int C: Register C index  		
- *
- * Return: None
- *
- ************************/
-void segLoad(Mem_T mem, int A, int B, int C)
-{
-        uint32_t value = getMem(mem, getReg(mem, B), getReg(mem, C));
-        setReg(mem, value, A); 
-}
-
-/********** loadp ********
- * 
- * Duplicates segment at address from value in register at index B,
- * and replaces segment 0 with this. Resets program counter to
- * segment 0 at offset from value in register at index C.
- *
- * Parameters:
- *      Mem_T Memory: Pointer to memory struct
- *      int B: Register B index
- *      int C: Register C index  		
- *
- * Return: None
- *
- ************************/
-void loadp(Mem_T mem, int B, int C)
-{
-        uint32_t address = getReg(mem, B);
-        if (address != 0) {
-                dupeSeg(mem, address);
-        }
-
-        shiftProgCounter(mem->counter, 0, getReg(mem, C));
-}
\ No newline at end of file
+/*
+ *     filename: memexec.c
+ *     partner 1 name: Jack Burton       Login: jburto05
+ *     partner 2 name: James Hartley        Login: jhartl01
+ *     date: April 8th, 2024
+ *     assignment: hw6
+ *
+ *     summary: Implements functions for executing instructions from memory
+ *     
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <time.h>
+#include <stdarg.h>
+#include "memexec.h"
+
+/* Instructions between reads of the clock while a deadline is set */
+#define CLOCK_CHECK_INTERVAL (1u << 24)
+
+/* 
+ * The executor runs from the pre-decoded form of segment 0 (see Decoded
+ * in memory.h), filling it in lazily: a record still DECODE_PENDING is
+ * decoded from its word the first time it is reached, and a store into
+ * a word sets its record back to DECODE_PENDING.
+ *
+ * Decoding also fuses the idioms in fusions[] into superinstructions: the
+ * first record of the sequence gets a handler that runs the whole of it,
+ * reading the operands of the rest from their own (decoded) records. A
+ * store sets back the records of the FUSE_SPAN - 1 words before it too,
+ * so no fused record outlives a change to any word it covers.
+ *
+ * With GCC/Clang the loop is direct threaded: every instruction ends by
+ * jumping straight to the handler of the next one through a table of label
+ * addresses. Elsewhere (or with -DUM_SWITCH_DISPATCH) the same handlers are
+ * compiled as cases of a switch.
+ */
+#if defined(__GNUC__) && !defined(UM_SWITCH_DISPATCH)
+#define UM_THREADED 1
+#endif
+
+/* Fields of the current instruction */
+#define RA (ins->a)
+#define RB (ins->b)
+#define RC (ins->c)
+#define LV_A (ins->a)
+#define LV_VAL (ins->value)
+
+#ifdef UM_THREADED
+#define OP(code) op_##code:
+#define DISPATCH() do {                                 \
+                ins = pc++;                             \
+                goto *dispatch[ins->op];                \
+        } while (0)
+#define REDISPATCH() goto *dispatch[ins->op]
+#define CONTINUE_AS(code) goto op_##code
+#else
+#define OP(code) case code:
+#define DISPATCH() continue
+#define REDISPATCH() goto redispatch
+#define CONTINUE_AS(code) goto redispatch
+#endif
+
+/* Moves on to the next instruction of a superinstruction */
+#define FUSED_NEXT() (ins = pc++)
+
+/*
+ * Checks for the failures the spec leaves undefined. A um-safe build
+ * (-DUM_SAFE) tests each one before the instruction runs and stops the
+ * machine with a fault naming the instruction; otherwise they compile to
+ * nothing, and the failure does whatever the unchecked code does.
+ * Expects io and r (the registers) in scope.
+ */
+#ifdef UM_SAFE
+#define SAFE_CHECK(cond, offset, ...) do {                              \
+                if (!(cond)) {                                          \
+                        fault(io, r, (offset), __VA_ARGS__);            \
+                }                                                       \
+        } while (0)
+#else
+#define SAFE_CHECK(cond, offset, ...) ((void)0)
+#endif
+
+/* Checks that word b of segment a exists, for SLOAD and SSTORE */
+#define SAFE_CHECK_WORD(a, b, offset, what)                             \
+        SAFE_CHECK(isMapped(mem, (a)) && (b) < mem->seg[(a)]->length,   \
+                   (offset), "%s $m[%u][%u], which does not exist",     \
+                   (what), (unsigned)(a), (unsigned)(b))
+
+/* SLOAD */
+#define DO_SLOAD() do {                                                 \
+                SAFE_CHECK_WORD(r[RB], r[RC], ins - code, "load from"); \
+                r[RA] = seg[r[RB]]->words[r[RC]];                       \
+        } while (0)
+
+/* SSTORE, copying a segment shared by LOADP first (and moving pc and code
+ * to the copy when it is segment 0) */
+#define DO_SSTORE() do {                                                \
+                SAFE_CHECK_WORD(r[RA], r[RB], ins - code, "store to");  \
+                Segment target = seg[r[RA]];                            \
+                if (target->refs > 1) {                                 \
+                        target = unshareSeg(mem, r[RA]);                \
+                        if (r[RA] == 0) {                               \
+                                Decoded *copy = decodedProgram(target); \
+                                pc = copy + (pc - code);                \
+                                code = copy;                            \
+                        }                                               \
+                }                                                       \
+                target->words[r[RB]] = r[RC];                           \
+                if (target->dirty != NULL) {                            \
+                        invalidateCode(target, r[RB]);                  \
+                }                                                       \
+        } while (0)
+
+/* Instruction sequences decoded as one superinstruction, longest first.
+ * LOADV+LOADP is goto, ADD+SSTORE push and LOADV+LOADV+NAND a negated or
+ * wide constant in the HW8 assembly; the pairs are the hottest ones
+ * um --profile reports for midmark and sandmark. */
+static const struct {
+        uint8_t length;
+        uint8_t seq[FUSE_SPAN];
+        uint8_t fused;
+} fusions[] = {
+        { 3, { D_LOADV, D_LOADV, D_NAND }, F_LOADV_LOADV_NAND },
+        { 2, { D_LOADV, D_LOADP }, F_LOADV_LOADP },
+        { 2, { D_LOADV, D_SLOAD }, F_LOADV_SLOAD },
+        { 2, { D_LOADV, D_SSTORE }, F_LOADV_SSTORE },
+        { 2, { D_LOADV, D_ADD }, F_LOADV_ADD },
+        { 2, { D_ADD, D_SSTORE }, F_ADD_SSTORE },
+        { 2, { D_SLOAD, D_LOADV }, F_SLOAD_LOADV },
+        { 2, { D_SSTORE, D_LOADV }, F_SSTORE_LOADV }
+};
+
+/********** decodeWord ********
+ * 
+ * Extracts the opcode and operands of an instruction word
+ *
+ * Parameters:
+ *     uint32_t word: Instruction word
+ *
+ * Return: Decoded record for word
+ *
+ ************************/
+Decoded decodeWord(uint32_t word)
+{
+        Decoded ins = { D_INVALID, 0, 0, 0, 0 };
+        Um_opcode code = word >> 28;
+
+        if (code == LOADV) {
+                ins.op = D_LOADV;
+                ins.a = (word >> 25) & 0x7;
+                ins.value = word & 0x1ffffff;
+        } else if (code < LOADV) {
+                ins.op = D_CMOV + code;
+                ins.a = (word >> 6) & 0x7;
+                ins.b = (word >> 3) & 0x7;
+                ins.c = word & 0x7;
+        }
+        return ins;
+}
+
+/********** decodedProgram ********
+ * 
+ * Gets the pre-decoded form of a segment about to run as segment 0,
+ * creating it with every record pending if the segment has none
+ *
+ * Parameters:
+ *     Segment program: Segment mapped at address 0
+ *
+ * Return: Array of program->length records
+ *
+ ************************/
+Decoded *decodedProgram(Segment program)
+{
+        if (program->decoded == NULL) {
+                trackCodePages(program);
+                program->decoded = calloc((size_t)program->length + 1, 
+                                          sizeof(Decoded));
+                assert(program->decoded != NULL);
+        }
+        return program->decoded;
+}
+
+#ifdef UM_SAFE
+/********** isMapped ********
+ * 
+ * Says whether an address names a mapped segment
+ *
+ * Parameters:
+ *     Mem_T mem: Pointer to memory struct
+ *     uint32_t address: Segment address
+ *
+ * Return: true if $m[address] is mapped
+ *
+ ************************/
+static inline bool isMapped(Mem_T mem, uint32_t address)
+{
+        return address < mem->numSegs && mem->seg[address] != NULL;
+}
+
+/********** fault ********
+ * 
+ * Stops a um-safe machine that is about to do something the spec leaves
+ * undefined, reporting what and where, and exits with EXIT_FAILURE
+ *
+ * Parameters:
+ *     IODev_T io: I/O device, flushed so output up to the fault is seen
+ *     const uint32_t *r: Registers
+ *     uint32_t offset: Offset in segment 0 of the faulting instruction
+ *     const char *fmt, ...: printf-style description of the fault
+ *
+ * Return: None; does not return
+ *
+ ************************/
+static void fault(IODev_T io, const uint32_t *r, uint32_t offset, 
+                  const char *fmt, ...)
+{
+        va_list args;
+        flushOutput(io);
+        fprintf(stderr, "um: fault at $m[0][%u]: ", (unsigned)offset);
+        va_start(args, fmt);
+        vfprintf(stderr, fmt, args);
+        va_end(args);
+        fprintf(stderr, "\nregisters:          ");
+        for (int i = 0; i < 8; i++) {
+                fprintf(stderr, " r%d=0x%08x", i, (unsigned)r[i]);
+        }
+        fprintf(stderr, "\n");
+        exit(EXIT_FAILURE);
+}
+#endif
+
+/********** stepInstruction ********
+ * 
+ * Executes the one instruction at $m[0][offset], straight from its word
+ *
+ * Parameters:
+ *     Mem_T mem: Pointer to memory struct, whose registers are used
+ *                in place
+ *     IODev_T io: I/O device used by IN and OUT
+ *     uint32_t *offset: Offset of the instruction; updated to the offset
+ *                       of the next one
+ *
+ * Return: false if the instruction was HALT, or a MAP there was no
+ *         memory for (which is not run); true otherwise. Either way
+ *         *offset is left on the instruction, and stopStatus says which.
+ *
+ * Notes
+ *      A slow path for callers that interleave their own execution with
+ *      the machine's (such as the JIT), not used by execInstructions.
+ *      Makes the same SAFE_CHECKs as execInstructions.
+ ************************/
+bool stepInstruction(Mem_T mem, IODev_T io, uint32_t *offset)
+{
+        uint32_t *r = mem->reg;
+        SAFE_CHECK(*offset < mem->seg[0]->length, *offset, 
+                   "program counter is past the end of $m[0]");
+        Decoded ins = decodeWord(mem->seg[0]->words[*offset]);
+        uint32_t next = *offset + 1;
+
+        switch (ins.op) {
+                case D_CMOV:
+                        if (r[ins.c] != 0) {
+                                r[ins.a] = r[ins.b];
+                        }
+                        break;
+                case D_SLOAD:
+                        SAFE_CHECK_WORD(r[ins.b], r[ins.c], *offset, 
+                                        "load from");
+                        r[ins.a] = getMem(mem, r[ins.b], r[ins.c]);
+                        break;
+                case D_SSTORE:
+                        SAFE_CHECK_WORD(r[ins.a], r[ins.b], *offset, 
+                                        "store to");
+                        setMem(mem, r[ins.c], r[ins.a], r[ins.b]);
+                        break;
+                case D_ADD:
+                        r[ins.a] = r[ins.b] + r[ins.c];
+                        break;
+                case D_MUL:
+                        r[ins.a] = r[ins.b] * r[ins.c];
+                        break;
+                case D_DIV:
+                        SAFE_CHECK(r[ins.c] != 0, *offset, 
+                                   "division by zero");
+                        r[ins.a] = r[ins.b] / r[ins.c];
+                        break;
+                case D_NAND:
+                        r[ins.a] = ~(r[ins.b] & r[ins.c]);
+                        break;
+                case D_HALT:
+                        flushOutput(io);
+                        return false;
+                case D_MAP: {
+                        uint32_t address = mapSeg(mem, r[ins.c]);
+                        if (address == 0) {
+                                flushOutput(io);
+                                return false;
+                        }
+                        r[ins.b] = address;
+                        break;
+                }
+                case D_UNMAP:
+                        SAFE_CHECK(r[ins.c] != 0 && isMapped(mem, r[ins.c]),
+                                   *offset, "unmap of $m[%u]", 
+                                   (unsigned)r[ins.c]);
+                        unmapSeg(mem, r[ins.c]);
+                        break;
+                case D_OUT:
+                        SAFE_CHECK(r[ins.c] <= 255, *offset, 
+                                   "output of %u, which is not a byte", 
+                                   (unsigned)r[ins.c]);
+                        putByte(io, r[ins.c]);
+                        break;
+                case D_IN:
+                        r[ins.c] = getByte(io);
+                        break;
+                case D_LOADP:
+                        SAFE_CHECK(isMapped(mem, r[ins.b]), *offset, 
+                                   "load program from $m[%u], which is "
+                                   "not mapped", (unsigned)r[ins.b]);
+                        SAFE_CHECK(r[ins.c] < mem->seg[r[ins.b]]->length,
+                                   *offset, "jump to $m[%u][%u], past the "
+                                   "end of the program", (unsigned)r[ins.b],
+                                   (unsigned)r[ins.c]);
+                        if (r[ins.b] != 0) {
+                                dupeSeg(mem, r[ins.b]);
+                        }
+                        next = r[ins.c];
+                        break;
+                case D_LOADV:
+                        r[ins.a] = ins.value;
+                        break;
+                default:
+                        SAFE_CHECK(false, *offset, 
+                                   "invalid instruction 0x%08x", 
+                                   (unsigned)mem->seg[0]->words[*offset]);
+                        break;
+        }
+        *offset = next;
+        return true;
+}
+
+/********** stopStatus ********
+ * 
+ * Says why stepInstruction returned false
+ *
+ * Parameters:
+ *     Mem_T mem: The machine
+ *     uint32_t offset: Offset stepInstruction left the machine on
+ *
+ * Return: RUN_NOMEM if the instruction there is a MAP, RUN_HALTED if it
+ *         is a HALT
+ *
+ ************************/
+Run_status stopStatus(Mem_T mem, uint32_t offset)
+{
+        return mem->seg[0]->words[offset] >> 28 == MAP ? RUN_NOMEM 
+                                                       : RUN_HALTED;
+}
+
+/********** decodeRecord ********
+ * 
+ * Fills in the pending record of one word of a running program, fusing it
+ * with the words after it when they start with a sequence in fusions[]
+ *
+ * Parameters:
+ *     Segment program: Segment 0, with decoded records
+ *     uint32_t offset: Offset of the word
+ *
+ * Return: None
+ *
+ * Notes
+ *      The other words of a fused sequence get their own records decoded
+ *      too, since the fused handler reads its operands from them.
+ *      offset may be the program's length, the spare record past its end
+ *      that a program counter running off the end reaches; that record
+ *      becomes a HALT, so the machine stops there rather than running
+ *      past the records. (um-safe reports a fault before getting here.)
+ ************************/
+static void decodeRecord(Segment program, uint32_t offset)
+{
+        Decoded *code = program->decoded;
+        uint32_t *words = program->words;
+        Decoded ins[FUSE_SPAN];
+        uint32_t avail = program->length - offset;
+        if (avail == 0) {
+                code[offset] = (Decoded){ D_HALT, 0, 0, 0, 0 };
+                return;
+        }
+        if (avail > FUSE_SPAN) {
+                avail = FUSE_SPAN;
+        }
+        for (uint32_t k = 0; k < avail; k++) {
+                ins[k] = decodeWord(words[offset + k]);
+        }
+
+        code[offset] = ins[0];
+        for (size_t f = 0; f < sizeof(fusions) / sizeof(fusions[0]); f++) {
+                uint32_t k = 0;
+                while (k < fusions[f].length && k < avail && 
+                       ins[k].op == fusions[f].seq[k]) {
+                        k++;
+                }
+                if (k < fusions[f].length) {
+                        continue;
+                }
+                code[offset].op = fusions[f].fused;
+                for (k = 1; k < fusions[f].length; k++) {
+                        if (code[offset + k].op == D_PENDING) {
+                                code[offset + k] = ins[k];
+                        }
+                }
+                return;
+        }
+}
+
+/********** clockMs ********
+ * 
+ * Reads the monotonic clock that RunLimits deadlines are measured on
+ *
+ * Parameters: None
+ *
+ * Return: Current time in milliseconds from an arbitrary epoch
+ *
+ ************************/
+double clockMs(void)
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+/********** checkLimits ********
+ * 
+ * Says whether a run has used up its limits, and if not, how many
+ * instructions it may retire before it has to ask again
+ *
+ * Parameters:
+ *     const RunLimits *limits: The run's limits, or NULL for none
+ *     uint64_t retired: Instructions retired so far
+ *     uint64_t *nextCheck: Set to the count at which to call again
+ *
+ * Return: RUN_BUDGET or RUN_DEADLINE if the run must stop, otherwise
+ *         RUN_HALTED (meaning: carry on until HALT)
+ *
+ * Notes
+ *      Executors compare their count with *nextCheck and call this only
+ *      once it is reached, so the clock is read at most once every
+ *      CLOCK_CHECK_INTERVAL instructions
+ ************************/
+Run_status checkLimits(const RunLimits *limits, uint64_t retired, 
+                       uint64_t *nextCheck)
+{
+        *nextCheck = RUN_UNLIMITED;
+        if (limits == NULL) {
+                return RUN_HALTED;
+        }
+        if (retired >= limits->maxRetired) {
+                return RUN_BUDGET;
+        }
+        *nextCheck = limits->maxRetired;
+        if (limits->deadlineMs > 0) {
+                if (clockMs() >= limits->deadlineMs) {
+                        return RUN_DEADLINE;
+                }
+                if (limits->maxRetired - retired > CLOCK_CHECK_INTERVAL) {
+                        *nextCheck = retired + CLOCK_CHECK_INTERVAL;
+                }
+        }
+        return RUN_HALTED;
+}
+
+#ifdef UM_THREADED
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
+/********** execInstructions ********
+ * 
+ * Read through segment zero, executing each instruction
+ * and iterating program counter
+ *
+ * Parameters:
+ *     Mem_T Memory: Pointer to memory struct      		
+ *     IODev_T io: I/O device used by IN and OUT
+ *     const RunLimits *limits: Budget and deadline for the run, or NULL
+ *                              to run until HALT
+ *
+ * Return: RUN_HALTED, or why the machine stopped before halting
+ *
+ * Expects
+ * 	 Non-NULL pointer to initialized memory struct
+ * 
+ * Notes
+ *      The registers are kept in a local array and the program counter
+ *      is a raw pointer into segment 0's decoded records; both are
+ *      written back to mem when the machine stops, so a stopped run
+ *      resumes with another call. seg caches mem->seg and is
+ *      refreshed whenever MAP may have moved the table.
+ *      Instructions are counted by run: every LOADP adds the length of
+ *      the straight-line run it ends, which keeps the count exact
+ *      without touching the other handlers. Limits are checked there
+ *      too, with a single comparison until the count reaches the point
+ *      checkLimits asked for; the machine stops at the first LOADP past
+ *      its budget or deadline.
+ *	Undefined behavior if:
+ *              Word does not code for a valid instruction
+ *              Segmented load or store refers to unmapped segment
+ *              Segment unmap called on $m[0] or an already unmapped segment 
+ *              Dividing by zero
+ *              Instruction loads program from unmapped segment
+ *              Instruction outputs value > 255
+ ************************/
+Run_status execInstructions(Mem_T mem, IODev_T io, const RunLimits *limits)
+{
+        assert(mem != NULL && io != NULL);
+
+        uint32_t r[8];
+        memcpy(r, mem->reg, sizeof(r));
+
+        Segment *seg = mem->seg;
+        Decoded *code = decodedProgram(seg[0]);
+        Decoded *pc = code + mem->counter->offset;
+        Decoded *ins;
+
+        /* Instructions before the current run, and where it started */
+        uint64_t retired = mem->retired;
+        uint32_t runStart = mem->counter->offset;
+        uint64_t nextCheck;
+        Run_status status = checkLimits(limits, retired, &nextCheck);
+        if (status != RUN_HALTED) {
+                return status;
+        }
+
+#ifdef UM_THREADED
+        static void *const dispatch[] = {
+                [D_PENDING] = &&op_D_PENDING, 
+                [D_CMOV] = &&op_D_CMOV, [D_SLOAD] = &&op_D_SLOAD, 
+                [D_SSTORE] = &&op_D_SSTORE, [D_ADD] = &&op_D_ADD, 
+                [D_MUL] = &&op_D_MUL, [D_DIV] = &&op_D_DIV, 
+                [D_NAND] = &&op_D_NAND, [D_HALT] = &&op_D_HALT, 
+                [D_MAP] = &&op_D_MAP, [D_UNMAP] = &&op_D_UNMAP,
+                [D_OUT] = &&op_D_OUT, [D_IN] = &&op_D_IN, 
+                [D_LOADP] = &&op_D_LOADP, [D_LOADV] = &&op_D_LOADV,
+                [D_INVALID] = &&op_D_INVALID,
+                [F_LOADV_LOADV_NAND] = &&op_F_LOADV_LOADV_NAND,
+                [F_LOADV_LOADP] = &&op_F_LOADV_LOADP,
+                [F_LOADV_SLOAD] = &&op_F_LOADV_SLOAD,
+                [F_LOADV_SSTORE] = &&op_F_LOADV_SSTORE,
+                [F_LOADV_ADD] = &&op_F_LOADV_ADD,
+                [F_ADD_SSTORE] = &&op_F_ADD_SSTORE,
+                [F_SLOAD_LOADV] = &&op_F_SLOAD_LOADV,
+                [F_SSTORE_LOADV] = &&op_F_SSTORE_LOADV
+        };
+        DISPATCH();
+#else
+        for (;;) {
+                ins = pc++;
+redispatch:
+                switch (ins->op) {
+#endif
+
+        OP(D_PENDING)
+                SAFE_CHECK((uint32_t)(ins - code) < seg[0]->length, 
+                           ins - code, 
+                           "program counter is past the end of $m[0]");
+                decodeRecord(seg[0], ins - code);
+                REDISPATCH();
+        OP(D_CMOV)
+                if (r[RC] != 0) {
+                        r[RA] = r[RB];
+                }
+                DISPATCH();
+        OP(D_SLOAD)
+                DO_SLOAD();
+                DISPATCH();
+        OP(D_SSTORE)
+                DO_SSTORE();
+                DISPATCH();
+        OP(D_ADD)
+                r[RA] = r[RB] + r[RC];
+                DISPATCH();
+        OP(D_MUL)
+                r[RA] = r[RB] * r[RC];
+                DISPATCH();
+        OP(D_DIV)
+                SAFE_CHECK(r[RC] != 0, ins - code, "division by zero");
+                r[RA] = r[RB] / r[RC];
+                DISPATCH();
+        OP(D_NAND)
+                r[RA] = ~(r[RB] & r[RC]);
+                DISPATCH();
+        OP(D_HALT)
+                /* Stop on the HALT, so a resumed machine halts again */
+                pc--;
+                retired += (pc - code) - runStart + 1;
+                status = RUN_HALTED;
+                goto stop;
+        OP(D_MAP) {
+                /* Mapping may grow (and so move) the segment table */
+                uint32_t address = mapSeg(mem, r[RC]);
+                if (address == 0) {
+                        /* No memory: stop on the MAP, without running it */
+                        pc = ins;
+                        retired += (pc - code) - runStart;
+                        status = RUN_NOMEM;
+                        goto stop;
+                }
+                r[RB] = address;
+                seg = mem->seg;
+                DISPATCH();
+        }
+        OP(D_UNMAP)
+                SAFE_CHECK(r[RC] != 0 && isMapped(mem, r[RC]), ins - code,
+                           "unmap of $m[%u]", (unsigned)r[RC]);
+                unmapSeg(mem, r[RC]);
+                DISPATCH();
+        OP(D_OUT)
+                SAFE_CHECK(r[RC] <= 255, ins - code, 
+                           "output of %u, which is not a byte", 
+                           (unsigned)r[RC]);
+                putByte(io, r[RC]);
+                DISPATCH();
+        OP(D_IN)
+                r[RC] = getByte(io);
+                DISPATCH();
+        OP(D_LOADP) {
+                /* Jumps within segment 0 need no copy, and loading
+                 * another segment shares it rather than copying. The
+                 * target is read first because replacing segment 0 may
+                 * free the record ins points to. */
+                uint32_t target = r[RC];
+                SAFE_CHECK(isMapped(mem, r[RB]), ins - code, 
+                           "load program from $m[%u], which is not "
+                           "mapped", (unsigned)r[RB]);
+                SAFE_CHECK(target < seg[r[RB]]->length, ins - code, 
+                           "jump to $m[%u][%u], past the end of the "
+                           "program", (unsigned)r[RB], (unsigned)target);
+                retired += (pc - code) - runStart;
+                if (r[RB] != 0) {
+                        dupeSeg(mem, r[RB]);
+                        code = decodedProgram(seg[0]);
+                }
+                pc = code + target;
+                runStart = target;
+                if (retired >= nextCheck) {
+                        goto check;
+                }
+                DISPATCH();
+        }
+        OP(D_LOADV)
+                r[LV_A] = LV_VAL;
+                DISPATCH();
+        OP(D_INVALID)
+                SAFE_CHECK(false, ins - code, "invalid instruction 0x%08x",
+                           (unsigned)seg[0]->words[ins - code]);
+                DISPATCH();
+
+        OP(F_LOADV_LOADV_NAND)
+                r[LV_A] = LV_VAL;
+                FUSED_NEXT();
+                r[LV_A] = LV_VAL;
+                FUSED_NEXT();
+                r[RA] = ~(r[RB] & r[RC]);
+                DISPATCH();
+        OP(F_LOADV_LOADP)
+                r[LV_A] = LV_VAL;
+                FUSED_NEXT();
+                CONTINUE_AS(D_LOADP);
+        OP(F_LOADV_SLOAD)
+                r[LV_A] = LV_VAL;
+                FUSED_NEXT();
+                DO_SLOAD();
+                DISPATCH();
+        OP(F_LOADV_SSTORE)
+                r[LV_A] = LV_VAL;
+                FUSED_NEXT();
+                CONTINUE_AS(D_SSTORE);
+        OP(F_LOADV_ADD)
+                r[LV_A] = LV_VAL;
+                FUSED_NEXT();
+                r[RA] = r[RB] + r[RC];
+                DISPATCH();
+        OP(F_ADD_SSTORE)
+                r[RA] = r[RB] + r[RC];
+                FUSED_NEXT();
+                CONTINUE_AS(D_SSTORE);
+        OP(F_SLOAD_LOADV)
+                DO_SLOAD();
+                FUSED_NEXT();
+                r[LV_A] = LV_VAL;
+                DISPATCH();
+        OP(F_SSTORE_LOADV)
+                DO_SSTORE();
+                if (pc->op == D_PENDING) {
+                        /* The store may have rewritten the LOADV */
+                        DISPATCH();
+                }
+                FUSED_NEXT();
+                r[LV_A] = LV_VAL;
+                DISPATCH();
+
+        /* Out of line so that LOADP keeps only the compare */
+check:
+        status = checkLimits(limits, retired, &nextCheck);
+        if (status == RUN_HALTED) {
+                DISPATCH();
+        }
+        goto stop;
+
+#ifndef UM_THREADED
+                }
+        }
+#endif
+
+stop:
+        flushOutput(io);
+        memcpy(mem->reg, r, sizeof(r));
+        shiftProgCounter(mem->counter, 0, pc - code);
+        mem->retired = retired;
+        return status;
+}
+
+#ifdef UM_THREADED
+#pragma GCC diagnostic pop
+#endif
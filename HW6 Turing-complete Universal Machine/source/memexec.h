@@ -1,37 +1,68 @@
-/*
- *     filename: memexec.h
- *     partner 1 name: Jack Burton       Login: jburto05
- *     partner 2 name: James Hartley        Login: jhartl01
- *     date: April 8th, 2024
- *     assignment: hw6
- *
- *     summary: Defines functions for executing instructions from memory
- *     
-*/
-
-#include "memory.h"
-#include <bitpack.h>
-
-typedef enum Um_opcode {
-        CMOV = 0, SLOAD, SSTORE, ADD, MUL, DIV,
-        NAND, HALT, MAP, UNMAP, OUT, IN, LOADP, LOADV
-} Um_opcode;
-
-void execInstructions(Mem_T mem);
-int handleCase(Mem_T mem, uint32_t encodedWord, Um_opcode code);
-int findArgs(Um_opcode code);
-
-/* UM Instruction set */
-void loadV(Mem_T mem, int A, int val);
-void loadp(Mem_T mem, int B, int C);
-void condMove(Mem_T mem, int A, int B, int C);
-void add(Mem_T mem, int A, int B, int C);
-void mult(Mem_T mem, int A, int B, int C);
-void divide(Mem_T mem, int A, int B, int C);
-void nand(Mem_T mem, int A, int B, int C);
-void input(Mem_T mem, int C);
-void output(Mem_T mem, int C);
-void mapSegment(Mem_T mem, int B, int C);
-void unmapSegment(Mem_T mem, int C);
-void segStore(Mem_T mem, int A, int B, int C);
-void segLoad(Mem_T mem, int A, int B, int C);
\ No newline at end of file
+/*
+ *     filename: memexec.h
+ *     partner 1 name: Jack Burton       Login: jburto05
+ *     partner 2 name: James Hartley        Login: jhartl01
+ *     date: April 8th, 2024
+ *     assignment: hw6
+ *
+ *     summary: Defines functions for executing instructions from memory
+ *     
+*/
+
+#ifndef MEMEXEC_INCLUDED
+#define MEMEXEC_INCLUDED
+
+#include "memory.h"
+#include "iodev.h"
+
+typedef enum Um_opcode {
+        CMOV = 0, SLOAD, SSTORE, ADD, MUL, DIV,
+        NAND, HALT, MAP, UNMAP, OUT, IN, LOADP, LOADV
+} Um_opcode;
+
+/* Handlers a Decoded record can name: DECODE_PENDING, then one per
+ * opcode in Um_opcode order, then one for words that are not valid
+ * instructions, then the superinstructions, each named for the sequence
+ * it runs */
+typedef enum Decoded_op {
+        D_PENDING = DECODE_PENDING, 
+        D_CMOV, D_SLOAD, D_SSTORE, D_ADD, D_MUL, D_DIV,
+        D_NAND, D_HALT, D_MAP, D_UNMAP, D_OUT, D_IN, D_LOADP, D_LOADV,
+        D_INVALID,
+        F_LOADV_LOADV_NAND, F_LOADV_LOADP, F_LOADV_SLOAD, F_LOADV_SSTORE,
+        F_LOADV_ADD, F_ADD_SSTORE, F_SLOAD_LOADV, F_SSTORE_LOADV
+} Decoded_op;
+
+/* Instruction limit that is never reached */
+#define RUN_UNLIMITED UINT64_MAX
+
+/* RunLimits
+ * Usage: When a run should stop short of HALT
+ *
+ * Members:
+ * 	uint64_t maxRetired: Stop once mem->retired reaches this, or
+ * 		RUN_UNLIMITED
+ * 	double deadlineMs: Stop once clockMs() reaches this, or 0 for no
+ * 		deadline
+ *
+*/
+typedef struct RunLimits {
+        uint64_t maxRetired;
+        double deadlineMs;
+} RunLimits;
+
+/* Why a run returned: RUN_NOMEM stops on a MAP there was no memory for */
+typedef enum Run_status {
+        RUN_HALTED = 0, RUN_BUDGET, RUN_DEADLINE, RUN_NOMEM
+} Run_status;
+
+Run_status execInstructions(Mem_T mem, IODev_T io, const RunLimits *limits);
+Run_status checkLimits(const RunLimits *limits, uint64_t retired, 
+                       uint64_t *nextCheck);
+double clockMs(void);
+bool stepInstruction(Mem_T mem, IODev_T io, uint32_t *offset);
+Run_status stopStatus(Mem_T mem, uint32_t offset);
+Decoded decodeWord(uint32_t word);
+Decoded *decodedProgram(Segment program);
+
+#endif
@@ -1,61 +1,93 @@
-/*
- *     filename: memload.c
- *     partner 1 name: Jack Burton       Login: jburto05
- *     partner 2 name: James Hartley        Login: jhartl01
- *     date: April 8th, 2024
- *     assignment: hw6
- *
- *     summary: Implements functions for loading instructions from file
- *     into memory.
- *     
-*/
-
-#include "memload.h"
-
-const int BYTE = 8 /* bits */;
-
-/********** loadInstructions ********
- * 
- * Read through .um file, pushing each instruction into segment zero
- *
- * Parameters:
- *     Mem_T memory: Pointer to initialized empty memory
- *     FILE *fp: Pointer to opened .um file
- *
- * Return: None
- *
- * Expects
- * 	 Non-NULL pointer to valid .um file
- *
- ************************/
-void loadInstructions(Mem_T mem, FILE *fp)
-{
-        assert(fp != NULL);
-
-        int segZeroLength = Seq_length(Seq_get(mem->seg, 0));
-        for (int i = 0; i < segZeroLength; i++) {
-                setMem(mem, packWord(fp), 0, i);
-        }
-}
-
-/********** packWord ********
- * 
- * Reads instruction from file and packs it into 32-bit word in big endian
- * order
- *
- * Parameters:
- *     FILE *fp: Pointer to opened .um file
- *
- * Return: bitpacked instruction word
- *
- ************************/
-uint32_t packWord(FILE *fp) {
-        uint32_t word;
-
-        /* Grab one word (4 chars) */
-        for (int i = 3; i >= 0; i--) {
-                word = Bitpack_newu(word, BYTE, BYTE*i, getc(fp));
-        }
-
-        return word;
-}
\ No newline at end of file
+/*
+ *     filename: memload.c
+ *     partner 1 name: Jack Burton       Login: jburto05
+ *     partner 2 name: James Hartley        Login: jhartl01
+ *     date: April 8th, 2024
+ *     assignment: hw6
+ *
+ *     summary: Implements functions for loading instructions from file
+ *     into memory.
+ *     
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <limits.h>
+#include <sys/stat.h>
+#include "memload.h"
+
+/********** loadInstructions ********
+ * 
+ * Reads the whole .um file into segment zero with a single fread, then
+ * converts each word from big-endian to host order in place
+ *
+ * Parameters:
+ *     Mem_T memory: Pointer to initialized empty memory
+ *     FILE *fp: Pointer to opened .um file
+ *
+ * Return: true, or false if the file is shorter than segment zero or
+ *         cannot be read
+ *
+ * Expects
+ * 	 Non-NULL pointer to valid .um file
+ *       Segment zero sized to the number of words in the file
+ *
+ * Notes
+ *       The conversion reads each word back as bytes, which works on any
+ *       host byte order. GCC compiles it to one bswap per word, or to
+ *       vectorized byte shuffles at -O3 when the target has them.
+ *
+ ************************/
+bool loadInstructions(Mem_T mem, FILE *fp)
+{
+        assert(fp != NULL);
+
+        uint32_t *words = mem->seg[0]->words;
+        size_t length = mem->seg[0]->length;
+        if (fread(words, sizeof(uint32_t), length, fp) != length) {
+                return false;
+        }
+
+        for (size_t i = 0; i < length; i++) {
+                const unsigned char *bytes = (unsigned char *)&words[i];
+                words[i] = (uint32_t)bytes[0] << 24 | 
+                           (uint32_t)bytes[1] << 16 |
+                           (uint32_t)bytes[2] << 8 | 
+                           (uint32_t)bytes[3];
+        }
+        return true;
+}
+
+/********** loadProgram ********
+ * 
+ * Creates a machine with a .um file loaded into segment zero
+ *
+ * Parameters:
+ *     FILE *fp: Pointer to opened .um file
+ *
+ * Return: pointer to the new Mem_T, or NULL if the file cannot be read
+ *         whole, is too large for initMem or there is no memory for it
+ * 
+ * Notes
+ *      Failing returns rather than exits, so um-batch can fail one job
+ *      and carry on with the rest
+ *
+ ************************/
+Mem_T loadProgram(FILE *fp)
+{
+        assert(fp != NULL);
+
+        struct stat st;
+        if (fstat(fileno(fp), &st) < 0 || st.st_size > INT_MAX) {
+                return NULL;
+        }
+        Mem_T mem = initMem(st.st_size);
+        if (mem == NULL) {
+                return NULL;
+        }
+        if (!loadInstructions(mem, fp)) {
+                freeMem(mem);
+                return NULL;
+        }
+        return mem;
+}
@@ -1,271 +1,504 @@
-/*
- *     filename: memory.c
- *     partner 1 name: Jack Burton       Login: jburto05
- *     partner 2 name: James Hartley        Login: jhartl01
- *     date: April 4th, 2024
- *     assignment: hw6
- *
- *     summary: Implements functions for segmented memory and registers
- *     for a universal machine.
- *     
-*/
-
-#include "memory.h"
-
-
-const int MAPPED = true;
-const int UNMAPPED = false;
-
-/********** initMem ********
- * 
- * Creates new empty Mem_T struct of size 
- *
- * Parameters:
- *     int size: Number of words 
- *
- *
- * Return: pointer to initialized Mem_T struct
- * 
- * Notes
- *      memory is heap allocated--freed at end of execution via freeMem()
- *
- ************************/
-Mem_T initMem(int size)
-{
-        Mem_T memory = ALLOC(sizeof(*memory));
-        assert(memory != NULL);
-        memory->seg = Seq_new(0);
-        memory->reg = UArray_new(8, sizeof(uint32_t));
-
-        /* Keeps track of mapped segments */
-        memory->segMapped = Seq_new(0);
-        
-        /* Creates 0th segment with number of words from input file */
-        mapSeg(memory, size / 4);
-
-        /* Initialize program counter to $m[0][0] */
-        memory->counter = ALLOC(sizeof(ProgCounter));
-        shiftProgCounter(memory->counter, 0, 0);
-        
-        return memory;
-}
-
-/********** freeMem ********
- * 
- * Frees entire segmented memory and registers given a memory object
- *
- * Parameters:
- *     Mem_T mem: Pointer to memory struct
- *
- * Return: None
- *
- ************************/
-void freeMem(Mem_T mem)
-{
-        /* Free words from each segment */
-        for (int i = 0; i < Seq_length(mem->seg); i++) {
-                unmapSeg(mem, i);
-        }
-        
-        /* Free segment mapped tracker and segments themselves */
-        Seq_free(&mem->segMapped);
-        Seq_free(&mem->seg);
-
-        /* Free registers and struct */
-        UArray_free(&mem->reg);
-        free(mem->counter);
-        free(mem);
-        
-}
-
-
-
-/********** getMem ********
- * 
- * Gets 32-bit word at $m[address][offset]
- *
- * Parameters:
- *     Mem_T memory: Pointer to memory struct
- *     uint32_t address: specifies segment address in memory
- *     int offset: specifies offset in memory
- *
- *
- * Return: uint32_t word
- *
- *
- ************************/
-uint32_t getMem(Mem_T mem, uint32_t address, int offset)
-{
-        assert(mem != NULL);
-        Seq_T segment = Seq_get(mem->seg, address);
-        return (uint32_t)(uintptr_t)Seq_get(segment, offset);
-}
-
-/********** getReg ********
- * 
- * Gets 32-bit word at $r[offset]
- *
- * Parameters:
- *     Mem_T mem: Pointer to UM memory struct
- *     int index: specifies index in registers uarray
- *
- *
- * Return: uint32_t word
- *
- * Expects
- *      0 <= index <= 7
- * 
- ************************/
-uint32_t getReg(Mem_T mem, int index)
-{
-        assert(mem->reg != NULL);
-        return *(uint32_t*)UArray_at(mem->reg, index);
-}
-
-/********** setMem ********
- * 
- * Sets $m[address][offset] to “word”
- *
- * Parameters:
- *     Mem_T mem: Pointer to memory struct
- *     uint32_t word: Bitpacked instruction
- *     uint32_t address: specifies segment address in memory
- *     int offset: specifies offset in memory
- *
- * Return: None
- *
- *
- ************************/
-void setMem(Mem_T mem, uint32_t word, uint32_t address, int offset) 
-{
-        assert(mem != NULL);
-        Seq_put(Seq_get(mem->seg, address), offset, (void*)(uintptr_t)word);
-}
-
-/********** setReg ********
- * 
- * Sets $r[index] to “word”
- *
- * Parameters:
- *     Mem_T mem: Pointer to memory struct
- *     uint32_t word: Bitpacked instruction
- *     int index: index of register in uarray
- *
- *
- * Return: None
- *
- * Expects
- *     0 <= index <= 7 (register to be in range r0-r7)
- *
- ************************/
-void setReg(Mem_T mem, uint32_t word, int index) 
-{
-        assert(index >= 0 && index <= 7);
-
-        uint32_t *regPtr = (uint32_t*)UArray_at(mem->reg, index);
-        *regPtr = word;
-}
-
-
-/********** mapSeg ********
- * 
- * Maps a new segment with "size" number of words initialized to 0
- * and returns its address
- *
- * Parameters:
- *     Mem_T mem: Pointer to memory struct
- *     int size: Number of words in new segment
- *
- *
- * Return: address of newly mapped segment
- *
- *
- ************************/
-uint32_t mapSeg(Mem_T mem, int size) 
-{
-        /* Create new segment and initialize all words to 0 */
-        Seq_T newSeg = Seq_new(size);
-        for (int i = 0; i < size; i++) {
-                Seq_addhi(newSeg, 0);
-        }
-        
-        /* Use unmapped segment space if it exists */
-        int numSegs = Seq_length(mem->segMapped);
-        for (int i = 0; i < numSegs; i++) {
-                int isMapped = (int)(uintptr_t)Seq_get(mem->segMapped, i);
-                if (isMapped == UNMAPPED) {
-                        Seq_put(mem->seg, i, newSeg);
-                        Seq_put(mem->segMapped, i, (void*)(uintptr_t)MAPPED);
-                        return i;
-                }
-        }
-
-
-        /* Otherwise add new segment at end */
-        Seq_addhi(mem->seg, newSeg);
-        Seq_addhi(mem->segMapped, (void*)(uintptr_t)MAPPED);
-        return (Seq_length(mem->segMapped) - 1);
-}
-
-/********** unmapSeg ********
- * 
- * Unmaps memory segment at specified address
- *
- * Parameters:
- *     Mem_T mem: Pointer to memory struct
- *     uint32_t address: Address within segmented memory to free
- *
- * Return: None
- *
- ************************/
-void unmapSeg(Mem_T mem, uint32_t address) {
-        Seq_T segment = Seq_get(mem->seg, address);
-
-        /* If segment is mapped, free it */
-        if ((int)(uintptr_t)Seq_get(mem->segMapped, address) == 1) {
-                Seq_free(&segment);
-        }
-
-        Seq_put(mem->segMapped, address, (void*)(uintptr_t)UNMAPPED);
-}
-
-/********** dupeSeg ********
- * 
- * Duplicates memory segment at specified address, placing it into segment
- * 0
- *
- * Parameters:
- *     Mem_T mem: Pointer to memory struct
- *     uint32_t address: Address within segmented memory to free
- *
- * Return: None
- *
- ************************/
-void dupeSeg(Mem_T mem, uint32_t address)
-{
-        int size = Seq_length(Seq_get(mem->seg, address));
-        unmapSeg(mem, 0);
-        mapSeg(mem, size);
-
-        /* Copy contents of segment into segment zero */
-        for (int i = 0; i < size; i++) {
-                setMem(mem, getMem(mem, address, i), 0, i);
-        }      
-}
-
-/********** shiftProgCounter ********
- * 
- * Shifts program counter to specified address and offset
- *
- * Parameters:
- *     ProgCounter pg: Program counter object
- *     uint32_t address: Address of memory segment
- *     int offset: Offset within segment
- *
- * Return: None
- *
- ************************/
-void shiftProgCounter(ProgCounter pg, uint32_t address, int offset){
-        pg->address = address;
-        pg->offset = offset;
-}
+/*
+ *     filename: memory.c
+ *     partner 1 name: Jack Burton       Login: jburto05
+ *     partner 2 name: James Hartley        Login: jhartl01
+ *     date: April 4th, 2024
+ *     assignment: hw6
+ *
+ *     summary: Implements functions for segmented memory and registers
+ *     for a universal machine.
+ *     
+*/
+
+#include <errno.h>
+#include "memory.h"
+
+
+/* Initial number of entries in the segment table and free-ID stack */
+const uint32_t SEG_TABLE_HINT = 16;
+
+static void releaseSeg(Mem_T mem, Segment segment);
+
+/* Bytes of a segment of length words, header included */
+static size_t segBytes(uint32_t length)
+{
+        return sizeof(struct Segment) + (size_t)length * sizeof(uint32_t);
+}
+
+/********** initMem ********
+ * 
+ * Creates new empty Mem_T struct of size 
+ *
+ * Parameters:
+ *     int size: Number of words 
+ *
+ *
+ * Return: pointer to initialized Mem_T struct, or NULL if there is no
+ *         memory for segment 0
+ * 
+ * Notes
+ *      memory is heap allocated--freed at end of execution via freeMem()
+ *
+ ************************/
+Mem_T initMem(int size)
+{
+        Mem_T memory = malloc(sizeof(*memory));
+        assert(memory != NULL);
+        memory->segCapacity = SEG_TABLE_HINT;
+        memory->numSegs = 0;
+        memory->seg = calloc(memory->segCapacity, sizeof(Segment));
+        assert(memory->seg != NULL);
+        memset(memory->reg, 0, sizeof(memory->reg));
+        memset(&memory->stats, 0, sizeof(memory->stats));
+        memory->slab = initSlab();
+        memory->retired = 0;
+        memory->counter = NULL;
+
+        /* Keeps track of addresses free for reuse */
+        memory->freeCapacity = SEG_TABLE_HINT;
+        memory->numFree = 0;
+        memory->freeIds = malloc(memory->freeCapacity * sizeof(uint32_t));
+        assert(memory->freeIds != NULL);
+        
+        /* Creates 0th segment with number of words from input file */
+        mapSeg(memory, size / 4);
+        if (memory->seg[0] == NULL) {
+                freeMem(memory);
+                return NULL;
+        }
+
+        /* Initialize program counter to $m[0][0] */
+        memory->counter = malloc(sizeof(*memory->counter));
+        assert(memory->counter != NULL);
+        shiftProgCounter(memory->counter, 0, 0);
+        
+        return memory;
+}
+
+/********** freeMem ********
+ * 
+ * Frees entire segmented memory and registers given a memory object
+ *
+ * Parameters:
+ *     Mem_T mem: Pointer to memory struct
+ *
+ * Return: None
+ *
+ ************************/
+void freeMem(Mem_T mem)
+{
+        /* Release each mapped segment, then the table itself */
+        for (uint32_t i = 0; i < mem->numSegs; i++) {
+                if (mem->seg[i] != NULL) {
+                        releaseSeg(mem, mem->seg[i]);
+                }
+        }
+        freeSlab(mem->slab);
+        free(mem->seg);
+        free(mem->freeIds);
+
+        /* Free program counter and struct */
+        free(mem->counter);
+        free(mem);
+        
+}
+
+
+
+/********** getMem ********
+ * 
+ * Gets 32-bit word at $m[address][offset]
+ *
+ * Parameters:
+ *     Mem_T memory: Pointer to memory struct
+ *     uint32_t address: specifies segment address in memory
+ *     int offset: specifies offset in memory
+ *
+ *
+ * Return: uint32_t word
+ *
+ *
+ ************************/
+uint32_t getMem(Mem_T mem, uint32_t address, int offset)
+{
+        assert(mem != NULL);
+        return mem->seg[address]->words[offset];
+}
+
+/********** getReg ********
+ * 
+ * Gets 32-bit word at $r[offset]
+ *
+ * Parameters:
+ *     Mem_T mem: Pointer to UM memory struct
+ *     int index: specifies index in registers array
+ *
+ *
+ * Return: uint32_t word
+ *
+ * Expects
+ *      0 <= index <= 7
+ * 
+ ************************/
+uint32_t getReg(Mem_T mem, int index)
+{
+        assert(index >= 0 && index <= 7);
+        return mem->reg[index];
+}
+
+/********** setMem ********
+ * 
+ * Sets $m[address][offset] to “word”
+ *
+ * Parameters:
+ *     Mem_T mem: Pointer to memory struct
+ *     uint32_t word: Bitpacked instruction
+ *     uint32_t address: specifies segment address in memory
+ *     int offset: specifies offset in memory
+ *
+ * Return: None
+ *
+ *
+ ************************/
+void setMem(Mem_T mem, uint32_t word, uint32_t address, int offset) 
+{
+        assert(mem != NULL);
+        Segment segment = mem->seg[address];
+        if (segment->refs > 1) {
+                segment = unshareSeg(mem, address);
+        }
+        segment->words[offset] = word;
+        if (segment->dirty != NULL) {
+                invalidateCode(segment, offset);
+        }
+}
+
+/********** trackCodePages ********
+ * 
+ * Starts tracking which code pages of a segment are stored to, for a code
+ * cache about to be built over it, with every page clean
+ *
+ * Parameters:
+ *     Segment segment: Segment about to be run
+ *
+ * Return: None
+ *
+ ************************/
+void trackCodePages(Segment segment)
+{
+        size_t words = (((size_t)segment->length >> CODE_PAGE_SHIFT) + 64) 
+                       / 64;
+        if (segment->dirty == NULL) {
+                segment->dirty = calloc(words, sizeof(uint64_t));
+                assert(segment->dirty != NULL);
+        } else {
+                memset(segment->dirty, 0, words * sizeof(uint64_t));
+        }
+}
+
+/********** invalidateCode ********
+ * 
+ * Records a store into a tracked segment: marks its code page dirty and
+ * sets back to pending every decoded record the store may have made
+ * stale, which is the word's own and those of the FUSE_SPAN - 1 words
+ * before it, which may have been fused with it
+ *
+ * Parameters:
+ *     Segment segment: Segment stored to, tracked by trackCodePages
+ *     uint32_t offset: Offset of the word stored to
+ *
+ * Return: None
+ *
+ * Notes
+ *      Decoded records are reset at once, since the interpreter may run
+ *      the word next; caches that cannot be entered mid-page, like the
+ *      JIT's, rebuild the page lazily from its dirty bit instead.
+ ************************/
+void invalidateCode(Segment segment, uint32_t offset)
+{
+        uint32_t page = offset >> CODE_PAGE_SHIFT;
+        segment->dirty[page / 64] |= (uint64_t)1 << (page % 64);
+        if (segment->decoded == NULL) {
+                return;
+        }
+        uint32_t first = offset < FUSE_SPAN - 1 ? 0 
+                                                : offset - (FUSE_SPAN - 1);
+        for (uint32_t i = first; i <= offset; i++) {
+                segment->decoded[i].op = DECODE_PENDING;
+        }
+}
+
+/********** nextDirtyPage ********
+ * 
+ * Takes the lowest dirty code page of a tracked segment, clearing its bit
+ *
+ * Parameters:
+ *     Segment segment: Segment tracked by trackCodePages
+ *     uint32_t *page: Set to the page's number, if there is one
+ *
+ * Return: true if a page was dirty, false if none is
+ *
+ ************************/
+bool nextDirtyPage(Segment segment, uint32_t *page)
+{
+        size_t words = (((size_t)segment->length >> CODE_PAGE_SHIFT) + 64) 
+                       / 64;
+        for (size_t i = 0; i < words; i++) {
+                uint64_t bits = segment->dirty[i];
+                if (bits != 0) {
+                        int bit = 0;
+                        while ((bits >> bit & 1) == 0) {
+                                bit++;
+                        }
+                        segment->dirty[i] = bits & (bits - 1);
+                        *page = i * 64 + bit;
+                        return true;
+                }
+        }
+        return false;
+}
+
+/********** setReg ********
+ * 
+ * Sets $r[index] to “word”
+ *
+ * Parameters:
+ *     Mem_T mem: Pointer to memory struct
+ *     uint32_t word: Bitpacked instruction
+ *     int index: index of register in registers array
+ *
+ *
+ * Return: None
+ *
+ * Expects
+ *     0 <= index <= 7 (register to be in range r0-r7)
+ *
+ ************************/
+void setReg(Mem_T mem, uint32_t word, int index) 
+{
+        assert(index >= 0 && index <= 7);
+        mem->reg[index] = word;
+}
+
+
+/********** mapSeg ********
+ * 
+ * Maps a new segment with "size" number of words initialized to 0
+ * and returns its address
+ *
+ * Parameters:
+ *     Mem_T mem: Pointer to memory struct
+ *     uint32_t size: Number of words in new segment
+ *
+ *
+ * Return: address of newly mapped segment, or 0 (which is always mapped
+ *         already) if there is no memory for it
+ *
+ * Notes
+ *      The segment and its length are allocated and zeroed together by
+ *      the slab allocator. The most recently unmapped address is reused
+ *      first, in constant time. Growing the segment table may move it,
+ *      but never moves the segments themselves. A failure is reported to
+ *      stderr and leaves memory as it was; the caller decides whether
+ *      the machine stops.
+ *
+ ************************/
+uint32_t mapSeg(Mem_T mem, uint32_t size) 
+{
+        /* Create new segment with all words initialized to 0 */
+        Segment newSeg = slabAlloc(mem->slab, segBytes(size));
+        if (newSeg == NULL) {
+                fprintf(stderr, "um: cannot map a segment of %u words: "
+                                "%s\n", (unsigned)size, strerror(errno));
+                return 0;
+        }
+        newSeg->refs = 1;
+        newSeg->length = size;
+        newSeg->decoded = NULL;
+        newSeg->dirty = NULL;
+        
+        mem->stats.maps++;
+        mem->stats.live++;
+        if (mem->stats.live > mem->stats.peakLive) {
+                mem->stats.peakLive = mem->stats.live;
+        }
+
+        /* Use unmapped segment space if it exists */
+        if (mem->numFree > 0) {
+                uint32_t address = mem->freeIds[--mem->numFree];
+                mem->seg[address] = newSeg;
+                mem->stats.reused++;
+                return address;
+        }
+
+        /* Otherwise add new segment at end, doubling the table if full */
+        if (mem->numSegs == mem->segCapacity) {
+                mem->segCapacity *= 2;
+                mem->seg = realloc(mem->seg, 
+                                   mem->segCapacity * sizeof(Segment));
+                assert(mem->seg != NULL);
+        }
+        mem->seg[mem->numSegs] = newSeg;
+        return mem->numSegs++;
+}
+
+/********** unmapSeg ********
+ * 
+ * Unmaps memory segment at specified address
+ *
+ * Parameters:
+ *     Mem_T mem: Pointer to memory struct
+ *     uint32_t address: Address within segmented memory to free
+ *
+ * Return: None
+ *
+ ************************/
+void unmapSeg(Mem_T mem, uint32_t address) {
+        assert(address != 0);
+        releaseSeg(mem, mem->seg[address]);
+        mem->seg[address] = NULL;
+        mem->stats.live--;
+
+        /* Push address on the free stack, growing it if full */
+        if (mem->numFree == mem->freeCapacity) {
+                mem->freeCapacity *= 2;
+                mem->freeIds = realloc(mem->freeIds, 
+                                       mem->freeCapacity * sizeof(uint32_t));
+                assert(mem->freeIds != NULL);
+        }
+        mem->freeIds[mem->numFree++] = address;
+}
+
+/********** dupeSeg ********
+ * 
+ * Duplicates memory segment at specified address, placing it into segment
+ * 0
+ *
+ * Parameters:
+ *     Mem_T mem: Pointer to memory struct
+ *     uint32_t address: Address within segmented memory to free
+ *
+ * Return: None
+ *
+ * Notes
+ *      Constant time: segment 0 shares the source segment rather than
+ *      copying it, and whichever address is stored to first gets its own
+ *      copy (see unshareSeg). Any pointer into the old segment 0's words
+ *      is stale after this call.
+ *
+ ************************/
+void dupeSeg(Mem_T mem, uint32_t address)
+{
+        Segment segment = mem->seg[address];
+        segment->refs++;
+        releaseSeg(mem, mem->seg[0]);
+        mem->seg[0] = segment;
+        mem->stats.loads++;
+}
+
+/********** unshareSeg ********
+ * 
+ * Gives address its own copy of a segment it shares with other addresses
+ *
+ * Parameters:
+ *     Mem_T mem: Pointer to memory struct
+ *     uint32_t address: Address of a shared segment about to be written
+ *
+ * Return: The private copy, now mapped at address
+ *
+ * Expects
+ *      mem->seg[address]->refs > 1
+ * Notes
+ *      If address is 0, pointers into segment 0's words are stale after
+ *      this call. The copy is made in the middle of a store, which no
+ *      executor can back out of, so a copy there is no memory for is
+ *      reported and exits with EXIT_FAILURE.
+ *
+ ************************/
+Segment unshareSeg(Mem_T mem, uint32_t address)
+{
+        Segment segment = mem->seg[address];
+        assert(segment->refs > 1);
+
+        size_t bytes = segBytes(segment->length);
+        Segment copy = slabAlloc(mem->slab, bytes);
+        if (copy == NULL) {
+                fprintf(stderr, "um: cannot copy a segment of %u words: "
+                                "%s\n", (unsigned)segment->length, 
+                        strerror(errno));
+                exit(EXIT_FAILURE);
+        }
+        memcpy(copy, segment, bytes);
+        copy->refs = 1;
+        copy->decoded = NULL;
+        copy->dirty = NULL;
+
+        segment->refs--;
+        mem->seg[address] = copy;
+        mem->stats.copies++;
+        return copy;
+}
+
+/********** releaseSeg ********
+ * 
+ * Drops one reference to a segment, freeing it when none remain
+ *
+ * Parameters:
+ *     Mem_T mem: Pointer to memory struct whose allocator holds it
+ *     Segment segment: Segment no longer used by one address
+ *
+ * Return: None
+ *
+ ************************/
+static void releaseSeg(Mem_T mem, Segment segment)
+{
+        if (--segment->refs == 0) {
+                free(segment->decoded);
+                free(segment->dirty);
+                slabFree(mem->slab, segment, segBytes(segment->length));
+        }
+}
+
+/********** printMemStats ********
+ * 
+ * Prints segment usage counters, showing how many addresses the free-ID
+ * stack recycled and the most segments that were live at once
+ *
+ * Parameters:
+ *     Mem_T mem: Pointer to memory struct
+ *     FILE *fp: Stream to print to
+ *
+ * Return: None
+ *
+ ************************/
+void printMemStats(Mem_T mem, FILE *fp)
+{
+        fprintf(fp, "segments mapped:     %llu\n", 
+                (unsigned long long)mem->stats.maps);
+        fprintf(fp, "addresses reused:    %llu\n", 
+                (unsigned long long)mem->stats.reused);
+        fprintf(fp, "peak live segments:  %u\n", mem->stats.peakLive);
+        fprintf(fp, "segment table size:  %u\n", mem->numSegs);
+        fprintf(fp, "program loads:       %llu\n", 
+                (unsigned long long)mem->stats.loads);
+        fprintf(fp, "copies on write:     %llu\n", 
+                (unsigned long long)mem->stats.copies);
+        printSlabStats(mem->slab, fp);
+}
+
+/********** shiftProgCounter ********
+ * 
+ * Shifts program counter to specified address and offset
+ *
+ * Parameters:
+ *     ProgCounter pg: Program counter object
+ *     uint32_t address: Address of memory segment
+ *     int offset: Offset within segment
+ *
+ * Return: None
+ *
+ ************************/
+void shiftProgCounter(ProgCounter pg, uint32_t address, int offset){
+        pg->address = address;
+        pg->offset = offset;
+}
@@ -1,79 +1,184 @@
-/*
- *     filename: memory.c
- *     partner 1 name: Jack Burton       Login: jburto05
- *     partner 2 name: James Hartley        Login: jhartl01
- *     date: April 4th, 2024
- *     assignment: hw6
- *
- *     summary: Defines functions for a segmented memory and 
- *     registers for a univeral machine.
- *     
-*/
-
-#include <stdio.h>
-#include <string.h>
-#include <stdlib.h>
-#include <stdint.h>
-#include <stdbool.h>
-#include <assert.h>
-#include <seq.h>
-#include <uarray.h>
-#include <mem.h>
-
-typedef UArray_T Reg_T;
-
-/* ProgCounter 
- * Usage: Points to next instruction to execute in form $m[address][offset]
- *
- * Members:
- * 	uint32_t address: Address of segment within memory being executed
- * 	int offset: word within segment to execute
- * 
-*/
-typedef struct ProgCounter {
-	uint32_t address;
-	int offset;
-} *ProgCounter;
-
-
-/* Mem_T
- * Usage: Represents a Universal Machine's memory, with segmented memory
- * and registers
- * 
- * Members:
- * 	Seq_T seg: A Hanson sequence of sequences, each containing 32-bit
- * 		instruction words represented as uint32_t's, representing
- * 		the segmented memory.
- * 	Seq_T segMapped: A sequence of booleans keeping track of whether
- * 		a segment is mapped (1) or not (0).
- * 	Reg_T reg: A UArray of 32-bit instruction words, representing the
- * 		8 registers r[0]-r[7].
- * 	ProgCounter counter: Program counter, storing address/offset of next
- * 	instruction to execute
- *
- * A Mem_T object is typedefed to be a pointer to a Mem_T struct instance.
-*/
-typedef struct Mem_T {
-	Seq_T seg;
-	Seq_T segMapped;
-	Reg_T reg;
-	ProgCounter counter;
-} *Mem_T;
-
-
-
-Mem_T initMem(int size);
-void freeMem(Mem_T mem);
-
-/* Memory/register getters and setters */
-uint32_t getMem(Mem_T mem, uint32_t address, int offset);
-uint32_t getReg(Mem_T mem, int index);
-void setMem(Mem_T mem, uint32_t word, uint32_t address, int offset);
-void setReg(Mem_T mem, uint32_t word, int index);
-
-/* Segment modifiers */
-uint32_t mapSeg(Mem_T mem, int size);
-void unmapSeg(Mem_T mem, uint32_t address);
-void dupeSeg(Mem_T mem, uint32_t address);
-
-void shiftProgCounter(ProgCounter pg, uint32_t address, int offset);
\ No newline at end of file
+/*
+ *     filename: memory.c
+ *     partner 1 name: Jack Burton       Login: jburto05
+ *     partner 2 name: James Hartley        Login: jhartl01
+ *     date: April 4th, 2024
+ *     assignment: hw6
+ *
+ *     summary: Defines functions for a segmented memory and 
+ *     registers for a univeral machine.
+ *     
+*/
+
+#ifndef MEMORY_INCLUDED
+#define MEMORY_INCLUDED
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <assert.h>
+#include "slab.h"
+
+/* ProgCounter 
+ * Usage: Points to next instruction to execute in form $m[address][offset]
+ *
+ * Members:
+ * 	uint32_t address: Address of segment within memory being executed
+ * 	int offset: word within segment to execute
+ * 
+*/
+typedef struct ProgCounter {
+	uint32_t address;
+	int offset;
+} *ProgCounter;
+
+
+/* Decoded
+ * Usage: Pre-decoded form of one instruction word, so the executor does
+ * not extract its fields every time it runs
+ *
+ * Members:
+ * 	uint8_t op: Handler to run (see Decoded_op in memexec.h), or
+ * 		DECODE_PENDING if the word has not been decoded since it
+ * 		was last stored to. A fused handler also runs the records
+ * 		after it, up to FUSE_SPAN words in all.
+ * 	uint8_t a, b, c: Register indices (only a, for LOADV)
+ * 	uint32_t value: Value loaded by LOADV
+ *
+*/
+typedef struct Decoded {
+	uint8_t op;
+	uint8_t a;
+	uint8_t b;
+	uint8_t c;
+	uint32_t value;
+} Decoded;
+
+#define DECODE_PENDING 0
+#define FUSE_SPAN 3
+
+/* Words per code page, the unit in which stores into a running program
+ * are tracked for the JIT */
+#define CODE_PAGE_SHIFT 8
+#define CODE_PAGE_WORDS (1u << CODE_PAGE_SHIFT)
+
+
+/* Segment
+ * Usage: One mapped segment of memory, stored as a length-prefixed array
+ * of words so that $m[address][offset] is a single indexed load
+ *
+ * Members:
+ * 	uint32_t refs: Number of addresses sharing this segment. LOADP
+ * 		shares a segment with segment 0 instead of copying it; a
+ * 		store to a shared segment first gives its address a copy.
+ * 	uint32_t length: Number of words in the segment
+ * 	Decoded *decoded: Pre-decoded form of the words, one record per
+ * 		word, built lazily by memexec once the segment runs as
+ * 		segment 0; NULL until then
+ * 	uint64_t *dirty: Bitmap with a bit per code page, set by a store
+ * 		into the page, for code caches to rebuild from; allocated
+ * 		with trackCodePages once any cache covers the segment
+ * 		(always by the time decoded is), NULL until then
+ * 	uint32_t words[]: The words themselves, allocated together with the
+ * 		length
+ *
+*/
+typedef struct Segment {
+	uint32_t refs;
+	uint32_t length;
+	Decoded *decoded;
+	uint64_t *dirty;
+	uint32_t words[];
+} *Segment;
+
+
+/* MemStats
+ * Usage: Counters describing how a program used segmented memory
+ *
+ * Members:
+ * 	uint64_t maps: Number of segments mapped, including segment 0
+ * 	uint64_t reused: Number of maps that recycled an unmapped address
+ * 	uint32_t live: Number of segments currently mapped
+ * 	uint32_t peakLive: High-water mark of live
+ * 	uint64_t loads: Number of LOADPs from a segment other than 0
+ * 	uint64_t copies: Number of shared segments copied by a store
+ *
+*/
+typedef struct MemStats {
+	uint64_t maps;
+	uint64_t reused;
+	uint32_t live;
+	uint32_t peakLive;
+	uint64_t loads;
+	uint64_t copies;
+} MemStats;
+
+
+/* Mem_T
+ * Usage: Represents a Universal Machine's memory, with segmented memory
+ * and registers
+ * 
+ * Members:
+ * 	Segment *seg: Growable table of segments indexed by address, NULL
+ * 		where a segment is unmapped
+ * 	uint32_t numSegs: Number of addresses handed out so far (entries
+ * 		of seg in use)
+ * 	uint32_t segCapacity: Number of entries allocated for seg
+ * 	uint32_t *freeIds: Stack of unmapped addresses below numSegs, most
+ * 		recently unmapped on top
+ * 	uint32_t numFree: Number of addresses on freeIds
+ * 	uint32_t freeCapacity: Number of entries allocated for freeIds
+ * 	MemStats stats: Segment usage counters
+ * 	Slab_T slab: Allocator every segment comes from
+ * 	uint32_t reg[8]: The 8 registers r[0]-r[7]. The executor works on
+ * 		a local copy and writes it back when it stops.
+ * 	ProgCounter counter: Program counter, storing address/offset of next
+ * 	instruction to execute
+ * 	uint64_t retired: Instructions executed so far, as counted by
+ * 		execInstructions and the profiler (the JIT does not count)
+ *
+ * A Mem_T object is typedefed to be a pointer to a Mem_T struct instance.
+*/
+typedef struct Mem_T {
+	Segment *seg;
+	uint32_t numSegs;
+	uint32_t segCapacity;
+	uint32_t *freeIds;
+	uint32_t numFree;
+	uint32_t freeCapacity;
+	MemStats stats;
+	Slab_T slab;
+	uint32_t reg[8];
+	ProgCounter counter;
+	uint64_t retired;
+} *Mem_T;
+
+
+
+Mem_T initMem(int size);
+void freeMem(Mem_T mem);
+
+/* Memory/register getters and setters */
+uint32_t getMem(Mem_T mem, uint32_t address, int offset);
+uint32_t getReg(Mem_T mem, int index);
+void setMem(Mem_T mem, uint32_t word, uint32_t address, int offset);
+void setReg(Mem_T mem, uint32_t word, int index);
+
+/* Segment modifiers */
+uint32_t mapSeg(Mem_T mem, uint32_t size);
+void unmapSeg(Mem_T mem, uint32_t address);
+void dupeSeg(Mem_T mem, uint32_t address);
+Segment unshareSeg(Mem_T mem, uint32_t address);
+
+/* Code caches over segments */
+void trackCodePages(Segment segment);
+void invalidateCode(Segment segment, uint32_t offset);
+bool nextDirtyPage(Segment segment, uint32_t *page);
+
+void printMemStats(Mem_T mem, FILE *fp);
+
+void shiftProgCounter(ProgCounter pg, uint32_t address, int offset);
+
+#endif
@@ -0,0 +1,476 @@
+/*
+ *     filename: profile.c
+ *     partner 1 name: Jack Burton       Login: jburto05
+ *     partner 2 name: James Hartley        Login: jhartl01
+ *     date: April 9th, 2024
+ *     assignment: hw6
+ *
+ *     summary: Implements the --profile mode of um. The profiled machine
+ *     is its own loop around stepInstruction, so execInstructions does
+ *     no counting at all when profiling is off.
+ *
+*/
+
+#include <string.h>
+#include "profile.h"
+
+/* Opcode field values, including the two that are not instructions */
+#define NUM_OPS 16
+
+/* Size buckets: 0, then [2^(k-1), 2^k) words for k = 1..32 */
+#define SIZE_BUCKETS 33
+
+/* Rows printed in each ranked section of the report */
+#define HOT_SPOTS 20
+#define HOT_PAIRS 10
+
+static const char *opNames[NUM_OPS] = {
+        "CMOV", "SLOAD", "SSTORE", "ADD", "MUL", "DIV", "NAND", "HALT",
+        "MAP", "UNMAP", "OUT", "IN", "LOADP", "LOADV", "INVALID14",
+        "INVALID15"
+};
+
+/* Profile_T
+ * Usage: Counts collected while running a profiled machine
+ *
+ * Members:
+ * 	uint64_t total: Instructions executed
+ * 	uint64_t ops: Executions per opcode
+ * 	uint64_t pairs: Executions of opcode [i] directly followed by [j]
+ * 	uint64_t *hits: Per offset of segment 0, executions there
+ * 	uint8_t *lastOp: Per offset, the opcode last executed there
+ * 	uint32_t length: Number of offsets hits and lastOp hold
+ * 	uint64_t mapSizes, unmapSizes: Segments mapped and unmapped, by
+ * 		size bucket
+ * 	uint64_t programLoads: LOADPs that replaced segment 0
+ * 	uint32_t *symOffsets: Offsets of the labels of a symbol map, in
+ * 		increasing order, or NULL if none was loaded
+ * 	char **symNames: Name of the label at each of symOffsets
+ * 	uint32_t numSymbols: Number of labels
+ *
+*/
+struct Profile_T {
+        uint64_t total;
+        uint64_t ops[NUM_OPS];
+        uint64_t pairs[NUM_OPS][NUM_OPS];
+        uint64_t *hits;
+        uint8_t *lastOp;
+        uint32_t length;
+        uint64_t mapSizes[SIZE_BUCKETS];
+        uint64_t unmapSizes[SIZE_BUCKETS];
+        uint64_t programLoads;
+        uint32_t *symOffsets;
+        char **symNames;
+        uint32_t numSymbols;
+};
+
+/********** initProfile ********
+ *
+ * Creates a profile with every count at zero
+ *
+ * Parameters: None
+ *
+ * Return: pointer to initialized Profile_T struct
+ *
+ ************************/
+Profile_T initProfile(void)
+{
+        Profile_T prof = calloc(1, sizeof(*prof));
+        assert(prof != NULL);
+        return prof;
+}
+
+/********** freeProfile ********
+ *
+ * Frees a profile and its per-offset counts
+ *
+ * Parameters:
+ *     Profile_T prof: Profile to free, or NULL
+ *
+ * Return: None
+ *
+ ************************/
+void freeProfile(Profile_T prof)
+{
+        if (prof == NULL) {
+                return;
+        }
+        for (uint32_t i = 0; i < prof->numSymbols; i++) {
+                free(prof->symNames[i]);
+        }
+        free(prof->symOffsets);
+        free(prof->symNames);
+        free(prof->hits);
+        free(prof->lastOp);
+        free(prof);
+}
+
+/********** loadSymbols ********
+ *
+ * Reads a symbol map, as umasm --map writes, so that the report can
+ * name offsets by the label at or before them
+ *
+ * Parameters:
+ *     Profile_T prof: Profile to name offsets in
+ *     const char *path: Map file: "OFFSET NAME" lines in increasing
+ *                       offset order, and '#' comment lines
+ *
+ * Return: true, or false if it cannot be read or a line is malformed
+ *
+ ************************/
+bool loadSymbols(Profile_T prof, const char *path)
+{
+        FILE *fp = fopen(path, "r");
+        if (fp == NULL) {
+                return false;
+        }
+        uint32_t capacity = 0;
+        char line[512], name[512];
+        bool ok = true;
+        while (ok && fgets(line, sizeof(line), fp) != NULL) {
+                unsigned offset;
+                if (line[0] == '#' || line[0] == '\n') {
+                        continue;
+                }
+                ok = sscanf(line, "%u %511s", &offset, name) == 2 &&
+                     (prof->numSymbols == 0 ||
+                      offset >= prof->symOffsets[prof->numSymbols - 1]);
+                if (!ok) {
+                        break;
+                }
+                if (prof->numSymbols == capacity) {
+                        capacity = 2 * capacity + 64;
+                        prof->symOffsets = realloc(prof->symOffsets,
+                                                   capacity *
+                                                   sizeof(uint32_t));
+                        prof->symNames = realloc(prof->symNames,
+                                                 capacity * sizeof(char *));
+                        assert(prof->symOffsets != NULL &&
+                               prof->symNames != NULL);
+                }
+                char *copy = malloc(strlen(name) + 1);
+                assert(copy != NULL);
+                strcpy(copy, name);
+                prof->symOffsets[prof->numSymbols] = offset;
+                prof->symNames[prof->numSymbols++] = copy;
+        }
+        ok = ok && !ferror(fp);
+        fclose(fp);
+        return ok;
+}
+
+/* Ends a report line with the opcode last run at an offset and, if
+ * symbols were loaded, where it is as "label+N" ("label" at the label
+ * itself, "-" before every label) */
+static void printWhere(Profile_T prof, FILE *fp, uint32_t offset)
+{
+        const char *op = opNames[prof->lastOp[offset]];
+        uint32_t lo = 0, hi = prof->numSymbols;
+        if (prof->symOffsets == NULL) {
+                fprintf(fp, "%s\n", op);
+                return;
+        }
+        while (lo < hi) {
+                uint32_t mid = lo + (hi - lo) / 2;
+                if (prof->symOffsets[mid] <= offset) {
+                        lo = mid + 1;
+                } else {
+                        hi = mid;
+                }
+        }
+        if (lo == 0) {
+                fprintf(fp, "%-9s -\n", op);
+        } else if (offset == prof->symOffsets[lo - 1]) {
+                fprintf(fp, "%-9s %s\n", op, prof->symNames[lo - 1]);
+        } else {
+                fprintf(fp, "%-9s %s+%u\n", op, prof->symNames[lo - 1],
+                        (unsigned)(offset - prof->symOffsets[lo - 1]));
+        }
+}
+
+/********** growOffsets ********
+ *
+ * Makes room for per-offset counts of a program of a given length
+ *
+ * Parameters:
+ *     Profile_T prof: Profile to grow
+ *     uint32_t length: Number of offsets needed
+ *
+ * Return: None
+ *
+ ************************/
+static void growOffsets(Profile_T prof, uint32_t length)
+{
+        prof->hits = realloc(prof->hits, length * sizeof(*prof->hits));
+        prof->lastOp = realloc(prof->lastOp, length);
+        assert(prof->hits != NULL && prof->lastOp != NULL);
+        memset(prof->hits + prof->length, 0,
+               (length - prof->length) * sizeof(*prof->hits));
+        memset(prof->lastOp + prof->length, 0, length - prof->length);
+        prof->length = length;
+}
+
+/* Bucket of a segment size: 0 for 0, else its bit length */
+static int sizeBucket(uint32_t size)
+{
+        int bucket = 0;
+        while (size != 0) {
+                bucket++;
+                size >>= 1;
+        }
+        return bucket;
+}
+
+/********** profExecInstructions ********
+ *
+ * Runs the machine like execInstructions, counting every instruction
+ *
+ * Parameters:
+ *     Profile_T prof: Profile to add the counts to
+ *     Mem_T mem: Pointer to memory struct
+ *     IODev_T io: I/O device used by IN and OUT
+ *     const RunLimits *limits: Budget and deadline, or NULL for none
+ *
+ * Return: RUN_HALTED, or why the machine stopped before halting
+ *
+ * Notes
+ *      Offsets are counted in whatever program is in segment 0 when they
+ *      run, so after a LOADP from another segment the hot spots mix
+ *      programs; programLoads says whether that happened. Unlike
+ *      execInstructions, a budget stops the machine at exactly its
+ *      count.
+ ************************/
+Run_status profExecInstructions(Profile_T prof, Mem_T mem, IODev_T io,
+                                const RunLimits *limits)
+{
+        assert(prof != NULL && mem != NULL && io != NULL);
+
+        uint32_t *r = mem->reg;
+        uint32_t offset = mem->counter->offset;
+        uint64_t nextCheck;
+        Run_status status = checkLimits(limits, mem->retired, &nextCheck);
+        int prev = -1;
+        while (status == RUN_HALTED) {
+                Segment program = mem->seg[0];
+#ifdef UM_SAFE
+                if (offset >= program->length) {
+                        /* Reports the fault, and does not return */
+                        stepInstruction(mem, io, &offset);
+                }
+#endif
+                assert(offset < program->length);
+                if (program->length > prof->length) {
+                        growOffsets(prof, program->length);
+                }
+
+                uint32_t word = program->words[offset];
+                int op = word >> 28;
+                prof->total++;
+                prof->ops[op]++;
+                prof->hits[offset]++;
+                prof->lastOp[offset] = op;
+                if (prev >= 0) {
+                        prof->pairs[prev][op]++;
+                }
+                prev = op;
+
+                if (op == MAP) {
+                        prof->mapSizes[sizeBucket(r[word & 0x7])]++;
+                } else if (op == UNMAP) {
+                        Segment seg = mem->seg[r[word & 0x7]];
+                        prof->unmapSizes[sizeBucket(seg->length)]++;
+                } else if (op == LOADP && r[(word >> 3) & 0x7] != 0) {
+                        prof->programLoads++;
+                }
+
+                if (!stepInstruction(mem, io, &offset)) {
+                        status = stopStatus(mem, offset);
+                        mem->retired += status == RUN_HALTED;
+                        break;
+                }
+                if (++mem->retired >= nextCheck) {
+                        status = checkLimits(limits, mem->retired, 
+                                             &nextCheck);
+                }
+        }
+        shiftProgCounter(mem->counter, 0, offset);
+        return status;
+}
+
+/* Hits at offset, for ranking offsets with qsort */
+static const uint64_t *sortHits;
+static int byHits(const void *x, const void *y)
+{
+        uint64_t hx = sortHits[*(const uint32_t *)x];
+        uint64_t hy = sortHits[*(const uint32_t *)y];
+        if (hx != hy) {
+                return hx < hy ? 1 : -1;
+        }
+        return *(const uint32_t *)x < *(const uint32_t *)y ? -1 : 1;
+}
+
+/********** rankOffsets ********
+ *
+ * Lists the offsets that ran at least once, most executed first
+ *
+ * Parameters:
+ *     Profile_T prof: Profile to rank
+ *     uint32_t *count: Set to the number of offsets listed
+ *
+ * Return: Array of offsets, which the caller must free
+ *
+ ************************/
+static uint32_t *rankOffsets(Profile_T prof, uint32_t *count)
+{
+        uint32_t *order = malloc(((size_t)prof->length + 1) *
+                                 sizeof(*order));
+        assert(order != NULL);
+        uint32_t n = 0;
+        for (uint32_t i = 0; i < prof->length; i++) {
+                if (prof->hits[i] != 0) {
+                        order[n++] = i;
+                }
+        }
+        sortHits = prof->hits;
+        qsort(order, n, sizeof(*order), byHits);
+        *count = n;
+        return order;
+}
+
+static double percent(uint64_t part, uint64_t whole)
+{
+        return whole == 0 ? 0.0 : 100.0 * part / whole;
+}
+
+/* Prints the nonempty buckets of a size distribution */
+static void printSizes(FILE *fp, const char *title,
+                       const uint64_t sizes[SIZE_BUCKETS])
+{
+        fprintf(fp, "\n%s (words):\n", title);
+        for (int k = 0; k < SIZE_BUCKETS; k++) {
+                if (sizes[k] == 0) {
+                        continue;
+                }
+                if (k == 0) {
+                        fprintf(fp, "  %21u  %12llu\n", 0u,
+                                (unsigned long long)sizes[k]);
+                } else {
+                        fprintf(fp, "  %10llu-%-10llu  %12llu\n",
+                                1ULL << (k - 1), (1ULL << k) - 1,
+                                (unsigned long long)sizes[k]);
+                }
+        }
+}
+
+/********** printProfile ********
+ *
+ * Prints the opcode histogram, the hottest offsets and opcode pairs, and
+ * the MAP and UNMAP size distributions
+ *
+ * Parameters:
+ *     Profile_T prof: Profile to report on
+ *     FILE *fp: Stream to print to
+ *
+ * Return: None
+ *
+ ************************/
+void printProfile(Profile_T prof, FILE *fp)
+{
+        fprintf(fp, "instructions executed: %llu\n",
+                (unsigned long long)prof->total);
+        fprintf(fp, "program loads:         %llu\n",
+                (unsigned long long)prof->programLoads);
+
+        fprintf(fp, "\nopcode      executions  percent\n");
+        for (int op = 0; op < NUM_OPS; op++) {
+                if (prof->ops[op] != 0) {
+                        fprintf(fp, "%-9s %12llu  %6.2f%%\n", opNames[op],
+                                (unsigned long long)prof->ops[op],
+                                percent(prof->ops[op], prof->total));
+                }
+        }
+
+        uint32_t n;
+        uint32_t *order = rankOffsets(prof, &n);
+        fprintf(fp, "\nhot spots    offset    executions  percent  "
+                    "opcode%s\n", prof->symOffsets ? "     label" : "");
+        for (uint32_t i = 0; i < n && i < HOT_SPOTS; i++) {
+                uint32_t offset = order[i];
+                fprintf(fp, "%9u %9u  %12llu  %6.2f%%  ", i + 1,
+                        offset, (unsigned long long)prof->hits[offset],
+                        percent(prof->hits[offset], prof->total));
+                printWhere(prof, fp, offset);
+        }
+        free(order);
+
+        fprintf(fp, "\nhot pairs               executions  percent\n");
+        bool shown[NUM_OPS][NUM_OPS] = {{false}};
+        for (int row = 0; row < HOT_PAIRS; row++) {
+                int bestI = -1, bestJ = -1;
+                for (int i = 0; i < NUM_OPS; i++) {
+                        for (int j = 0; j < NUM_OPS; j++) {
+                                if (!shown[i][j] && prof->pairs[i][j] != 0 &&
+                                    (bestI < 0 || prof->pairs[i][j] >
+                                                  prof->pairs[bestI][bestJ])) {
+                                        bestI = i;
+                                        bestJ = j;
+                                }
+                        }
+                }
+                if (bestI < 0) {
+                        break;
+                }
+                shown[bestI][bestJ] = true;
+                fprintf(fp, "%-9s %-9s %12llu  %6.2f%%\n", opNames[bestI],
+                        opNames[bestJ],
+                        (unsigned long long)prof->pairs[bestI][bestJ],
+                        percent(prof->pairs[bestI][bestJ], prof->total));
+        }
+
+        printSizes(fp, "MAP sizes", prof->mapSizes);
+        printSizes(fp, "UNMAP sizes", prof->unmapSizes);
+}
+
+/********** writeFlatProfile ********
+ *
+ * Writes one line per executed offset, most executed first, in the
+ * columns of a flat profile
+ *
+ * Parameters:
+ *     Profile_T prof: Profile to write
+ *     const char *path: File to create or overwrite
+ *
+ * Return: true on success, false if the file could not be written
+ *
+ * Notes
+ *      Lines starting with '#' are headers; the rest are whitespace
+ *      separated: percent, cumulative percent, executions, offset,
+ *      opcode, and the label+N of the offset if symbols were loaded
+ ************************/
+bool writeFlatProfile(Profile_T prof, const char *path)
+{
+        FILE *fp = fopen(path, "w");
+        if (fp == NULL) {
+                return false;
+        }
+
+        fprintf(fp, "# um flat profile: %llu instructions\n",
+                (unsigned long long)prof->total);
+        fprintf(fp, "# %%time  cumulative    executions     offset  "
+                    "opcode%s\n", prof->symOffsets ? "     label" : "");
+        uint32_t n;
+        uint32_t *order = rankOffsets(prof, &n);
+        uint64_t cumulative = 0;
+        for (uint32_t i = 0; i < n; i++) {
+                uint32_t offset = order[i];
+                cumulative += prof->hits[offset];
+                fprintf(fp, "%7.2f  %10.2f  %12llu  %9u  ",
+                        percent(prof->hits[offset], prof->total),
+                        percent(cumulative, prof->total),
+                        (unsigned long long)prof->hits[offset], offset);
+                printWhere(prof, fp, offset);
+        }
+        free(order);
+
+        return fclose(fp) == 0;
+}
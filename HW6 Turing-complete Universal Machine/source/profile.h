@@ -0,0 +1,28 @@
+/*
+ *     filename: profile.h
+ *     partner 1 name: Jack Burton       Login: jburto05
+ *     partner 2 name: James Hartley        Login: jhartl01
+ *     date: April 9th, 2024
+ *     assignment: hw6
+ *
+ *     summary: Defines an instruction-level profiler that runs the machine
+ *     one counted instruction at a time
+ *
+*/
+
+#ifndef PROFILE_INCLUDED
+#define PROFILE_INCLUDED
+
+#include "memexec.h"
+
+typedef struct Profile_T *Profile_T;
+
+Profile_T initProfile(void);
+void freeProfile(Profile_T prof);
+bool loadSymbols(Profile_T prof, const char *path);
+Run_status profExecInstructions(Profile_T prof, Mem_T mem, IODev_T io,
+                                const RunLimits *limits);
+void printProfile(Profile_T prof, FILE *fp);
+bool writeFlatProfile(Profile_T prof, const char *path);
+
+#endif
@@ -0,0 +1,369 @@
+/*
+ *     filename: slab.c
+ *     partner 1 name: Jack Burton       Login: jburto05
+ *     partner 2 name: James Hartley        Login: jhartl01
+ *     date: April 10th, 2024
+ *     assignment: hw6
+ *
+ *     summary: Implements the segment allocator. Blocks up to
+ *     SLAB_MAX_BYTES come from per-class free lists, refilled by carving
+ *     arenas; bigger blocks are mmapped on their own, and from
+ *     SLAB_HUGE_BYTES up are aligned for and advised to use transparent
+ *     huge pages. Each Mem_T has its own Slab_T, so machines never share
+ *     allocator state.
+ *
+*/
+
+#define _DEFAULT_SOURCE
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <sys/mman.h>
+#include "slab.h"
+
+/* Smallest class, in bytes: a segment header and four words */
+#define SLAB_MIN_SHIFT 5
+#define SLAB_CLASSES 12
+#define SLAB_MAX_BYTES ((size_t)1 << (SLAB_MIN_SHIFT + SLAB_CLASSES - 1))
+
+/* Size of a huge page, and of the smallest block mapped to use them */
+#define SLAB_HUGE_BYTES ((size_t)2 << 20)
+
+/* Bytes between the addresses prefaulting touches */
+#define SLAB_TOUCH_BYTES 4096
+
+/* Bytes mmapped per arena; the first block is the arena's own header */
+#define SLAB_ARENA_BYTES ((size_t)1 << 20)
+#define SLAB_ARENA_HEADER 64
+
+/* ClassStats
+ * Usage: Counters for one size class
+ *
+ * Members:
+ * 	uint64_t allocs: Blocks handed out
+ * 	uint64_t reused: Of those, blocks taken from the free list
+ * 	uint64_t live: Blocks currently handed out
+ * 	uint64_t peakLive: High-water mark of live
+ *
+*/
+typedef struct ClassStats {
+        uint64_t allocs;
+        uint64_t reused;
+        uint64_t live;
+        uint64_t peakLive;
+} ClassStats;
+
+/* Slab_T
+ * Usage: State of one segment allocator
+ *
+ * Members:
+ * 	void *freeList: Per class, freed blocks linked through their first
+ * 		pointer
+ * 	char *arenas: Arenas mapped so far, linked through their headers
+ * 	char *next, *end: Uncarved space in the newest arena
+ * 	ClassStats stats: Per class counters, large for other mmapped
+ * 		blocks and huge for those on the huge-page path
+ * 	uint64_t hugeBytes: Bytes mapped on the huge-page path
+ * 	uint64_t unadvised: Blocks on that path the kernel would not
+ * 		advise to use huge pages (so they use normal ones)
+ * 	uint64_t numArenas: Arenas mapped
+ * 	bool prefault: Whether huge-page blocks are touched when mapped
+ *
+*/
+struct Slab_T {
+        void *freeList[SLAB_CLASSES];
+        char *arenas;
+        char *next;
+        char *end;
+        ClassStats stats[SLAB_CLASSES];
+        ClassStats large;
+        ClassStats huge;
+        uint64_t hugeBytes;
+        uint64_t unadvised;
+        uint64_t numArenas;
+        bool prefault;
+};
+
+/********** initSlab ********
+ *
+ * Creates an allocator with no arenas
+ *
+ * Parameters: None
+ *
+ * Return: pointer to initialized Slab_T struct
+ *
+ ************************/
+Slab_T initSlab(void)
+{
+        Slab_T slab = calloc(1, sizeof(*slab));
+        assert(slab != NULL);
+        return slab;
+}
+
+/********** freeSlab ********
+ *
+ * Unmaps every arena of an allocator, and the allocator
+ *
+ * Parameters:
+ *     Slab_T slab: Allocator to free
+ *
+ * Return: None
+ *
+ * Notes
+ *      Blocks still handed out from arenas are freed with them; large
+ *      blocks must have been given back with slabFree.
+ ************************/
+void freeSlab(Slab_T slab)
+{
+        char *arena = slab->arenas;
+        while (arena != NULL) {
+                char *next;
+                memcpy(&next, arena, sizeof(next));
+                munmap(arena, SLAB_ARENA_BYTES);
+                arena = next;
+        }
+        free(slab);
+}
+
+/* Size class of a block of at most SLAB_MAX_BYTES */
+static int sizeClass(size_t bytes)
+{
+        int k = 0;
+        while (((size_t)1 << (SLAB_MIN_SHIFT + k)) < bytes) {
+                k++;
+        }
+        return k;
+}
+
+/* Maps a fresh block, zeroed by the kernel, or returns NULL (with errno
+ * set by mmap) if there is no memory for it */
+static void *mapBlock(size_t bytes)
+{
+        void *block = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        return block == MAP_FAILED ? NULL : block;
+}
+
+/* Bytes mapped for a block on the huge-page path: whole huge pages */
+static size_t hugeLength(size_t bytes)
+{
+        return (bytes + SLAB_HUGE_BYTES - 1) & ~(SLAB_HUGE_BYTES - 1);
+}
+
+/********** mapHuge ********
+ *
+ * Maps a zeroed block on a huge-page boundary and asks the kernel to
+ * back it with transparent huge pages
+ *
+ * Parameters:
+ *     Slab_T slab: Allocator, whose prefault setting is used and whose
+ *                  unadvised count goes up if the kernel refuses the
+ *                  advice
+ *     size_t bytes: Size of the block, at least SLAB_HUGE_BYTES
+ *
+ * Return: Pointer to the block, hugeLength(bytes) bytes long, or NULL
+ *         if there is no memory for it
+ *
+ * Notes
+ *      Over-maps by one huge page and unmaps the slack either side, so
+ *      the block is aligned and can be freed with one munmap. Without
+ *      prefault, pages are placed wherever the machine first touches
+ *      them; with it, they are all faulted in (and so placed on the
+ *      mapping thread's NUMA node) before MAP returns. A refused
+ *      madvise (transparent huge pages disabled, say) is not an error:
+ *      the block is still good, on normal pages.
+ ************************/
+static void *mapHuge(Slab_T slab, size_t bytes)
+{
+        size_t length = hugeLength(bytes);
+        char *raw = mapBlock(length + SLAB_HUGE_BYTES);
+        if (raw == NULL) {
+                return NULL;
+        }
+        char *block = (char *)(((uintptr_t)raw + SLAB_HUGE_BYTES - 1) & 
+                               ~(uintptr_t)(SLAB_HUGE_BYTES - 1));
+        if (block > raw) {
+                munmap(raw, block - raw);
+        }
+        munmap(block + length, raw + SLAB_HUGE_BYTES - block);
+#ifdef MADV_HUGEPAGE
+        if (madvise(block, length, MADV_HUGEPAGE) != 0) {
+                slab->unadvised++;
+        }
+#else
+        slab->unadvised++;
+#endif
+        if (slab->prefault) {
+                for (size_t i = 0; i < length; i += SLAB_TOUCH_BYTES) {
+                        ((volatile char *)block)[i] = 0;
+                }
+        }
+        return block;
+}
+
+static void countAlloc(ClassStats *stats, bool reused)
+{
+        stats->allocs++;
+        stats->reused += reused;
+        if (++stats->live > stats->peakLive) {
+                stats->peakLive = stats->live;
+        }
+}
+
+/********** slabAlloc ********
+ *
+ * Allocates a zeroed block
+ *
+ * Parameters:
+ *     Slab_T slab: Allocator
+ *     size_t bytes: Size of the block
+ *
+ * Return: Pointer to bytes zero bytes, aligned for any segment, or NULL
+ *         (with errno set) if no memory could be mapped for it
+ *
+ * Notes
+ *      Constant time apart from zeroing. Blocks carved from an arena or
+ *      mapped are already zero; a reused block is zeroed here, and only
+ *      for the bytes asked for rather than its whole class.
+ ************************/
+void *slabAlloc(Slab_T slab, size_t bytes)
+{
+        if (bytes >= SLAB_HUGE_BYTES) {
+                void *block = mapHuge(slab, bytes);
+                if (block != NULL) {
+                        countAlloc(&slab->huge, false);
+                        slab->hugeBytes += hugeLength(bytes);
+                }
+                return block;
+        }
+        if (bytes > SLAB_MAX_BYTES) {
+                void *block = mapBlock(bytes);
+                if (block != NULL) {
+                        countAlloc(&slab->large, false);
+                }
+                return block;
+        }
+
+        int k = sizeClass(bytes);
+        void *block = slab->freeList[k];
+        if (block != NULL) {
+                memcpy(&slab->freeList[k], block, sizeof(void *));
+                memset(block, 0, bytes);
+                countAlloc(&slab->stats[k], true);
+                return block;
+        }
+
+        size_t classBytes = (size_t)1 << (SLAB_MIN_SHIFT + k);
+        if ((size_t)(slab->end - slab->next) < classBytes) {
+                char *arena = mapBlock(SLAB_ARENA_BYTES);
+                if (arena == NULL) {
+                        return NULL;
+                }
+                memcpy(arena, &slab->arenas, sizeof(slab->arenas));
+                slab->arenas = arena;
+                slab->next = arena + SLAB_ARENA_HEADER;
+                slab->end = arena + SLAB_ARENA_BYTES;
+                slab->numArenas++;
+        }
+        block = slab->next;
+        slab->next += classBytes;
+        countAlloc(&slab->stats[k], false);
+        return block;
+}
+
+/********** slabFree ********
+ *
+ * Gives a block back to its allocator
+ *
+ * Parameters:
+ *     Slab_T slab: Allocator the block came from
+ *     void *block: Block from slabAlloc
+ *     size_t bytes: The size it was allocated with
+ *
+ * Return: None
+ *
+ ************************/
+void slabFree(Slab_T slab, void *block, size_t bytes)
+{
+        if (bytes >= SLAB_HUGE_BYTES) {
+                munmap(block, hugeLength(bytes));
+                slab->huge.live--;
+                return;
+        }
+        if (bytes > SLAB_MAX_BYTES) {
+                munmap(block, bytes);
+                slab->large.live--;
+                return;
+        }
+
+        int k = sizeClass(bytes);
+        memcpy(block, &slab->freeList[k], sizeof(void *));
+        slab->freeList[k] = block;
+        slab->stats[k].live--;
+}
+
+/********** slabPrefault ********
+ *
+ * Sets whether blocks on the huge-page path are touched when mapped
+ *
+ * Parameters:
+ *     Slab_T slab: Allocator
+ *     bool prefault: true to fault every page in at MAP time, binding it
+ *                    to the mapping thread's node; false (the default)
+ *                    to leave placement to the first instruction that
+ *                    touches it
+ *
+ * Return: None
+ *
+ ************************/
+void slabPrefault(Slab_T slab, bool prefault)
+{
+        slab->prefault = prefault;
+}
+
+/********** printSlabStats ********
+ *
+ * Prints, for each size class used, how many blocks were allocated, how
+ * many of those were reused from the free list and the most live at once
+ *
+ * Parameters:
+ *     Slab_T slab: Allocator to report on
+ *     FILE *fp: Stream to print to
+ *
+ * Return: None
+ *
+ ************************/
+void printSlabStats(Slab_T slab, FILE *fp)
+{
+        fprintf(fp, "slab arenas:         %llu (%llu KiB each)\n",
+                (unsigned long long)slab->numArenas,
+                (unsigned long long)(SLAB_ARENA_BYTES >> 10));
+        fprintf(fp, "slab class     allocs        reused     peak live\n");
+        for (int k = 0; k < SLAB_CLASSES; k++) {
+                ClassStats *stats = &slab->stats[k];
+                if (stats->allocs == 0) {
+                        continue;
+                }
+                fprintf(fp, "%8lluB %12llu  %12llu  %12llu\n",
+                        1ULL << (SLAB_MIN_SHIFT + k),
+                        (unsigned long long)stats->allocs,
+                        (unsigned long long)stats->reused,
+                        (unsigned long long)stats->peakLive);
+        }
+        if (slab->large.allocs != 0) {
+                fprintf(fp, "%9s %12llu  %12s  %12llu\n", "mmap",
+                        (unsigned long long)slab->large.allocs, "-",
+                        (unsigned long long)slab->large.peakLive);
+        }
+        fprintf(fp, "huge-page segments:  %llu (%llu MiB, peak live %llu)\n",
+                (unsigned long long)slab->huge.allocs,
+                (unsigned long long)(slab->hugeBytes >> 20),
+                (unsigned long long)slab->huge.peakLive);
+        if (slab->unadvised != 0) {
+                fprintf(fp, "  not on huge pages: %llu (madvise refused)\n",
+                        (unsigned long long)slab->unadvised);
+        }
+}
@@ -0,0 +1,30 @@
+/*
+ *     filename: slab.h
+ *     partner 1 name: Jack Burton       Login: jburto05
+ *     partner 2 name: James Hartley        Login: jhartl01
+ *     date: April 10th, 2024
+ *     assignment: hw6
+ *
+ *     summary: Defines a slab allocator for UM segments: power-of-two
+ *     size classes carved from large arenas, with big blocks mapped
+ *     directly and the biggest on transparent huge pages
+ *
+*/
+
+#ifndef SLAB_INCLUDED
+#define SLAB_INCLUDED
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+typedef struct Slab_T *Slab_T;
+
+Slab_T initSlab(void);
+void freeSlab(Slab_T slab);
+void *slabAlloc(Slab_T slab, size_t bytes);
+void slabFree(Slab_T slab, void *block, size_t bytes);
+void slabPrefault(Slab_T slab, bool prefault);
+void printSlabStats(Slab_T slab, FILE *fp);
+
+#endif
@@ -0,0 +1,279 @@
+/*
+ *     filename: snapshot.c
+ *     partner 1 name: Jack Burton       Login: jburto05
+ *     partner 2 name: James Hartley        Login: jhartl01
+ *     date: April 9th, 2024
+ *     assignment: hw6
+ *
+ *     summary: Implements machine snapshots. A snapshot holds the
+ *     registers, the program counter, the segment table and every mapped
+ *     segment, as host-order 32-bit words so that it can be mmapped and
+ *     copied straight into memory, and the input the machine had read but
+ *     not yet consumed.
+ *
+*/
+
+#define _DEFAULT_SOURCE
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "snapshot.h"
+
+/* Identifies a snapshot file, and the layout version */
+static const char SNAP_MAGIC[8] = "UMSNAP2\n";
+
+/* SnapHeader
+ * Usage: Start of a snapshot file
+ *
+ * Members:
+ * 	char magic[8]: SNAP_MAGIC
+ * 	uint32_t reg[8]: Registers
+ * 	uint32_t offset: Offset in segment 0 of the next instruction
+ * 	uint32_t numSegs: Addresses handed out (Mem_T's numSegs)
+ * 	uint32_t numFree: Entries on the free-ID stack
+ * 	uint32_t numMapped: Segments that follow
+ * 	uint64_t retired: Instructions executed before the snapshot
+ * 	uint32_t numInput: Bytes of buffered input IN had not consumed
+ *
+ * The header is followed by the free-ID stack (numFree words, bottom
+ * first), then by numMapped segments, each an address word, a length
+ * word and length words of contents, and last by the numInput bytes of
+ * input.
+*/
+typedef struct SnapHeader {
+        char magic[8];
+        uint32_t reg[8];
+        uint32_t offset;
+        uint32_t numSegs;
+        uint32_t numFree;
+        uint32_t numMapped;
+        uint64_t retired;
+        uint32_t numInput;
+} SnapHeader;
+
+/********** writeSnapshot ********
+ *
+ * Writes the state of a stopped machine to a stream
+ *
+ * Parameters:
+ *     Mem_T mem: Memory of a machine execInstructions has returned from,
+ *                or that a stepInstruction loop has stopped stepping
+ *     IODev_T io: The machine's I/O device
+ *     FILE *fp: Stream to write to, left open
+ *
+ * Return: true on success, false if a write failed
+ *
+ * Notes
+ *      A segment shared by LOADP is written once per address that maps
+ *      it, so a restored machine has its own copy at each. Input read
+ *      ahead of IN is saved with it, so a restored machine sees the same
+ *      bytes before going on to its own input.
+ ************************/
+bool writeSnapshot(Mem_T mem, IODev_T io, FILE *fp)
+{
+        assert(mem != NULL && fp != NULL);
+
+        SnapHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, SNAP_MAGIC, sizeof(header.magic));
+        memcpy(header.reg, mem->reg, sizeof(header.reg));
+        header.offset = mem->counter->offset;
+        header.numSegs = mem->numSegs;
+        header.numFree = mem->numFree;
+        header.numMapped = mem->numSegs - mem->numFree;
+        header.retired = mem->retired;
+        const unsigned char *input;
+        header.numInput = unreadInput(io, &input);
+
+        bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+        ok = ok && fwrite(mem->freeIds, sizeof(uint32_t), mem->numFree,
+                          fp) == mem->numFree;
+        for (uint32_t address = 0; ok && address < mem->numSegs; address++) {
+                Segment segment = mem->seg[address];
+                if (segment == NULL) {
+                        continue;
+                }
+                uint32_t prefix[2] = { address, segment->length };
+                ok = fwrite(prefix, sizeof(prefix), 1, fp) == 1 &&
+                     fwrite(segment->words, sizeof(uint32_t),
+                            segment->length, fp) == segment->length;
+        }
+        ok = ok && fwrite(input, 1, header.numInput, fp) == header.numInput;
+        return ok;
+}
+
+/********** saveSnapshot ********
+ *
+ * Writes the state of a stopped machine to a file, with writeSnapshot
+ *
+ * Parameters:
+ *     Mem_T mem: Memory of a machine execInstructions has returned from
+ *     IODev_T io: The machine's I/O device
+ *     const char *path: File to create or overwrite
+ *
+ * Return: true on success, false if the file could not be written
+ *
+ ************************/
+bool saveSnapshot(Mem_T mem, IODev_T io, const char *path)
+{
+        FILE *fp = fopen(path, "wb");
+        if (fp == NULL) {
+                return false;
+        }
+        bool ok = writeSnapshot(mem, io, fp);
+        return fclose(fp) == 0 && ok;
+}
+
+/********** readSnapshot ********
+ *
+ * Rebuilds a machine from a snapshot held in memory
+ *
+ * Parameters:
+ *     const void *image: Snapshot written by writeSnapshot, aligned for
+ *                        32-bit words
+ *     size_t size: Bytes of image
+ *     IODev_T io: I/O device for the restored machine, with no input
+ *                 buffered; the saved unread input is buffered in it
+ *
+ * Return: Memory ready for execInstructions to resume, or NULL if image
+ *         is not a well-formed snapshot or there is no memory for its
+ *         segments
+ *
+ * Notes
+ *      Every address is mapped in order and the free ones unmapped again
+ *      in stack order, so later MAPs hand out the same addresses as the
+ *      original run would have. Segment counters start from the restored
+ *      state.
+ ************************/
+Mem_T readSnapshot(const void *image, size_t size, IODev_T io)
+{
+        if (size < sizeof(SnapHeader)) {
+                return NULL;
+        }
+        const SnapHeader *header = image;
+        const uint32_t *words = (const uint32_t *)(header + 1);
+        size_t numWords = (size - sizeof(*header)) / sizeof(uint32_t);
+        if (memcmp(header->magic, SNAP_MAGIC, sizeof(header->magic)) != 0 ||
+            header->numFree > numWords || header->numSegs == 0 ||
+            header->numMapped + header->numFree != header->numSegs) {
+                return NULL;
+        }
+
+        /* Walk the segment records once to check them before mapping */
+        const uint32_t *freeIds = words;
+        size_t at = header->numFree;
+        uint32_t last = 0;
+        for (uint32_t i = 0; i < header->numMapped; i++) {
+                if (numWords - at < 2 || words[at] >= header->numSegs ||
+                    (i > 0 && words[at] <= last) ||
+                    (i == 0 && words[at] != 0) ||
+                    numWords - at - 2 < words[at + 1]) {
+                        return NULL;
+                }
+                last = words[at];
+                at += 2 + (size_t)words[at + 1];
+        }
+
+        const unsigned char *input = (const unsigned char *)(words + at);
+        if (header->numMapped == 0 || 
+            header->offset >= words[header->numFree + 1] ||
+            header->numInput > IO_BUFSIZE ||
+            (size_t)((const unsigned char *)image + size - input) != 
+            header->numInput) {
+                return NULL;
+        }
+
+        Mem_T mem = initMem(words[header->numFree + 1] * 4);
+        if (mem == NULL) {
+                return NULL;
+        }
+        bool *isFree = malloc(header->numSegs * sizeof(bool));
+        assert(isFree != NULL);
+        memset(isFree, true, header->numSegs * sizeof(bool));
+        at = header->numFree;
+        bool mapped = true;
+        for (uint32_t i = 0; mapped && i < header->numMapped; i++) {
+                uint32_t address = words[at];
+                uint32_t length = words[at + 1];
+                while (mapped && mem->numSegs < address) {
+                        mapped = mapSeg(mem, 0) != 0;
+                }
+                if (mapped && address > 0) {
+                        mapped = mapSeg(mem, length) != 0;
+                }
+                if (mapped) {
+                        isFree[address] = false;
+                        memcpy(mem->seg[address]->words, words + at + 2,
+                               (size_t)length * sizeof(uint32_t));
+                }
+                at += 2 + (size_t)length;
+        }
+        while (mapped && mem->numSegs < header->numSegs) {
+                mapped = mapSeg(mem, 0) != 0;
+        }
+        if (!mapped) {
+                free(isFree);
+                freeMem(mem);
+                return NULL;
+        }
+        for (uint32_t i = 0; i < header->numFree; i++) {
+                uint32_t address = freeIds[i];
+                if (address >= mem->numSegs || !isFree[address]) {
+                        free(isFree);
+                        freeMem(mem);
+                        return NULL;
+                }
+                isFree[address] = false;
+                unmapSeg(mem, address);
+        }
+        free(isFree);
+
+        memcpy(mem->reg, header->reg, sizeof(mem->reg));
+        shiftProgCounter(mem->counter, 0, header->offset);
+        mem->retired = header->retired;
+        memset(&mem->stats, 0, sizeof(mem->stats));
+        mem->stats.maps = header->numMapped;
+        mem->stats.live = mem->stats.peakLive = header->numMapped;
+        pushInput(io, input, header->numInput);
+        return mem;
+}
+
+/********** restoreSnapshot ********
+ *
+ * Rebuilds a machine from a snapshot file, with readSnapshot
+ *
+ * Parameters:
+ *     const char *path: Snapshot written by saveSnapshot
+ *     IODev_T io: I/O device for the restored machine, with no input
+ *                 buffered; the saved unread input is buffered in it
+ *
+ * Return: Memory ready for execInstructions to resume, or NULL if the
+ *         file cannot be read, is not a well-formed snapshot or there
+ *         is no memory for its segments
+ *
+ * Notes
+ *      The file is mmapped and each segment copied out of the mapping.
+ ************************/
+Mem_T restoreSnapshot(const char *path, IODev_T io)
+{
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) {
+                return NULL;
+        }
+        struct stat st;
+        if (fstat(fd, &st) < 0 || st.st_size == 0) {
+                close(fd);
+                return NULL;
+        }
+        size_t size = st.st_size;
+        void *file = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (file == MAP_FAILED) {
+                return NULL;
+        }
+        Mem_T mem = readSnapshot(file, size, io);
+        munmap(file, size);
+        return mem;
+}
@@ -0,0 +1,23 @@
+/*
+ *     filename: snapshot.h
+ *     partner 1 name: Jack Burton       Login: jburto05
+ *     partner 2 name: James Hartley        Login: jhartl01
+ *     date: April 9th, 2024
+ *     assignment: hw6
+ *
+ *     summary: Defines functions for saving a stopped machine to a file
+ *     and restoring it
+ *
+*/
+
+#ifndef SNAPSHOT_INCLUDED
+#define SNAPSHOT_INCLUDED
+
+#include "memexec.h"
+
+bool writeSnapshot(Mem_T mem, IODev_T io, FILE *fp);
+bool saveSnapshot(Mem_T mem, IODev_T io, const char *path);
+Mem_T readSnapshot(const void *image, size_t size, IODev_T io);
+Mem_T restoreSnapshot(const char *path, IODev_T io);
+
+#endif
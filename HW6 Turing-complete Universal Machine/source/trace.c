@@ -0,0 +1,693 @@
+/*
+ *     filename: trace.c
+ *     partner 1 name: Jack Burton       Login: jburto05
+ *     partner 2 name: James Hartley        Login: jhartl01
+ *     date: April 11th, 2024
+ *     assignment: hw6
+ *
+ *     summary: Implements the --trace and --replay modes of um. Like the
+ *     profiler, the traced machine is its own loop around stepInstruction,
+ *     so execInstructions pays nothing when tracing is off. A recording
+ *     either streams every record to its file or, with --trace-ring,
+ *     keeps only the most recent in a bounded ring written out at the
+ *     end, behind a snapshot of the machine where they start.
+ *
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <string.h>
+#include "trace.h"
+#include "snapshot.h"
+
+/* Identifies a trace file, and the record format version */
+static const char TRACE_MAGIC[8] = "UMTRACE3";
+
+/* Bytes of a trace header */
+#define TRACE_HEADER_BYTES (sizeof(TRACE_MAGIC) + 24)
+
+/* Bytes buffered between the machine and the file */
+#define TRACE_BUFFER (1 << 20)
+
+/* Chunks a ring is split into, the smallest chunk, and the most bytes
+ * one record (or the end tag) can take, which a chunk keeps room for.
+ * Every chunk starts with a snapshot, so there are few of them. */
+#define RING_CHUNKS 4
+#define RING_MIN_CHUNK 4096
+#define TRACE_MAX_RECORD 32
+
+/* Record tag that ends a trace stopped short of HALT */
+#define TRACE_END 0xFF
+
+/*
+ * Trace format. After an 8-byte magic, a 4-byte starting offset in
+ * segment 0, an 8-byte count of instructions retired before it, the
+ * 4-byte offset the first SSTORE delta is from and the 8-byte size of a
+ * snapshot (all little-endian), then that many bytes of snapshot (see
+ * snapshot.c) of the machine at the start, if any, there is one record
+ * per instruction, in order. A record
+ * is a tag byte, the instruction's opcode, then operands as LEB128
+ * varints:
+ *
+ *     SSTORE  segment, offset as a zigzag delta from the last SSTORE's
+ *             offset, value
+ *     MAP     size, address returned
+ *     UNMAP   address
+ *     OUT     value
+ *     IN      value + 1 (0 for end of input)
+ *     LOADP   segment, target as a zigzag delta from the next offset
+ *
+ * and nothing for the other instructions, whose program counter is
+ * always the previous one plus 1. The program counter of every
+ * instruction is therefore implied: each LOADP gives the next as a
+ * delta. A trace stopped by a limit ends with a TRACE_END tag; one that
+ * halted ends with the HALT record.
+ *
+ * A ring keeps its records in RING_CHUNKS chunks, each starting at a
+ * record with a RingChunk saying where the machine was, including a
+ * snapshot of it, and overwrites the oldest chunk when it runs out. Its
+ * file is a trace starting at the oldest chunk kept, with that chunk's
+ * snapshot, so the last 3/4 or more of the ring is written and can be
+ * replayed without the program's original input. A streamed trace
+ * starts where the machine does, and has no snapshot.
+ */
+
+/* RingChunk
+ * Usage: Where the first record of a chunk of a ring starts
+ *
+ * Members:
+ * 	uint32_t offset: Offset in segment 0 of its instruction
+ * 	uint32_t lastStore: Offset its first SSTORE delta is from
+ * 	uint64_t retired: Instructions retired before it
+ * 	size_t used: Bytes of records in the chunk
+ * 	char *snap: Snapshot of the machine before its first instruction
+ * 	size_t snapBytes: Bytes of snap
+ *
+*/
+typedef struct RingChunk {
+        uint32_t offset;
+        uint32_t lastStore;
+        uint64_t retired;
+        size_t used;
+        char *snap;
+        size_t snapBytes;
+} RingChunk;
+
+/* Trace_T
+ * Usage: A trace file being recorded or replayed
+ *
+ * Members:
+ * 	FILE *fp: The file
+ * 	const char *path: Its name, for messages
+ * 	bool replay: true if reading the trace back, false if recording
+ * 	bool failed: Whether the file could not be written, or a replay
+ * 		diverged from it
+ * 	uint8_t *buf: Bytes staged to or from the file, or the ring
+ * 	size_t size: Bytes of buf
+ * 	size_t pos, fill: Next byte of buf to use, and bytes in buf (for a
+ * 		replay; a recording's fill is always the buffer size)
+ * 	uint32_t lastStore: Offset of the last SSTORE, for its delta
+ * 	RingChunk *ring: The chunks of a ring, or NULL when streaming
+ * 	size_t chunkBytes: Bytes of each chunk
+ * 	uint32_t chunk: Chunk being filled
+ * 	bool wrapped: Whether the ring has overwritten a chunk
+ * 	uint32_t startOffset, startLastStore: For a replay, the offset and
+ * 		lastStore its header says the trace starts at
+ * 	uint64_t startRetired: And the instructions retired before it
+ *
+*/
+struct Trace_T {
+        FILE *fp;
+        const char *path;
+        bool replay;
+        bool failed;
+        uint8_t *buf;
+        size_t size;
+        size_t pos;
+        size_t fill;
+        uint32_t lastStore;
+        RingChunk *ring;
+        size_t chunkBytes;
+        uint32_t chunk;
+        bool wrapped;
+        uint32_t startOffset;
+        uint32_t startLastStore;
+        uint64_t startRetired;
+};
+
+/* The trace being recorded, written out by finishAtExit if a um-safe
+ * fault exits before closeTrace */
+static Trace_T recording = NULL;
+
+static void finishTrace(Trace_T trace);
+
+static void finishAtExit(void)
+{
+        if (recording != NULL) {
+                finishTrace(recording);
+                fclose(recording->fp);
+                recording = NULL;
+        }
+}
+
+/********** openTrace ********
+ *
+ * Opens a trace file to record to or replay from
+ *
+ * Parameters:
+ *     const char *path: File to create (recording) or read (replaying)
+ *     bool replay: Whether to replay the trace rather than record it
+ *     uint64_t ringBytes: For a recording, 0 to stream every record to
+ *                         the file, or the bytes of a ring keeping only
+ *                         the last records (at least RING_CHUNKS *
+ *                         RING_MIN_CHUNK are used)
+ *
+ * Return: pointer to initialized Trace_T struct, or NULL if the file
+ *         cannot be opened or there is no memory for the buffer
+ *
+ ************************/
+Trace_T openTrace(const char *path, bool replay, uint64_t ringBytes)
+{
+        size_t chunkBytes = 0, size = TRACE_BUFFER;
+        if (!replay && ringBytes > 0) {
+                if (ringBytes > SIZE_MAX / 2) {
+                        return NULL;
+                }
+                chunkBytes = ringBytes / RING_CHUNKS;
+                if (chunkBytes < RING_MIN_CHUNK) {
+                        chunkBytes = RING_MIN_CHUNK;
+                }
+                size = chunkBytes * RING_CHUNKS;
+        }
+        FILE *fp = fopen(path, replay ? "rb" : "wb");
+        if (fp == NULL) {
+                return NULL;
+        }
+        Trace_T trace = calloc(1, sizeof(*trace));
+        assert(trace != NULL);
+        trace->buf = malloc(size);
+        if (chunkBytes > 0) {
+                trace->ring = calloc(RING_CHUNKS, sizeof(*trace->ring));
+        }
+        if (trace->buf == NULL || (chunkBytes > 0 && trace->ring == NULL)) {
+                free(trace->buf);
+                free(trace);
+                fclose(fp);
+                return NULL;
+        }
+        trace->fp = fp;
+        trace->path = path;
+        trace->replay = replay;
+        trace->size = size;
+        trace->fill = replay ? 0 : size;
+        trace->chunkBytes = chunkBytes;
+        if (!replay) {
+                if (recording == NULL) {
+                        atexit(finishAtExit);
+                }
+                recording = trace;
+        }
+        return trace;
+}
+
+/* Writes out the staged bytes of a recording */
+static void drainTrace(Trace_T trace)
+{
+        if (fwrite(trace->buf, 1, trace->pos, trace->fp) != trace->pos) {
+                trace->failed = true;
+        }
+        trace->pos = 0;
+}
+
+/* Lays out a header for a trace starting at offset, after retired
+ * instructions, with its first SSTORE delta from lastStore and a
+ * snapshot of snapBytes after it */
+static void encodeHeader(uint8_t *header, uint32_t offset, uint64_t retired,
+                         uint32_t lastStore, uint64_t snapBytes)
+{
+        memcpy(header, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+        for (int i = 0; i < 4; i++) {
+                header[8 + i] = offset >> (8 * i);
+                header[20 + i] = lastStore >> (8 * i);
+        }
+        for (int i = 0; i < 8; i++) {
+                header[12 + i] = retired >> (8 * i);
+                header[24 + i] = snapBytes >> (8 * i);
+        }
+}
+
+/* Reads a little-endian field of bytes bytes from a header */
+static uint64_t headerField(const uint8_t *at, int bytes)
+{
+        uint64_t value = 0;
+        for (int i = bytes - 1; i >= 0; i--) {
+                value = value << 8 | at[i];
+        }
+        return value;
+}
+
+/********** beginChunk ********
+ *
+ * Starts filling the ring's current chunk, noting the machine's state
+ * and taking a snapshot of it
+ *
+ * Parameters:
+ *     Trace_T trace: Ring being recorded
+ *     Mem_T mem: The machine, stopped between instructions
+ *     IODev_T io: Its I/O device, whose read-ahead input is saved
+ *     uint32_t offset: Offset of the next instruction
+ *
+ * Return: None
+ *
+ * Notes
+ *      The snapshot replaces the one of the chunk being overwritten. If
+ *      there is no memory for it, the recording is marked failed.
+ ************************/
+static void beginChunk(Trace_T trace, Mem_T mem, IODev_T io, 
+                       uint32_t offset)
+{
+        RingChunk *chunk = &trace->ring[trace->chunk];
+        chunk->offset = offset;
+        chunk->lastStore = trace->lastStore;
+        chunk->retired = mem->retired;
+        chunk->used = 0;
+        trace->pos = trace->chunk * trace->chunkBytes;
+
+        free(chunk->snap);
+        chunk->snap = NULL;
+        chunk->snapBytes = 0;
+        shiftProgCounter(mem->counter, 0, offset);
+        FILE *snap = open_memstream(&chunk->snap, &chunk->snapBytes);
+        bool ok = snap != NULL && writeSnapshot(mem, io, snap);
+        if (snap == NULL || fclose(snap) != 0 || !ok) {
+                trace->failed = true;
+        }
+}
+
+/********** startRecord ********
+ *
+ * Makes room for the next record of a ring: when the current chunk may
+ * not hold it, moves on to the next chunk, overwriting the oldest
+ *
+ * Parameters:
+ *     Trace_T trace: Trace being recorded
+ *     Mem_T mem: The machine
+ *     IODev_T io: Its I/O device
+ *     uint32_t offset: Offset of the instruction about to be recorded
+ *
+ * Return: None
+ *
+ ************************/
+static void startRecord(Trace_T trace, Mem_T mem, IODev_T io, 
+                        uint32_t offset)
+{
+        if (trace->ring == NULL) {
+                return;
+        }
+        size_t start = trace->chunk * trace->chunkBytes;
+        if (start + trace->chunkBytes - trace->pos >= TRACE_MAX_RECORD) {
+                return;
+        }
+        trace->ring[trace->chunk].used = trace->pos - start;
+        trace->chunk = (trace->chunk + 1) % RING_CHUNKS;
+        trace->wrapped |= trace->chunk == 0;
+        beginChunk(trace, mem, io, offset);
+}
+
+/* Writes a ring out as a trace from its oldest chunk */
+static void dumpRing(Trace_T trace)
+{
+        trace->ring[trace->chunk].used = trace->pos -
+                                         trace->chunk * trace->chunkBytes;
+        uint32_t first = trace->wrapped ? (trace->chunk + 1) % RING_CHUNKS
+                                        : 0;
+        RingChunk *oldest = &trace->ring[first];
+        uint8_t header[TRACE_HEADER_BYTES];
+        encodeHeader(header, oldest->offset, oldest->retired,
+                     oldest->lastStore, oldest->snapBytes);
+        bool ok = oldest->snap != NULL &&
+                  fwrite(header, sizeof(header), 1, trace->fp) == 1 &&
+                  fwrite(oldest->snap, 1, oldest->snapBytes, trace->fp) ==
+                  oldest->snapBytes;
+        for (uint32_t k = first; ok; k = (k + 1) % RING_CHUNKS) {
+                size_t used = trace->ring[k].used;
+                ok = fwrite(trace->buf + k * trace->chunkBytes, 1, used,
+                            trace->fp) == used;
+                if (k == trace->chunk) {
+                        break;
+                }
+        }
+        if (!ok) {
+                trace->failed = true;
+        }
+}
+
+/* Writes out what a recording has not yet written */
+static void finishTrace(Trace_T trace)
+{
+        if (trace->ring != NULL) {
+                dumpRing(trace);
+        } else {
+                drainTrace(trace);
+        }
+}
+
+/********** closeTrace ********
+ *
+ * Finishes writing or reading a trace, and frees it
+ *
+ * Parameters:
+ *     Trace_T trace: Trace to close, or NULL
+ *
+ * Return: true if every byte of a recording was written, or a replay
+ *         matched its trace throughout; false otherwise
+ *
+ ************************/
+bool closeTrace(Trace_T trace)
+{
+        if (trace == NULL) {
+                return true;
+        }
+        if (!trace->replay) {
+                recording = NULL;
+                finishTrace(trace);
+        }
+        bool ok = fclose(trace->fp) == 0 && !trace->failed;
+        for (uint32_t k = 0; trace->ring != NULL && k < RING_CHUNKS; k++) {
+                free(trace->ring[k].snap);
+        }
+        free(trace->buf);
+        free(trace->ring);
+        free(trace);
+        return ok;
+}
+
+/* Stages one byte of a recording; a ring's chunks always have room */
+static void writeByte(Trace_T trace, uint8_t byte)
+{
+        if (trace->pos == trace->size) {
+                drainTrace(trace);
+        }
+        trace->buf[trace->pos++] = byte;
+}
+
+/* Reads one byte of a replay, or returns -1 at the end of the file */
+static int readByte(Trace_T trace)
+{
+        if (trace->pos == trace->fill) {
+                trace->fill = fread(trace->buf, 1, trace->size, trace->fp);
+                trace->pos = 0;
+                if (trace->fill == 0) {
+                        return -1;
+                }
+        }
+        return trace->buf[trace->pos++];
+}
+
+static void writeVarint(Trace_T trace, uint32_t value)
+{
+        while (value >= 0x80) {
+                writeByte(trace, (value & 0x7F) | 0x80);
+                value >>= 7;
+        }
+        writeByte(trace, value);
+}
+
+/* Reads a varint into *value; false if the file ends inside it */
+static bool readVarint(Trace_T trace, uint32_t *value)
+{
+        *value = 0;
+        for (int shift = 0; shift < 35; shift += 7) {
+                int byte = readByte(trace);
+                if (byte < 0) {
+                        return false;
+                }
+                *value |= (uint32_t)(byte & 0x7F) << shift;
+                if ((byte & 0x80) == 0) {
+                        return true;
+                }
+        }
+        return false;
+}
+
+/* Maps a signed delta to an unsigned one that is small when it is */
+static uint32_t zigzag(uint32_t delta)
+{
+        return (delta << 1) ^ (uint32_t)-(int32_t)(delta >> 31);
+}
+
+/********** traceOperand ********
+ *
+ * Records one operand of an instruction, or when replaying, checks it
+ * against the trace
+ *
+ * Parameters:
+ *     Trace_T trace: Trace being recorded or replayed
+ *     uint32_t value: The operand as the machine has it
+ *
+ * Return: false if a replay's trace has a different value or ends,
+ *         true otherwise
+ *
+ ************************/
+static bool traceOperand(Trace_T trace, uint32_t value)
+{
+        if (!trace->replay) {
+                writeVarint(trace, value);
+                return true;
+        }
+        uint32_t recorded;
+        return readVarint(trace, &recorded) && recorded == value;
+}
+
+/********** startReplay ********
+ *
+ * Reads a replay's header, and if the trace starts with a snapshot (as
+ * a ring's does), replaces the machine with the one it holds
+ *
+ * Parameters:
+ *     Trace_T trace: Trace opened for replay
+ *     IODev_T io: I/O device of the machine
+ *     Mem_T *mem: The machine loaded to replay the trace on; replaced,
+ *                 and the old one freed, if the trace has a snapshot
+ *
+ * Return: true, or false if the file is not a trace or its snapshot
+ *         cannot be restored
+ *
+ * Notes
+ *      A trace with a snapshot needs neither the program's input nor
+ *      the run before it: the snapshot has the machine as it was where
+ *      the records start. traceExecInstructions then checks the machine
+ *      is where the header says.
+ ************************/
+bool startReplay(Trace_T trace, IODev_T io, Mem_T *mem)
+{
+        assert(trace != NULL && trace->replay && mem != NULL);
+        uint8_t header[TRACE_HEADER_BYTES];
+        for (size_t i = 0; i < sizeof(header); i++) {
+                int byte = readByte(trace);
+                if (byte < 0) {
+                        return false;
+                }
+                header[i] = byte;
+        }
+        if (memcmp(header, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0) {
+                return false;
+        }
+        trace->startOffset = headerField(header + 8, 4);
+        trace->startRetired = headerField(header + 12, 8);
+        trace->startLastStore = headerField(header + 20, 4);
+        uint64_t snapBytes = headerField(header + 24, 8);
+        if (snapBytes == 0) {
+                return true;
+        }
+
+        /* Word-aligned, as readSnapshot needs */
+        uint32_t *image = snapBytes <= SIZE_MAX ? malloc(snapBytes) : NULL;
+        if (image == NULL) {
+                return false;
+        }
+        unsigned char *bytes = (unsigned char *)image;
+        for (uint64_t i = 0; i < snapBytes; i++) {
+                int byte = readByte(trace);
+                if (byte < 0) {
+                        free(image);
+                        return false;
+                }
+                bytes[i] = byte;
+        }
+        Mem_T restored = readSnapshot(image, snapBytes, io);
+        free(image);
+        if (restored == NULL) {
+                return false;
+        }
+        freeMem(*mem);
+        *mem = restored;
+        return true;
+}
+
+/********** traceHeader ********
+ *
+ * Starts a recording: writes its header, or for a ring, starts its first
+ * chunk. Or starts a replay whose header startReplay has read: checks
+ * the machine is where the trace starts.
+ *
+ * Parameters:
+ *     Trace_T trace: Trace being recorded or replayed
+ *     Mem_T mem: Machine about to run
+ *     IODev_T io: Its I/O device
+ *
+ * Return: true if the header was written or matches, false if the
+ *         replay's trace does not start where the machine is
+ *
+ ************************/
+static bool traceHeader(Trace_T trace, Mem_T mem, IODev_T io)
+{
+        uint32_t offset = mem->counter->offset;
+        if (trace->replay) {
+                trace->lastStore = trace->startLastStore;
+                return mem->retired == trace->startRetired && 
+                       offset == trace->startOffset;
+        }
+        if (trace->ring != NULL) {
+                beginChunk(trace, mem, io, offset);
+                return true;
+        }
+        uint8_t header[TRACE_HEADER_BYTES];
+        encodeHeader(header, offset, mem->retired, trace->lastStore, 0);
+        for (size_t i = 0; i < sizeof(header); i++) {
+                writeByte(trace, header[i]);
+        }
+        return true;
+}
+
+/* Reports where a replay stopped matching its trace */
+static void diverged(Trace_T trace, Mem_T mem, uint32_t offset)
+{
+        fprintf(stderr, "um: replay diverges from %s at instruction %llu "
+                        "($m[0][%u])\n", trace->path,
+                (unsigned long long)mem->retired, (unsigned)offset);
+        trace->failed = true;
+}
+
+/********** traceExecInstructions ********
+ *
+ * Runs the machine like execInstructions, recording each instruction to
+ * a trace, or replaying one: running the same program again with its IN
+ * bytes taken from the trace, checking every instruction against it
+ *
+ * Parameters:
+ *     Trace_T trace: Trace to record to or replay
+ *     Mem_T mem: Pointer to memory struct
+ *     IODev_T io: I/O device used by OUT (and by IN when recording)
+ *     const RunLimits *limits: Budget and deadline, or NULL for none
+ *
+ * Return: RUN_HALTED, or why the machine stopped before halting. A
+ *         replay of a trace recorded under a limit stops where it did,
+ *         with RUN_BUDGET.
+ *
+ * Notes
+ *      A replay must have had its header read by startReplay. One that
+ *      diverges reports the instruction to stderr and stops; closeTrace
+ *      then returns false. Memory use is bounded by the one
+ *      TRACE_BUFFER, or the ring and its snapshots, however long the run.
+ ************************/
+Run_status traceExecInstructions(Trace_T trace, Mem_T mem, IODev_T io,
+                                 const RunLimits *limits)
+{
+        assert(trace != NULL && mem != NULL && io != NULL);
+
+        uint32_t *r = mem->reg;
+        bool started = traceHeader(trace, mem, io);
+        uint32_t offset = mem->counter->offset;
+        if (!started) {
+                diverged(trace, mem, offset);
+                return RUN_HALTED;
+        }
+        uint64_t nextCheck;
+        Run_status status = checkLimits(limits, mem->retired, &nextCheck);
+        while (status == RUN_HALTED) {
+                Segment program = mem->seg[0];
+#ifdef UM_SAFE
+                if (offset >= program->length) {
+                        /* Reports the fault, and does not return */
+                        stepInstruction(mem, io, &offset);
+                }
+#endif
+                assert(offset < program->length);
+                uint32_t word = program->words[offset];
+                int op = word >> 28;
+                uint32_t *ra = &r[(word >> 6) & 0x7];
+                uint32_t *rb = &r[(word >> 3) & 0x7];
+                uint32_t *rc = &r[word & 0x7];
+
+                if (!trace->replay) {
+                        startRecord(trace, mem, io, offset);
+                        writeByte(trace, op);
+                } else {
+                        int tag = readByte(trace);
+                        if (tag == TRACE_END) {
+                                status = RUN_BUDGET;
+                                break;
+                        }
+                        if (tag != op) {
+                                diverged(trace, mem, offset);
+                                break;
+                        }
+                }
+
+                bool ok = true;
+                if (op == SSTORE) {
+                        ok = traceOperand(trace, *ra) &&
+                             traceOperand(trace,
+                                          zigzag(*rb - trace->lastStore)) &&
+                             traceOperand(trace, *rc);
+                        trace->lastStore = *rb;
+                } else if (op == MAP || op == UNMAP || op == OUT) {
+                        ok = traceOperand(trace, *rc);
+                } else if (op == LOADP) {
+                        ok = traceOperand(trace, *rb) &&
+                             traceOperand(trace, zigzag(*rc - (offset + 1)));
+                } else if (op == IN && trace->replay) {
+                        /* The input comes from the trace, not io */
+                        uint32_t value;
+                        ok = readVarint(trace, &value);
+                        if (ok) {
+                                *rc = value - 1;
+                                offset++;
+                        }
+                }
+                if (!ok) {
+                        diverged(trace, mem, offset);
+                        break;
+                }
+
+                if (op == IN && trace->replay) {
+                        /* Already run */
+                } else if (!stepInstruction(mem, io, &offset)) {
+                        status = stopStatus(mem, offset);
+                        mem->retired += status == RUN_HALTED;
+                        break;
+                }
+                if (op == MAP) {
+                        ok = traceOperand(trace, *rb);
+                } else if (op == IN && !trace->replay) {
+                        ok = traceOperand(trace, *rc + 1);
+                }
+                if (!ok) {
+                        diverged(trace, mem, offset);
+                        break;
+                }
+
+                if (++mem->retired >= nextCheck) {
+                        status = checkLimits(limits, mem->retired,
+                                             &nextCheck);
+                }
+        }
+        if (status != RUN_HALTED && !trace->replay) {
+                startRecord(trace, mem, io, offset);
+                writeByte(trace, TRACE_END);
+        }
+        flushOutput(io);
+        shiftProgCounter(mem->counter, 0, offset);
+        return status;
+}
@@ -0,0 +1,26 @@
+/*
+ *     filename: trace.h
+ *     partner 1 name: Jack Burton       Login: jburto05
+ *     partner 2 name: James Hartley        Login: jhartl01
+ *     date: April 11th, 2024
+ *     assignment: hw6
+ *
+ *     summary: Defines execution traces: recording every instruction a
+ *     machine runs, with its effects, to a file, and replaying one
+ *
+*/
+
+#ifndef TRACE_INCLUDED
+#define TRACE_INCLUDED
+
+#include "memexec.h"
+
+typedef struct Trace_T *Trace_T;
+
+Trace_T openTrace(const char *path, bool replay, uint64_t ringBytes);
+bool closeTrace(Trace_T trace);
+bool startReplay(Trace_T trace, IODev_T io, Mem_T *mem);
+Run_status traceExecInstructions(Trace_T trace, Mem_T mem, IODev_T io,
+                                 const RunLimits *limits);
+
+#endif
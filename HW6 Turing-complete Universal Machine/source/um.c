@@ -1,79 +1,480 @@
-/*
- *     filename: um.c
- *     partner 1 name: Jack Burton       Login: jburto05
- *     partner 2 name: James Hartley        Login: jhartl01
- *     date: April 4th, 2024
- *     assignment: hw6
- *
- *     summary: Implements main universal machine driver
- *     
-*/
-
-#include <stdio.h>
-#include <string.h>
-#include <stdlib.h>
-#include <assert.h>
-#include <sys/stat.h>
-#include "memload.h"
-
-
-
-/********** main ********
- * 
- * Opens file for reading, passes file pointer to memload,
- * then executes instructions with memexec.
- *
- * Parameters:
- *     int argc: Number of arguments passed via stdin
- *     char *argv[]: Arguments from stdin
- *
- * Return: None
- *
- * Expects
- * 	 argc == 2
- *     argv[1] to be a valid, readable .um file   
- * Notes
- *    Provides appropriate error messages and exits with EXIT_FAILURE
- *    if expectations are not met.
- *
-************************/
-int main(int argc, char *argv[]) 
-{
-        if (argc != 2) {
-                fprintf(stderr, "Incorrect number of arguments\n");
-                exit(EXIT_FAILURE);
-        }
-
-
-        FILE *input;
-        char *filename = argv[1];
-        input = fopen(filename, "rb");
-        if (input == NULL) {
-                fprintf(stderr, "%s: No such file or directory\n", filename);
-                exit(EXIT_FAILURE);
-        }
-
-        struct stat st;
-        stat(filename, &st);
-        Mem_T memory = initMem(st.st_size);
-        
-        
-        //testGetAndSetMem(memory);
-        // testGetAndSetReg(memory);
-        // //testMapSeg(memory);
-        // testUnmapSeg(memory);
-        // testMapReuseArea(memory);
-        //testRandMemAccess(memory);
-        loadInstructions(memory, input);
-        //printAllWords(Seq_get(memory->seg, 0));
-        execInstructions(memory);
-
-        freeMem(memory);
-
-        
-        fclose(input);
-        
-        return EXIT_SUCCESS;
-}
-
-
+/*
+ *     filename: um.c
+ *     partner 1 name: Jack Burton       Login: jburto05
+ *     partner 2 name: James Hartley        Login: jhartl01
+ *     date: April 4th, 2024
+ *     assignment: hw6
+ *
+ *     summary: Implements main universal machine driver
+ *     
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "memload.h"
+#include "jit.h"
+#include "profile.h"
+#include "trace.h"
+#include "snapshot.h"
+
+
+
+/********** usage ********
+ * 
+ * Prints command line usage and exits with EXIT_FAILURE
+ *
+ * Parameters:
+ *     char *progname: Name the program was invoked as
+ *
+ * Return: None
+ *
+************************/
+static void usage(char *progname)
+{
+        fprintf(stderr, "Usage: %s [options] file.um\n"
+                        "       %s [options] --restore FILE\n", 
+                progname, progname);
+        fprintf(stderr, "  --stats          print timings, peak RSS and "
+                        "memory statistics to stderr at exit\n");
+        fprintf(stderr, "  --jit            compile hot code to x86-64 "
+                        "machine code\n");
+        fprintf(stderr, "  --profile[=FILE] count every instruction; "
+                        "report to stderr at halt and\n"
+                        "                   write a flat profile to FILE "
+                        "(default um.prof)\n");
+        fprintf(stderr, "  --symbols FILE   name offsets in the profile by "
+                        "the labels of FILE,\n"
+                        "                   a umasm --map symbol map\n");
+        fprintf(stderr, "  --trace FILE     record every instruction and "
+                        "its effects to FILE\n");
+        fprintf(stderr, "  --trace-ring BYTES\n"
+                        "                   keep only the last BYTES of "
+                        "the trace, written to FILE\n"
+                        "                   with a snapshot to replay "
+                        "from when the machine\n"
+                        "                   halts, stops or faults\n");
+        fprintf(stderr, "  --replay FILE    rerun the trace in FILE, with "
+                        "its input, and stop\n"
+                        "                   where the machine departs "
+                        "from it\n");
+        fprintf(stderr, "  --save-snapshot FILE\n"
+                        "                   save the machine, with input it "
+                        "has read ahead,\n"
+                        "                   to FILE when it halts or stops\n");
+        fprintf(stderr, "  --snapshot-at N  stop at the first LOADP after "
+                        "N instructions\n");
+        fprintf(stderr, "  --budget N       stop after about N more "
+                        "instructions\n");
+        fprintf(stderr, "  --timeout SECS   stop after SECS seconds of "
+                        "wall-clock time\n");
+        fprintf(stderr, "  --count          print the number of "
+                        "instructions executed at exit\n");
+        fprintf(stderr, "  --prefault       fault in huge-page segments "
+                        "when they are mapped\n");
+        fprintf(stderr, "  --restore FILE   resume the machine saved in "
+                        "FILE instead of loading\n"
+                        "                   a .um file\n");
+        fprintf(stderr, "  --flush=WHEN     flush output on any of "
+                        "newline,input (comma separated),\n"
+                        "                   or only when full and at "
+                        "halt (full)\n");
+        exit(EXIT_FAILURE);
+}
+
+/********** optionValue ********
+ * 
+ * Gets the value of an option given as either "--name=VALUE" or
+ * "--name VALUE"
+ *
+ * Parameters:
+ *     int argc, char *argv[]: Command line
+ *     int *argi: Index of the current argument; advanced past VALUE when
+ *                it is a separate argument
+ *     char *name: Option, including the leading "--"
+ *
+ * Return: The value, or NULL if argv[*argi] is not this option
+ *
+************************/
+static char *optionValue(int argc, char *argv[], int *argi, char *name)
+{
+        size_t len = strlen(name);
+        char *arg = argv[*argi];
+        if (strncmp(arg, name, len) != 0) {
+                return NULL;
+        }
+        if (arg[len] == '=') {
+                return arg + len + 1;
+        }
+        if (arg[len] != '\0') {
+                return NULL;
+        }
+        if (*argi + 1 >= argc) {
+                fprintf(stderr, "%s needs a value\n", name);
+                usage(argv[0]);
+        }
+        return argv[++*argi];
+}
+
+/********** parseCount ********
+ * 
+ * Parses an instruction count, exiting through usage if it is not one
+ *
+ * Parameters:
+ *     char *value: Decimal count
+ *     char *progname: Name the program was invoked as
+ *
+ * Return: The count
+ *
+************************/
+static uint64_t parseCount(char *value, char *progname)
+{
+        char *end;
+        uint64_t count = strtoull(value, &end, 10);
+        if (*value == '\0' || *value == '-' || *end != '\0') {
+                fprintf(stderr, "Bad instruction count %s\n", value);
+                usage(progname);
+        }
+        return count;
+}
+
+/********** reportStop ********
+ * 
+ * Tells the user why a machine stopped before halting and where
+ *
+ * Parameters:
+ *     Run_status status: RUN_BUDGET, RUN_DEADLINE or RUN_NOMEM
+ *     Mem_T mem: The stopped machine
+ *
+ * Return: None
+ *
+************************/
+static void reportStop(Run_status status, Mem_T mem)
+{
+        fprintf(stderr, "um: stopped: %s\n", 
+                status == RUN_BUDGET ? "instruction limit reached" 
+                : status == RUN_DEADLINE ? "deadline passed" 
+                                         : "no memory for a MAP");
+        fprintf(stderr, "pc:                  $m[0][%d]\n", 
+                mem->counter->offset);
+        fprintf(stderr, "registers:          ");
+        for (int i = 0; i < 8; i++) {
+                fprintf(stderr, " r%d=0x%08x", i, (unsigned)mem->reg[i]);
+        }
+        fprintf(stderr, "\n");
+        /* Only limits need the count, and --jit, which has none, may
+         * run out of memory */
+        if (status != RUN_NOMEM) {
+                fprintf(stderr, "instructions:        %llu\n", 
+                        (unsigned long long)mem->retired);
+        }
+}
+
+/********** parseFlushPolicy ********
+ * 
+ * Parses the argument of --flush
+ *
+ * Parameters:
+ *     char *arg: Comma separated list of "newline", "input", "full" or
+ *                "halt"
+ *
+ * Return: FlushPolicy bits, or -1 if arg names an unknown policy
+ *
+************************/
+static int parseFlushPolicy(char *arg)
+{
+        int policy = FLUSH_FULL;
+        char *name = strtok(arg, ",");
+        while (name != NULL) {
+                if (strcmp(name, "newline") == 0) {
+                        policy |= FLUSH_NEWLINE;
+                } else if (strcmp(name, "input") == 0) {
+                        policy |= FLUSH_INPUT;
+                } else if (strcmp(name, "full") != 0 && 
+                           strcmp(name, "halt") != 0) {
+                        return -1;
+                }
+                name = strtok(NULL, ",");
+        }
+        return policy;
+}
+
+/********** main ********
+ * 
+ * Opens file for reading, passes file pointer to memload,
+ * then executes instructions with memexec.
+ *
+ * Parameters:
+ *     int argc: Number of arguments passed via stdin
+ *     char *argv[]: Arguments from stdin
+ *
+ * Return: None
+ *
+ * Expects
+ * 	 Options, if any, before exactly one file name
+ *     File name to be a valid, readable .um file   
+ * Notes
+ *    Provides appropriate error messages and exits with EXIT_FAILURE
+ *    if expectations are not met.
+ *
+************************/
+int main(int argc, char *argv[]) 
+{
+        bool showStats = false;
+        bool useJit = false;
+        char *profilePath = NULL;
+        char *symbolsPath = NULL;
+        char *tracePath = NULL;
+        bool replay = false;
+        uint64_t ringBytes = 0;
+        char *savePath = NULL;
+        char *restorePath = NULL;
+        bool showCount = false;
+        bool prefault = false;
+        uint64_t snapshotAt = RUN_UNLIMITED;
+        uint64_t budget = RUN_UNLIMITED;
+        double timeout = 0;
+        char *value;
+        int flushPolicy = defaultFlushPolicy(STDIN_FILENO, STDOUT_FILENO);
+
+        int argi = 1;
+        for (; argi < argc && strncmp(argv[argi], "--", 2) == 0; argi++) {
+                if (strcmp(argv[argi], "--stats") == 0) {
+                        showStats = true;
+                } else if (strcmp(argv[argi], "--jit") == 0) {
+                        useJit = true;
+                } else if (strcmp(argv[argi], "--profile") == 0) {
+                        profilePath = "um.prof";
+                } else if (strncmp(argv[argi], "--profile=", 10) == 0) {
+                        profilePath = argv[argi] + 10;
+                } else if ((value = optionValue(argc, argv, &argi, 
+                                                "--symbols"))) {
+                        symbolsPath = value;
+                } else if ((value = optionValue(argc, argv, &argi, 
+                                                "--trace"))) {
+                        tracePath = value;
+                        replay = false;
+                } else if ((value = optionValue(argc, argv, &argi, 
+                                                "--trace-ring"))) {
+                        ringBytes = parseCount(value, argv[0]);
+                } else if ((value = optionValue(argc, argv, &argi, 
+                                                "--replay"))) {
+                        tracePath = value;
+                        replay = true;
+                } else if ((value = optionValue(argc, argv, &argi, 
+                                                "--save-snapshot"))) {
+                        savePath = value;
+                } else if ((value = optionValue(argc, argv, &argi, 
+                                                "--restore"))) {
+                        restorePath = value;
+                } else if ((value = optionValue(argc, argv, &argi, 
+                                                "--snapshot-at"))) {
+                        snapshotAt = parseCount(value, argv[0]);
+                } else if ((value = optionValue(argc, argv, &argi, 
+                                                "--budget"))) {
+                        budget = parseCount(value, argv[0]);
+                } else if ((value = optionValue(argc, argv, &argi, 
+                                                "--timeout"))) {
+                        char *end;
+                        timeout = strtod(value, &end);
+                        if (*end != '\0' || !(timeout > 0)) {
+                                fprintf(stderr, "Bad timeout %s\n", value);
+                                usage(argv[0]);
+                        }
+                } else if (strcmp(argv[argi], "--count") == 0) {
+                        showCount = true;
+                } else if (strcmp(argv[argi], "--prefault") == 0) {
+                        prefault = true;
+                } else if (strncmp(argv[argi], "--flush=", 8) == 0) {
+                        flushPolicy = parseFlushPolicy(argv[argi] + 8);
+                        if (flushPolicy < 0) {
+                                fprintf(stderr, "Unknown flush policy\n");
+                                usage(argv[0]);
+                        }
+                } else {
+                        fprintf(stderr, "Unknown option %s\n", argv[argi]);
+                        usage(argv[0]);
+                }
+        }
+        if (argc - argi != (restorePath == NULL ? 1 : 0)) {
+                fprintf(stderr, "Incorrect number of arguments\n");
+                usage(argv[0]);
+        }
+        bool limited = snapshotAt != RUN_UNLIMITED || 
+                       budget != RUN_UNLIMITED || timeout > 0;
+        if (snapshotAt != RUN_UNLIMITED && savePath == NULL) {
+                fprintf(stderr, "--snapshot-at needs --save-snapshot\n");
+                usage(argv[0]);
+        }
+#ifdef UM_SAFE
+        if (useJit) {
+                fprintf(stderr, "Compiled code is not checked, so um-safe "
+                                "cannot --jit\n");
+                usage(argv[0]);
+        }
+#endif
+        if (symbolsPath != NULL && profilePath == NULL) {
+                fprintf(stderr, "--symbols needs --profile\n");
+                usage(argv[0]);
+        }
+        if (ringBytes > 0 && (tracePath == NULL || replay)) {
+                fprintf(stderr, "--trace-ring needs --trace\n");
+                usage(argv[0]);
+        }
+        if (tracePath != NULL && (useJit || profilePath != NULL)) {
+                fprintf(stderr, "--trace and --replay cannot be combined "
+                                "with --jit or --profile\n");
+                usage(argv[0]);
+        }
+        if (useJit && profilePath != NULL) {
+                fprintf(stderr, "--profile counts every instruction, so "
+                                "cannot be combined with --jit\n");
+                usage(argv[0]);
+        }
+        if (useJit && (limited || showCount)) {
+                fprintf(stderr, "--jit does not count instructions, so "
+                                "cannot be limited or --count\n");
+                usage(argv[0]);
+        }
+
+        FILE *input = NULL;
+        Mem_T memory;
+        IODev_T io = initIODev(STDIN_FILENO, STDOUT_FILENO, flushPolicy);
+        double loadStart = clockMs();
+        if (restorePath != NULL) {
+                memory = restoreSnapshot(restorePath, io);
+                if (memory == NULL) {
+                        fprintf(stderr, "%s: not a readable UM snapshot\n", 
+                                restorePath);
+                        exit(EXIT_FAILURE);
+                }
+        } else {
+                char *filename = argv[argi];
+                input = fopen(filename, "rb");
+                if (input == NULL) {
+                        fprintf(stderr, "%s: No such file or directory\n", 
+                                filename);
+                        exit(EXIT_FAILURE);
+                }
+
+                memory = loadProgram(input);
+                if (memory == NULL) {
+                        fprintf(stderr, "%s: cannot read program\n", 
+                                filename);
+                        exit(EXIT_FAILURE);
+                }
+        }
+        double loadTime = clockMs() - loadStart;
+        slabPrefault(memory->slab, prefault);
+
+        Profile_T prof = NULL;
+        Jit_T jit = NULL;
+        Trace_T trace = NULL;
+        if (tracePath != NULL) {
+                trace = openTrace(tracePath, replay, ringBytes);
+                if (trace == NULL) {
+                        fprintf(stderr, "%s: cannot open %s\n", argv[0], 
+                                tracePath);
+                        exit(EXIT_FAILURE);
+                }
+                /* A ring trace brings its own machine to start from */
+                if (replay && !startReplay(trace, io, &memory)) {
+                        fprintf(stderr, "%s: not a readable UM trace\n",
+                                tracePath);
+                        exit(EXIT_FAILURE);
+                }
+                slabPrefault(memory->slab, prefault);
+        } else if (profilePath != NULL) {
+                prof = initProfile();
+                if (symbolsPath != NULL && !loadSymbols(prof, symbolsPath)) {
+                        fprintf(stderr, "%s: cannot read symbol map %s\n",
+                                argv[0], symbolsPath);
+                        exit(EXIT_FAILURE);
+                }
+        } else if (useJit) {
+                jit = initJit();
+                if (jit == NULL) {
+                        fprintf(stderr, "%s: cannot run compiled code "
+                                        "here, interpreting\n", argv[0]);
+                }
+        }
+        RunLimits limits = { snapshotAt, 0 };
+        if (budget < RUN_UNLIMITED - memory->retired && 
+            memory->retired + budget < limits.maxRetired) {
+                limits.maxRetired = memory->retired + budget;
+        }
+        if (timeout > 0) {
+                limits.deadlineMs = clockMs() + timeout * 1000;
+        }
+
+        Run_status status = RUN_HALTED;
+        double runStart = clockMs();
+        if (trace != NULL) {
+                status = traceExecInstructions(trace, memory, io, 
+                                               limited ? &limits : NULL);
+        } else if (prof != NULL) {
+                status = profExecInstructions(prof, memory, io, 
+                                              limited ? &limits : NULL);
+        } else if (jit != NULL) {
+                status = jitExecInstructions(jit, memory, io);
+        } else {
+                status = execInstructions(memory, io, 
+                                          limited ? &limits : NULL);
+        }
+        double runTime = clockMs() - runStart;
+        if (savePath != NULL && !saveSnapshot(memory, io, savePath)) {
+                fprintf(stderr, "%s: cannot write %s\n", argv[0], savePath);
+        }
+        freeIODev(io);
+        if (status != RUN_HALTED) {
+                reportStop(status, memory);
+        }
+        bool traced = closeTrace(trace);
+        if (!traced && !replay) {
+                fprintf(stderr, "%s: cannot write %s\n", argv[0], tracePath);
+        }
+
+        if (showCount || (showStats && jit == NULL)) {
+                fprintf(stderr, "instructions:        %llu\n", 
+                        (unsigned long long)memory->retired);
+        }
+        if (showStats) {
+                struct rusage self;
+                getrusage(RUSAGE_SELF, &self);
+                fprintf(stderr, "load time:           %.3f ms\n", loadTime);
+                fprintf(stderr, "run time:            %.3f ms\n", runTime);
+                fprintf(stderr, "peak rss:            %ld KiB\n", 
+                        self.ru_maxrss);
+                printMemStats(memory, stderr);
+                if (jit != NULL) {
+                        printJitStats(jit, stderr);
+                }
+        }
+        if (prof != NULL) {
+                printProfile(prof, stderr);
+                if (!writeFlatProfile(prof, profilePath)) {
+                        fprintf(stderr, "%s: cannot write %s\n", argv[0], 
+                                profilePath);
+                }
+        }
+        freeProfile(prof);
+        freeJit(jit);
+        freeMem(memory);
+
+        
+        if (input != NULL) {
+                fclose(input);
+        }
+        
+        return traced && (status == RUN_HALTED || 
+                          (savePath != NULL && status != RUN_NOMEM))
+               ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
@@ -0,0 +1,136 @@
+/*
+ *     filename: umasm.c
+ *     partner 1 name: Jack Burton       Login: jburto05
+ *     partner 2 name: James Hartley        Login: jhartl01
+ *     date: April 13th, 2024
+ *     assignment: hw6
+ *
+ *     summary: Implements umasm, which assembles .ums modules, in the
+ *     HW8 macro syntax, and links them into one .um program
+ *
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#include "asm.h"
+
+/********** usage ********
+ *
+ * Prints command line usage and exits with EXIT_FAILURE
+ *
+ * Parameters:
+ *     char *progname: Name the program was invoked as
+ *
+ * Return: None
+ *
+************************/
+static void usage(char *progname)
+{
+        fprintf(stderr, "Usage: %s [options] file.ums...\n", progname);
+        fprintf(stderr, "  -o FILE          write the program to FILE "
+                        "(default a.um)\n");
+        fprintf(stderr, "  --map FILE       write the offset of every "
+                        "label to FILE, for\n"
+                        "                   um --symbols\n");
+        fprintf(stderr, "  --no-zero-fill   store trailing zero words "
+                        "(.space) in the image\n"
+                        "                   rather than have a boot stub "
+                        "map them\n");
+        fprintf(stderr, "  --no-optimize    leave out the peephole "
+                        "pass\n");
+        fprintf(stderr, "  --stats          print the size of the "
+                        "program, and what the\n"
+                        "                   peephole pass removed, to "
+                        "stderr\n");
+        exit(EXIT_FAILURE);
+}
+
+/* Counts the instructions of every section */
+static uint32_t countInstructions(Asm_T as)
+{
+        uint32_t n = 0;
+        for (uint32_t s = 0; s < as->numSections; s++) {
+                const Section *section = &as->sections[s];
+                for (uint32_t i = 0; i < section->numItems; i++) {
+                        n += section->items[i].kind == ITEM_INSN;
+                }
+        }
+        return n;
+}
+
+/********** main ********
+ *
+ * Assembles and links the modules named on the command line, in order;
+ * the first one's first section starts the program
+ *
+ * Parameters:
+ *     int argc: Number of command line arguments
+ *     char *argv[]: Options, then the .ums files
+ *
+ * Return: EXIT_SUCCESS, or EXIT_FAILURE if there were errors, which are
+ *         reported to stderr
+ *
+************************/
+int main(int argc, char *argv[])
+{
+        char *output = "a.um", *mapFile = NULL;
+        bool zeroFill = true, optimize = true, stats = false;
+        int argi = 1;
+        for (; argi < argc && argv[argi][0] == '-'; argi++) {
+                if (strcmp(argv[argi], "-o") == 0 && argi + 1 < argc) {
+                        output = argv[++argi];
+                } else if (strcmp(argv[argi], "--map") == 0 &&
+                           argi + 1 < argc) {
+                        mapFile = argv[++argi];
+                } else if (strcmp(argv[argi], "--no-zero-fill") == 0) {
+                        zeroFill = false;
+                } else if (strcmp(argv[argi], "--no-optimize") == 0) {
+                        optimize = false;
+                } else if (strcmp(argv[argi], "--stats") == 0) {
+                        stats = true;
+                } else {
+                        fprintf(stderr, "Unknown option %s\n", argv[argi]);
+                        usage(argv[0]);
+                }
+        }
+        if (argi == argc) {
+                usage(argv[0]);
+        }
+
+        Asm_T as = initAsm();
+        for (; argi < argc; argi++) {
+                assembleFile(as, argv[argi]);
+        }
+        uint32_t before = countInstructions(as), removed = 0;
+        if (optimize && as->errors == 0) {
+                removed = optimizeProgram(as);
+        }
+        Asm_image image = { NULL, 0, 0, 0 };
+        bool ok = as->errors == 0 && linkProgram(as, zeroFill, &image);
+        if (ok && !writeImage(&image, output)) {
+                fprintf(stderr, "umasm: cannot write %s\n", output);
+                ok = false;
+        }
+        if (ok && mapFile != NULL && !writeSymbolMap(as, mapFile)) {
+                fprintf(stderr, "umasm: cannot write %s\n", mapFile);
+                ok = false;
+        }
+        if (!ok && as->errors > 0) {
+                fprintf(stderr, "umasm: %d error%s\n", as->errors,
+                        as->errors == 1 ? "" : "s");
+        }
+        if (ok && stats) {
+                fprintf(stderr, "image words:     %u (boot stub %u)\n",
+                        (unsigned)image.length, (unsigned)image.stub);
+                fprintf(stderr, "segment 0 words: %u\n",
+                        (unsigned)image.total);
+                fprintf(stderr, "peephole removed %u of %u instructions\n",
+                        (unsigned)removed, (unsigned)before);
+        }
+
+        free(image.words);
+        freeAsm(as);
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,605 @@
+/*
+ *     filename: umbatch.c
+ *     partner 1 name: Jack Burton       Login: jburto05
+ *     partner 2 name: James Hartley        Login: jhartl01
+ *     date: April 11th, 2024
+ *     assignment: hw6
+ *
+ *     summary: Implements um-batch, which runs many independent UM jobs
+ *     on a pool of threads, one per core. Each job runs in a child
+ *     process of its own, reading its input file and writing its own
+ *     output file, so a job that faults or runs out of memory fails
+ *     alone; idle threads steal jobs from the others' queues.
+ *
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/wait.h>
+#include "memload.h"
+
+/* Size of a cache line, to keep each queue's hot word to itself */
+#define CACHE_LINE 64
+
+/* Bytes of the reason a job failed, as reported in the summary */
+#define JOB_WHY 64
+
+/* JobResult
+ * Usage: What a job's child process reports back through its pipe
+ *
+ * Members:
+ * 	uint64_t retired: Instructions the job executed
+ * 	bool failed: The job did not halt: a file could not be opened, the
+ * 		program could not be loaded, a MAP found no memory, it hit
+ * 		its limits or its process died
+ * 	char why[JOB_WHY]: Why it failed
+ *
+*/
+typedef struct JobResult {
+        uint64_t retired;
+        bool failed;
+        char why[JOB_WHY];
+} JobResult;
+
+/* Job
+ * Usage: One run of a UM program
+ *
+ * Members:
+ * 	char *program: .um file to run
+ * 	char *input: File IN reads from, or NULL for no input
+ * 	char *output: File OUT writes to, created or truncated
+ * 	uint64_t budget: Instructions it may run, or RUN_UNLIMITED
+ * 	double timeout: Seconds it may run, or 0 for no limit
+ * 	JobResult result: How it went
+ *
+*/
+typedef struct Job {
+        char *program;
+        char *input;
+        char *output;
+        uint64_t budget;
+        double timeout;
+        JobResult result;
+} Job;
+
+/* JobQueue
+ * Usage: Jobs dealt to one worker, which others may steal from
+ *
+ * Members:
+ * 	uint64_t range: Unclaimed jobs[head, tail), head in the high 32
+ * 		bits and tail in the low 32. Every claim is one
+ * 		compare-and-swap of this word: the owner takes from the tail,
+ * 		thieves from the head, so no locks are needed.
+ * 	uint32_t *jobs: Indices into the batch's job array
+ *
+*/
+typedef struct JobQueue {
+        uint64_t range;
+        uint32_t *jobs;
+        char pad[CACHE_LINE - sizeof(uint64_t) - sizeof(uint32_t *)];
+} JobQueue;
+
+/* Worker
+ * Usage: One thread of the pool and its counters
+ *
+ * Members:
+ * 	pthread_t thread: The thread
+ * 	uint32_t id: Index of the worker, and of its own queue
+ * 	uint32_t numWorkers: Size of the pool
+ * 	JobQueue *queues: Every worker's queue
+ * 	Job *jobs: The batch's jobs
+ * 	uint64_t retired, jobsRun, steals: Totals over the jobs it ran
+ *
+*/
+typedef struct Worker {
+        pthread_t thread;
+        uint32_t id;
+        uint32_t numWorkers;
+        JobQueue *queues;
+        Job *jobs;
+        uint64_t retired;
+        uint64_t jobsRun;
+        uint64_t steals;
+} Worker;
+
+static double nowMs(void)
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+/********** claimJob ********
+ *
+ * Takes one job off a queue, from the tail for its owner or the head for
+ * a thief
+ *
+ * Parameters:
+ *     JobQueue *queue: Queue to take from
+ *     bool fromHead: Whether the caller is stealing
+ *     uint32_t *job: Set to the job's index
+ *
+ * Return: true if a job was taken, false if the queue is empty
+ *
+ * Notes
+ *      Lock-free: a failed compare-and-swap means another thread claimed
+ *      a job from the same queue, and the claim is retried
+ ************************/
+static bool claimJob(JobQueue *queue, bool fromHead, uint32_t *job)
+{
+        uint64_t range = __atomic_load_n(&queue->range, __ATOMIC_ACQUIRE);
+        for (;;) {
+                uint32_t head = range >> 32;
+                uint32_t tail = (uint32_t)range;
+                if (head == tail) {
+                        return false;
+                }
+                uint32_t taken = fromHead ? head : tail - 1;
+                uint64_t rest = fromHead ? (uint64_t)(head + 1) << 32 | tail
+                                         : (uint64_t)head << 32 | (tail - 1);
+                if (__atomic_compare_exchange_n(&queue->range, &range, rest,
+                                                false, __ATOMIC_ACQ_REL,
+                                                __ATOMIC_ACQUIRE)) {
+                        *job = queue->jobs[taken];
+                        return true;
+                }
+        }
+}
+
+/********** runMachine ********
+ *
+ * Runs one job in the calling process, which is the job's child
+ *
+ * Parameters:
+ *     const Job *job: Job to run
+ *
+ * Return: How the job went
+ *
+ ************************/
+static JobResult runMachine(const Job *job)
+{
+        JobResult result;
+        memset(&result, 0, sizeof(result));
+        FILE *fp = fopen(job->program, "rb");
+        int inFd = open(job->input != NULL ? job->input : "/dev/null",
+                        O_RDONLY);
+        int outFd = open(job->output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        Mem_T mem = NULL;
+        if (fp == NULL || inFd < 0 || outFd < 0) {
+                snprintf(result.why, sizeof(result.why), "cannot open %s",
+                         fp == NULL ? job->program 
+                         : inFd < 0 ? job->input : job->output);
+                result.failed = true;
+        } else if ((mem = loadProgram(fp)) == NULL) {
+                snprintf(result.why, sizeof(result.why), 
+                         "cannot read program");
+                result.failed = true;
+        } else {
+                RunLimits limits = { job->budget, 0 };
+                if (job->timeout > 0) {
+                        limits.deadlineMs = clockMs() + 
+                                            job->timeout * 1000;
+                }
+                IODev_T io = initIODev(inFd, outFd, FLUSH_FULL);
+                Run_status status = execInstructions(mem, io, &limits);
+                freeIODev(io);
+                result.retired = mem->retired;
+                result.failed = status != RUN_HALTED;
+                snprintf(result.why, sizeof(result.why), "%s", 
+                         status == RUN_BUDGET ? "instruction limit reached"
+                         : status == RUN_DEADLINE ? "deadline passed"
+                         : status == RUN_NOMEM ? "no memory for a MAP" 
+                                               : "");
+                freeMem(mem);
+        }
+
+        if (fp != NULL) {
+                fclose(fp);
+        }
+        if (inFd >= 0) {
+                close(inFd);
+        }
+        if (outFd >= 0) {
+                close(outFd);
+        }
+        return result;
+}
+
+/********** runJob ********
+ *
+ * Runs one job to completion in a child process, waiting on the calling
+ * thread
+ *
+ * Parameters:
+ *     Job *job: Job to run; its result is filled in
+ *
+ * Return: None
+ *
+ * Notes
+ *      The machine is not checked (like um's), so a job that divides by
+ *      zero or loads from an unmapped segment may crash; in its own
+ *      process that kills only the job, which is marked failed with the
+ *      signal, and the batch carries on. The child only runs the job
+ *      and writes its JobResult down a pipe before _exit.
+ ************************/
+static void runJob(Job *job)
+{
+        JobResult *result = &job->result;
+        int fds[2];
+        pid_t pid = -1;
+        if (pipe(fds) == 0) {
+                pid = fork();
+                if (pid < 0) {
+                        close(fds[0]);
+                        close(fds[1]);
+                }
+        }
+        if (pid < 0) {
+                snprintf(result->why, sizeof(result->why), 
+                         "cannot start: %s", strerror(errno));
+                result->failed = true;
+                return;
+        }
+        if (pid == 0) {
+                close(fds[0]);
+                JobResult ran = runMachine(job);
+                ssize_t n = write(fds[1], &ran, sizeof(ran));
+                _exit(n == (ssize_t)sizeof(ran) ? EXIT_SUCCESS 
+                                                 : EXIT_FAILURE);
+        }
+
+        close(fds[1]);
+        ssize_t n;
+        do {
+                n = read(fds[0], result, sizeof(*result));
+        } while (n < 0 && errno == EINTR);
+        close(fds[0]);
+        int wstatus = 0;
+        while (waitpid(pid, &wstatus, 0) < 0 && errno == EINTR) {
+        }
+        if (WIFSIGNALED(wstatus)) {
+                memset(result, 0, sizeof(*result));
+                snprintf(result->why, sizeof(result->why), 
+                         "killed by signal %d (%s)", WTERMSIG(wstatus),
+                         strsignal(WTERMSIG(wstatus)));
+                result->failed = true;
+        } else if (n != (ssize_t)sizeof(*result)) {
+                memset(result, 0, sizeof(*result));
+                snprintf(result->why, sizeof(result->why), 
+                         "exited with status %d", WEXITSTATUS(wstatus));
+                result->failed = true;
+        }
+}
+
+/********** runWorker ********
+ *
+ * Thread body: runs jobs from the worker's own queue, then steals from
+ * the others until every queue is empty
+ *
+ * Parameters:
+ *     void *arg: The Worker
+ *
+ * Return: NULL
+ *
+ ************************/
+static void *runWorker(void *arg)
+{
+        Worker *self = arg;
+        for (;;) {
+                uint32_t job;
+                bool found = claimJob(&self->queues[self->id], false, &job);
+                for (uint32_t k = 1; !found && k < self->numWorkers; k++) {
+                        uint32_t victim = (self->id + k) % self->numWorkers;
+                        found = claimJob(&self->queues[victim], true, &job);
+                        self->steals += found;
+                }
+                if (!found) {
+                        return NULL;
+                }
+                runJob(&self->jobs[job]);
+                self->retired += self->jobs[job].result.retired;
+                self->jobsRun++;
+        }
+}
+
+/********** nextField ********
+ *
+ * Splits the next field off a job line: a run of characters other than
+ * blanks, or a double-quoted string, which may hold blanks
+ *
+ * Parameters:
+ *     char **cursor: Where the rest of the line starts; moved past the
+ *                    field
+ *     bool *bad: Set if a quoted field is not closed
+ *
+ * Return: The field, terminated in place, or NULL at the end of the line
+ *
+ ************************/
+static char *nextField(char **cursor, bool *bad)
+{
+        char *at = *cursor + strspn(*cursor, " \t\r\n");
+        if (*at == '\0') {
+                *cursor = at;
+                return NULL;
+        }
+        char *field = at;
+        if (*at == '"') {
+                field = ++at;
+                at = strchr(at, '"');
+                if (at == NULL) {
+                        *bad = true;
+                        *cursor = field + strlen(field);
+                        return NULL;
+                }
+        } else {
+                at += strcspn(at, " \t\r\n");
+        }
+        if (*at != '\0') {
+                *at++ = '\0';
+        }
+        *cursor = at;
+        return field;
+}
+
+/********** parseLimit ********
+ *
+ * Reads a "--budget=N" or "--timeout=SECS" field into a job
+ *
+ * Parameters:
+ *     const char *field: Field of a job line
+ *     Job *job: Job whose limits to set
+ *     bool *bad: Set if the field names a limit but its value is bad
+ *
+ * Return: true if the field is a limit, false if it is a file name
+ *
+ ************************/
+static bool parseLimit(const char *field, Job *job, bool *bad)
+{
+        char *end;
+        if (strncmp(field, "--budget=", 9) == 0) {
+                job->budget = strtoull(field + 9, &end, 10);
+                *bad |= field[9] == '\0' || field[9] == '-' || *end != '\0';
+                return true;
+        }
+        if (strncmp(field, "--timeout=", 10) == 0) {
+                job->timeout = strtod(field + 10, &end);
+                *bad |= field[10] == '\0' || *end != '\0' || 
+                        !(job->timeout > 0);
+                return true;
+        }
+        return false;
+}
+
+/********** readJobs ********
+ *
+ * Reads a job list: one job per line, "PROGRAM [INPUT [OUTPUT]]" plus
+ * optional "--budget=N" and "--timeout=SECS" fields, skipping blank lines
+ * and lines starting with '#'
+ *
+ * Parameters:
+ *     FILE *fp: Job list
+ *     const char *name: Its name, for errors
+ *     Job **jobsp: Set to the array of jobs read, which the caller frees
+ *     uint32_t *numJobs: Set to the number of jobs read
+ *
+ * Return: true on success, false (after reporting the line) if a line
+ *         has too many fields, an unclosed quote or a bad limit
+ *
+ * Notes
+ *      Fields are separated by blanks; a name with blanks in it is
+ *      written in double quotes. INPUT "-" means no input. OUTPUT
+ *      defaults to "jobN.out", N counting jobs from 0. Without limits a
+ *      job runs until it halts.
+ ************************/
+static bool readJobs(FILE *fp, const char *name, Job **jobsp, 
+                     uint32_t *numJobs)
+{
+        Job *jobs = NULL;
+        uint32_t count = 0, capacity = 0, lineNum = 0;
+        char *line = NULL;
+        size_t lineSize = 0;
+        bool bad = false;
+
+        while (!bad && getline(&line, &lineSize, fp) != -1) {
+                lineNum++;
+                char *cursor = line;
+                char *program = nextField(&cursor, &bad);
+                if (!bad && (program == NULL || program[0] == '#')) {
+                        continue;
+                }
+
+                if (count == capacity) {
+                        capacity = capacity == 0 ? 64 : 2 * capacity;
+                        jobs = realloc(jobs, capacity * sizeof(*jobs));
+                        assert(jobs != NULL);
+                }
+                Job *job = &jobs[count];
+                memset(job, 0, sizeof(*job));
+                job->budget = RUN_UNLIMITED;
+                char *files[2] = { NULL, NULL };
+                int numFiles = 0;
+                char *field;
+                while ((field = nextField(&cursor, &bad)) != NULL) {
+                        if (parseLimit(field, job, &bad)) {
+                                continue;
+                        }
+                        if (numFiles == 2) {
+                                bad = true;
+                                break;
+                        }
+                        files[numFiles++] = field;
+                }
+                if (bad) {
+                        fprintf(stderr, "%s: line %u: bad job\n", name, 
+                                lineNum);
+                        break;
+                }
+
+                job->program = strdup(program);
+                if (files[0] != NULL && strcmp(files[0], "-") != 0) {
+                        job->input = strdup(files[0]);
+                }
+                if (files[1] != NULL) {
+                        job->output = strdup(files[1]);
+                } else {
+                        char out[32];
+                        snprintf(out, sizeof(out), "job%u.out", count);
+                        job->output = strdup(out);
+                }
+                count++;
+        }
+        free(line);
+        *jobsp = jobs;
+        *numJobs = count;
+        return !bad;
+}
+
+static void usage(char *progname)
+{
+        fprintf(stderr, "Usage: %s [-j THREADS] JOBFILE\n"
+                        "  JOBFILE has one job per line: PROGRAM.um "
+                        "[INPUT|- [OUTPUT]]\n"
+                        "  [--budget=N] [--timeout=SECS], quoting "
+                        "names with blanks in \"\"\n"
+                        "  (\"-\" reads the job list from stdin; THREADS "
+                        "defaults to one per core)\n", progname);
+        exit(EXIT_FAILURE);
+}
+
+/********** main ********
+ *
+ * Reads the job list, deals the jobs round-robin to one queue per
+ * thread, runs the pool and reports totals, then each failed job, to
+ * stderr
+ *
+ * Parameters:
+ *     int argc: Number of arguments
+ *     char *argv[]: Options, then the job list
+ *
+ * Return: EXIT_SUCCESS if every job halted, EXIT_FAILURE otherwise
+ *
+ * Notes
+ *      If a thread cannot be created, no more are, and the main thread
+ *      runs in its place; the queues of workers never started are
+ *      emptied by stealing, so every job still runs
+ ************************/
+int main(int argc, char *argv[])
+{
+        long numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+        int argi = 1;
+        if (argi + 1 < argc && strcmp(argv[argi], "-j") == 0) {
+                numThreads = strtol(argv[argi + 1], NULL, 10);
+                argi += 2;
+        }
+        if (argc - argi != 1 || numThreads < 1) {
+                usage(argv[0]);
+        }
+
+        FILE *list = strcmp(argv[argi], "-") == 0 ? stdin
+                                                   : fopen(argv[argi], "r");
+        if (list == NULL) {
+                fprintf(stderr, "%s: No such file or directory\n",
+                        argv[argi]);
+                exit(EXIT_FAILURE);
+        }
+        Job *jobs;
+        uint32_t numJobs;
+        bool ok = readJobs(list, argv[argi], &jobs, &numJobs);
+        if (list != stdin) {
+                fclose(list);
+        }
+        if (!ok) {
+                exit(EXIT_FAILURE);
+        }
+        if ((uint32_t)numThreads > numJobs && numJobs > 0) {
+                numThreads = numJobs;
+        }
+
+        uint32_t numWorkers = numThreads;
+        JobQueue *queues = calloc(numWorkers, sizeof(*queues));
+        Worker *workers = calloc(numWorkers, sizeof(*workers));
+        assert(queues != NULL && workers != NULL);
+        for (uint32_t w = 0; w < numWorkers; w++) {
+                uint32_t share = numJobs / numWorkers +
+                                 (w < numJobs % numWorkers);
+                queues[w].jobs = malloc((share + 1) * sizeof(uint32_t));
+                assert(queues[w].jobs != NULL);
+                for (uint32_t i = 0; i < share; i++) {
+                        queues[w].jobs[i] = w + i * numWorkers;
+                }
+                queues[w].range = share;
+        }
+
+        double start = nowMs();
+        uint32_t started = 0;
+        for (; started < numWorkers; started++) {
+                Worker *worker = &workers[started];
+                worker->id = started;
+                worker->numWorkers = numWorkers;
+                worker->queues = queues;
+                worker->jobs = jobs;
+                int err = pthread_create(&worker->thread, NULL, runWorker,
+                                         worker);
+                if (err != 0) {
+                        fprintf(stderr, "um-batch: cannot create thread "
+                                        "%u: %s\n", started, strerror(err));
+                        break;
+                }
+        }
+        uint32_t numRan = started;
+        if (started < numWorkers) {
+                runWorker(&workers[started]);
+                numRan++;
+        }
+        uint64_t retired = 0, steals = 0;
+        for (uint32_t w = 0; w < numRan; w++) {
+                if (w < started) {
+                        pthread_join(workers[w].thread, NULL);
+                }
+                retired += workers[w].retired;
+                steals += workers[w].steals;
+        }
+        double elapsed = nowMs() - start;
+
+        uint32_t failed = 0;
+        for (uint32_t i = 0; i < numJobs; i++) {
+                failed += jobs[i].result.failed;
+        }
+        fprintf(stderr, "jobs:                %u (%u failed)\n", numJobs,
+                failed);
+        fprintf(stderr, "threads:             %u\n", numRan);
+        fprintf(stderr, "jobs stolen:         %llu\n",
+                (unsigned long long)steals);
+        fprintf(stderr, "instructions:        %llu\n",
+                (unsigned long long)retired);
+        fprintf(stderr, "wall time:           %.3f ms\n", elapsed);
+        fprintf(stderr, "instructions/second: %.0f\n",
+                elapsed > 0 ? retired / (elapsed / 1000.0) : 0.0);
+        for (uint32_t i = 0; i < numJobs; i++) {
+                if (jobs[i].result.failed) {
+                        fprintf(stderr, "failed: job %u, %s: %s\n", i,
+                                jobs[i].program, jobs[i].result.why);
+                }
+                free(jobs[i].program);
+                free(jobs[i].input);
+                free(jobs[i].output);
+        }
+
+        for (uint32_t w = 0; w < numWorkers; w++) {
+                free(queues[w].jobs);
+        }
+        free(queues);
+        free(workers);
+        free(jobs);
+        return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,348 @@
+/*
+ *     filename: umdis.c
+ *     partner 1 name: Jack Burton       Login: jburto05
+ *     partner 2 name: James Hartley        Login: jhartl01
+ *     date: April 12th, 2024
+ *     assignment: hw6
+ *
+ *     summary: Implements umdis, which inspects a .um file without
+ *     running it: a disassembly split into basic blocks, the program's
+ *     control-flow graph, or its static instruction mix
+ *
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <sys/stat.h>
+#include "cfg.h"
+
+/* Opcode field values, including the two that are not instructions */
+#define NUM_OPS 16
+
+static const char *opNames[NUM_OPS] = {
+        "CMOV", "SLOAD", "SSTORE", "ADD", "MUL", "DIV", "NAND", "HALT",
+        "MAP", "UNMAP", "OUT", "IN", "LOADP", "LOADV", "INVALID14",
+        "INVALID15"
+};
+
+static const char *exitNames[] = {
+        "fall", "jump", "branch", "call", "indirect", "load", "halt",
+        "invalid", "end"
+};
+
+/********** usage ********
+ *
+ * Prints command line usage and exits with EXIT_FAILURE
+ *
+ * Parameters:
+ *     char *progname: Name the program was invoked as
+ *
+ * Return: None
+ *
+************************/
+static void usage(char *progname)
+{
+        fprintf(stderr, "Usage: %s [options] file.um\n", progname);
+        fprintf(stderr, "  --cfg            print the control-flow graph, "
+                        "a block per line, instead\n"
+                        "                   of the disassembly\n");
+        fprintf(stderr, "  --mix            print the static instruction "
+                        "mix and block counts\n"
+                        "                   instead of the disassembly\n");
+        fprintf(stderr, "  --r0-zero        take r0 to be always 0, as in "
+                        "HW8 code, so that its\n"
+                        "                   gotos are known jumps\n");
+        exit(EXIT_FAILURE);
+}
+
+/********** readProgram ********
+ *
+ * Reads a .um file into host-order words
+ *
+ * Parameters:
+ *     const char *path: File to read
+ *     uint32_t *length: Set to its number of words
+ *
+ * Return: The words, or NULL if the file cannot be read or is not a
+ *         whole number of words
+ *
+************************/
+static uint32_t *readProgram(const char *path, uint32_t *length)
+{
+        struct stat st;
+        if (stat(path, &st) != 0 || st.st_size % 4 != 0 ||
+            st.st_size / 4 > UINT32_MAX) {
+                return NULL;
+        }
+        FILE *fp = fopen(path, "rb");
+        if (fp == NULL) {
+                return NULL;
+        }
+
+        *length = st.st_size / 4;
+        uint8_t *bytes = malloc((size_t)st.st_size + 1);
+        uint32_t *words = malloc(((size_t)*length + 1) * sizeof(*words));
+        assert(bytes != NULL && words != NULL);
+        bool ok = fread(bytes, 1, st.st_size, fp) == (size_t)st.st_size;
+        fclose(fp);
+        for (uint32_t i = 0; i < *length; i++) {
+                const uint8_t *b = bytes + 4 * (size_t)i;
+                words[i] = (uint32_t)b[0] << 24 | (uint32_t)b[1] << 16 |
+                           (uint32_t)b[2] << 8 | b[3];
+        }
+        free(bytes);
+        if (!ok) {
+                free(words);
+                return NULL;
+        }
+        return words;
+}
+
+/********** printInstruction ********
+ *
+ * Prints one word in umasm syntax
+ *
+ * Parameters:
+ *     FILE *fp: Stream to print to
+ *     uint32_t word: The word
+ *
+ * Return: None
+ *
+************************/
+static void printInstruction(FILE *fp, uint32_t word)
+{
+        Decoded ins = decodeWord(word);
+        int a = ins.a, b = ins.b, c = ins.c;
+        switch (ins.op) {
+        case D_CMOV:
+                fprintf(fp, "if (r%d != 0) r%d := r%d", c, a, b);
+                break;
+        case D_SLOAD:
+                fprintf(fp, "r%d := m[r%d][r%d]", a, b, c);
+                break;
+        case D_SSTORE:
+                fprintf(fp, "m[r%d][r%d] := r%d", a, b, c);
+                break;
+        case D_ADD:
+                fprintf(fp, "r%d := r%d + r%d", a, b, c);
+                break;
+        case D_MUL:
+                fprintf(fp, "r%d := r%d * r%d", a, b, c);
+                break;
+        case D_DIV:
+                fprintf(fp, "r%d := r%d / r%d", a, b, c);
+                break;
+        case D_NAND:
+                fprintf(fp, "r%d := ~(r%d & r%d)", a, b, c);
+                break;
+        case D_HALT:
+                fprintf(fp, "halt");
+                break;
+        case D_MAP:
+                fprintf(fp, "r%d := map segment (r%d words)", b, c);
+                break;
+        case D_UNMAP:
+                fprintf(fp, "unmap m[r%d]", c);
+                break;
+        case D_OUT:
+                fprintf(fp, "output r%d", c);
+                break;
+        case D_IN:
+                fprintf(fp, "r%d := input()", c);
+                break;
+        case D_LOADP:
+                fprintf(fp, "goto r%d in program m[r%d]", c, b);
+                break;
+        case D_LOADV:
+                fprintf(fp, "r%d := %u", a, (unsigned)ins.value);
+                break;
+        default:
+                fprintf(fp, ".data 0x%08x", (unsigned)word);
+                break;
+        }
+}
+
+/* Prints a block's exit and successors, as "KIND [SUCC [SUCC]]" */
+static void printExit(FILE *fp, const Block *block)
+{
+        fprintf(fp, "%s", exitNames[block->exit]);
+        for (int i = 0; i < 2; i++) {
+                if (block->succ[i] != CFG_NONE) {
+                        fprintf(fp, " %u", (unsigned)block->succ[i]);
+                }
+        }
+}
+
+/********** printListing ********
+ *
+ * Prints the disassembly: every word with its offset and hex encoding,
+ * under a comment line opening each block
+ *
+ * Parameters:
+ *     FILE *fp: Stream to print to
+ *     Cfg_T cfg: The program's graph
+ *     const uint32_t *words: The program
+ *
+ * Return: None
+ *
+************************/
+static void printListing(FILE *fp, Cfg_T cfg, const uint32_t *words)
+{
+        for (uint32_t i = 0; i < cfg->numBlocks; i++) {
+                const Block *block = &cfg->blocks[i];
+                fprintf(fp, "// block %u-%u: ", (unsigned)block->start,
+                        (unsigned)block->end - 1);
+                printExit(fp, block);
+                fprintf(fp, "%s\n", block->reachable ? ""
+                                                     : " (unreachable)");
+                for (uint32_t offset = block->start; offset < block->end;
+                     offset++) {
+                        fprintf(fp, "%10u  %08x  ", (unsigned)offset,
+                                (unsigned)words[offset]);
+                        printInstruction(fp, words[offset]);
+                        fputc('\n', fp);
+                }
+        }
+}
+
+/********** printCfg ********
+ *
+ * Prints the control-flow graph, one line per block:
+ *     START END EXIT [SUCC [SUCC]] [unreachable]
+ * where END is one past the block's last offset and EXIT is one of
+ * exitNames; START and END are decimal offsets in segment 0. A first line
+ * "cfg WORDS BLOCKS" gives the program's size.
+ *
+ * Parameters:
+ *     FILE *fp: Stream to print to
+ *     Cfg_T cfg: The graph
+ *
+ * Return: None
+ *
+************************/
+static void printCfg(FILE *fp, Cfg_T cfg)
+{
+        fprintf(fp, "cfg %u %u\n", (unsigned)cfg->length,
+                (unsigned)cfg->numBlocks);
+        for (uint32_t i = 0; i < cfg->numBlocks; i++) {
+                const Block *block = &cfg->blocks[i];
+                fprintf(fp, "%u %u ", (unsigned)block->start,
+                        (unsigned)block->end);
+                printExit(fp, block);
+                fprintf(fp, "%s\n", block->reachable ? "" : " unreachable");
+        }
+}
+
+/********** printMix ********
+ *
+ * Prints the static instruction mix, over the whole program and over
+ * the blocks reachable from offset 0, and the number of blocks ending
+ * each way
+ *
+ * Parameters:
+ *     FILE *fp: Stream to print to
+ *     Cfg_T cfg: The program's graph
+ *     const uint32_t *words: The program
+ *
+ * Return: None
+ *
+************************/
+static void printMix(FILE *fp, Cfg_T cfg, const uint32_t *words)
+{
+        uint64_t all[NUM_OPS] = { 0 }, reached[NUM_OPS] = { 0 };
+        uint64_t exits[BLOCK_END + 1] = { 0 };
+        uint64_t numReached = 0, reachedBlocks = 0;
+        for (uint32_t i = 0; i < cfg->numBlocks; i++) {
+                const Block *block = &cfg->blocks[i];
+                exits[block->exit]++;
+                reachedBlocks += block->reachable;
+                for (uint32_t offset = block->start; offset < block->end;
+                     offset++) {
+                        int op = words[offset] >> 28;
+                        all[op]++;
+                        if (block->reachable) {
+                                reached[op]++;
+                                numReached++;
+                        }
+                }
+        }
+
+        fprintf(fp, "words:               %u\n", (unsigned)cfg->length);
+        fprintf(fp, "reachable words:     %llu\n",
+                (unsigned long long)numReached);
+        fprintf(fp, "blocks:              %u (%llu reachable)\n",
+                (unsigned)cfg->numBlocks, (unsigned long long)reachedBlocks);
+        for (int exit = 0; exit <= BLOCK_END; exit++) {
+                fprintf(fp, "  ending %-9s %12llu\n", exitNames[exit],
+                        (unsigned long long)exits[exit]);
+        }
+        fprintf(fp, "\n%-9s %12s %8s %12s %8s\n", "opcode", "all", "",
+                "reachable", "");
+        for (int op = 0; op < NUM_OPS; op++) {
+                if (all[op] == 0) {
+                        continue;
+                }
+                fprintf(fp, "%-9s %12llu %7.2f%% %12llu %7.2f%%\n",
+                        opNames[op], (unsigned long long)all[op],
+                        100.0 * all[op] / cfg->length,
+                        (unsigned long long)reached[op],
+                        numReached ? 100.0 * reached[op] / numReached : 0);
+        }
+}
+
+/********** main ********
+ *
+ * Disassembles a .um file, or prints its graph or instruction mix
+ *
+ * Parameters:
+ *     int argc: Number of command line arguments
+ *     char *argv[]: Options, then the .um file
+ *
+ * Return: EXIT_SUCCESS, or EXIT_FAILURE if the file cannot be read
+ *
+************************/
+int main(int argc, char *argv[])
+{
+        bool showCfg = false, showMix = false, r0Zero = false;
+        int argi = 1;
+        for (; argi < argc && strncmp(argv[argi], "--", 2) == 0; argi++) {
+                if (strcmp(argv[argi], "--cfg") == 0) {
+                        showCfg = true;
+                } else if (strcmp(argv[argi], "--mix") == 0) {
+                        showMix = true;
+                } else if (strcmp(argv[argi], "--r0-zero") == 0) {
+                        r0Zero = true;
+                } else {
+                        fprintf(stderr, "Unknown option %s\n", argv[argi]);
+                        usage(argv[0]);
+                }
+        }
+        if (argc - argi != 1 || (showCfg && showMix)) {
+                usage(argv[0]);
+        }
+
+        uint32_t length;
+        uint32_t *words = readProgram(argv[argi], &length);
+        if (words == NULL) {
+                fprintf(stderr, "%s: not a readable .um file\n",
+                        argv[argi]);
+                exit(EXIT_FAILURE);
+        }
+        Cfg_T cfg = buildCfg(words, length, r0Zero);
+
+        static char outBuf[1 << 16];
+        setvbuf(stdout, outBuf, _IOFBF, sizeof(outBuf));
+        if (showCfg) {
+                printCfg(stdout, cfg);
+        } else if (showMix) {
+                printMix(stdout, cfg, words);
+        } else {
+                printListing(stdout, cfg, words);
+        }
+
+        freeCfg(cfg);
+        free(words);
+        return EXIT_SUCCESS;
+}